@@ -22,37 +22,51 @@
  */
 
 #include <stdlib.h>
+#include <unistd.h>
 
 #define LOG_TAG "terrain"
 #include "libcc/cc_log.h"
+#include "terrain/terrain_exporter.h"
+#include "terrain/terrain_index.h"
+#include "terrain/terrain_pool.h"
 #include "terrain/terrain_tile.h"
 #include "terrain/terrain_util.h"
 
-/***********************************************************
-* protected                                                *
-***********************************************************/
-
-extern int terrain_tile_export(terrain_tile_t* self,
-                               const char* base);
+// background tile writer
+#define CROP_WRITERS 4
+#define CROP_DEPTH   32
 
 /***********************************************************
 * private                                                  *
 ***********************************************************/
 
-static int crop(const char* src,
-                const char* dst,
+static int crop(terrain_pool_t* pool,
+                terrain_exporter_t* exporter,
+                terrain_index_t* index,
+                const char* src,
                 int zoom, int x, int y,
                 double latT, double lonL,
                 double latB, double lonR)
 {
+	ASSERT(pool);
+	ASSERT(exporter);
 	ASSERT(src);
-	ASSERT(dst);
 
+	// read the header from the src index when available
 	short min;
 	short max;
 	int   flags;
-	if(terrain_tile_header(src, x, y, zoom,
-	                       &min, &max, &flags) == 0)
+	if(index)
+	{
+		if(terrain_index_header(index, x, y, zoom,
+		                        &min, &max, &flags) == 0)
+		{
+			LOGE("invalid %i/%i/%i", zoom, x, y);
+			return 0;
+		}
+	}
+	else if(terrain_tile_header(src, x, y, zoom,
+	                            &min, &max, &flags) == 0)
 	{
 		return 0;
 	}
@@ -90,7 +104,8 @@ static int crop(const char* src,
 		else
 		{
 			LOGI("PICK: %i/%i/%i", zoom + 1, 2*x, 2*y);
-			if(crop(src, dst, zoom + 1, 2*x, 2*y,
+			if(crop(pool, exporter, index, src,
+			        zoom + 1, 2*x, 2*y,
 			        latT, lonL, latB, lonR) == 0)
 			{
 				return 0;
@@ -111,7 +126,8 @@ static int crop(const char* src,
 		else
 		{
 			LOGI("PICK: %i/%i/%i", zoom + 1, 2*x + 1, 2*y);
-			if(crop(src, dst, zoom + 1, 2*x + 1, 2*y,
+			if(crop(pool, exporter, index, src,
+			        zoom + 1, 2*x + 1, 2*y,
 			        latT, lonL, latB, lonR) == 0)
 			{
 				return 0;
@@ -132,7 +148,8 @@ static int crop(const char* src,
 		else
 		{
 			LOGI("PICK: %i/%i/%i", zoom + 1, 2*x, 2*y + 1);
-			if(crop(src, dst, zoom + 1, 2*x, 2*y + 1,
+			if(crop(pool, exporter, index, src,
+			        zoom + 1, 2*x, 2*y + 1,
 			        latT, lonL, latB, lonR) == 0)
 			{
 				return 0;
@@ -153,7 +170,8 @@ static int crop(const char* src,
 		else
 		{
 			LOGI("PICK: %i/%i/%i", zoom + 1, 2*x + 1, 2*y + 1);
-			if(crop(src, dst, zoom + 1, 2*x + 1, 2*y + 1,
+			if(crop(pool, exporter, index, src,
+			        zoom + 1, 2*x + 1, 2*y + 1,
 			        latT, lonL, latB, lonR) == 0)
 			{
 				return 0;
@@ -163,7 +181,7 @@ static int crop(const char* src,
 
 	// read tile from src
 	terrain_tile_t* tile;
-	tile = terrain_tile_import(src, x, y, zoom);
+	tile = terrain_pool_importTile(pool, src, x, y, zoom);
 	if(tile == NULL)
 	{
 		return 0;
@@ -176,19 +194,19 @@ static int crop(const char* src,
 	}
 
 	// write tile to dst
-	if(terrain_tile_export(tile, dst) == 0)
+	if(terrain_exporter_export(exporter, tile) == 0)
 	{
 		goto fail_export;
 	}
 
-	terrain_tile_delete(&tile);
+	terrain_pool_put(pool, &tile);
 
 	// success
 	return 1;
 
 	// failure
 	fail_export:
-		terrain_tile_delete(&tile);
+		terrain_pool_put(pool, &tile);
 	return 0;
 }
 
@@ -212,11 +230,60 @@ int main(int argc, const char** argv)
 	const char* src  = argv[5];
 	const char* dst  = argv[6];
 
-	if(crop(src, dst, 0, 0, 0,
-	        latT, lonL, latB, lonR) == 0)
+	// tiles are imported one at a time and copied by the
+	// exporter so a single tile is recycled
+	terrain_pool_t* pool = terrain_pool_new(1);
+	if(pool == NULL)
 	{
 		return EXIT_FAILURE;
 	}
 
+	terrain_exporter_t* exporter;
+	exporter = terrain_exporter_new(dst, CROP_WRITERS,
+	                                CROP_DEPTH);
+	if(exporter == NULL)
+	{
+		goto fail_exporter;
+	}
+
+	// the src index is optional
+	terrain_index_t* index = NULL;
+	char iname[256];
+	terrain_index_name(src, iname);
+	if(access(iname, F_OK) == 0)
+	{
+		index = terrain_index_open(src);
+		if(index == NULL)
+		{
+			goto fail_index;
+		}
+	}
+
+	if(crop(pool, exporter, index, src, 0, 0, 0,
+	        latT, lonL, latB, lonR) == 0)
+	{
+		goto fail_crop;
+	}
+
+	if(terrain_exporter_finish(exporter) == 0)
+	{
+		goto fail_finish;
+	}
+
+	terrain_index_close(&index);
+	terrain_exporter_delete(&exporter);
+	terrain_pool_delete(&pool);
+
+	// success
 	return EXIT_SUCCESS;
+
+	// failure
+	fail_finish:
+	fail_crop:
+		terrain_index_close(&index);
+	fail_index:
+		terrain_exporter_delete(&exporter);
+	fail_exporter:
+		terrain_pool_delete(&pool);
+	return EXIT_FAILURE;
 }
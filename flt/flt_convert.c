@@ -0,0 +1,392 @@
+/*
+ * Copyright (c) 2020 Jeff Boody
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+	#include <immintrin.h>
+	#define FLT_CONVERT_X86
+#endif
+
+#define LOG_TAG "flt"
+#include "../../libcc/cc_log.h"
+#include "flt_convert.h"
+#include "flt_tile.h"
+
+// ASTERv3 nodata value
+#define FLT_CONVERT_NODATA -9999
+
+static int flt_convert_kernel = -1;
+
+/***********************************************************
+* private                                                  *
+***********************************************************/
+
+static float meters2feet(float m)
+{
+	return m*5280.0f/1609.344f;
+}
+
+static void
+flt_convert_f32Scalar(short* dst, const unsigned char* src,
+                      int count, int byteorder)
+{
+	ASSERT(dst);
+	ASSERT(src);
+
+	int i;
+	if(byteorder == FLT_MSBFIRST)
+	{
+		for(i = 0; i < count; ++i)
+		{
+			// need to swap byte order for big endian
+			unsigned char data[4] =
+			{
+				src[4*i + 3], src[4*i + 2],
+				src[4*i + 1], src[4*i + 0],
+			};
+
+			// convert data to feet
+			float height;
+			memcpy(&height, data, sizeof(float));
+			dst[i] = (short) (meters2feet(height) + 0.5f);
+		}
+	}
+	else
+	{
+		for(i = 0; i < count; ++i)
+		{
+			// convert data to feet
+			float height;
+			memcpy(&height, &src[4*i], sizeof(float));
+			dst[i] = (short) (meters2feet(height) + 0.5f);
+		}
+	}
+}
+
+static void
+flt_convert_i16Scalar(short* dst, const short* src,
+                      int count)
+{
+	ASSERT(dst);
+	ASSERT(src);
+
+	int i;
+	for(i = 0; i < count; ++i)
+	{
+		// ignore nodata values
+		short t = src[i];
+		if(t == FLT_CONVERT_NODATA)
+		{
+			t = 0;
+		}
+
+		dst[i] = (short) (meters2feet((float) t) + 0.5f);
+	}
+}
+
+#ifdef FLT_CONVERT_X86
+
+// The float to short conversion truncates to a 32-bit
+// integer and keeps the low 16 bits. The kernels match
+// this by sign extending the low 16 bits before packing
+// rather than relying on the saturation of packs.
+
+__attribute__((target("ssse3")))
+static void
+flt_convert_f32Ssse3(short* dst, const unsigned char* src,
+                     int count, int byteorder)
+{
+	ASSERT(dst);
+	ASSERT(src);
+
+	const __m128i swap = _mm_setr_epi8(3, 2, 1, 0,
+	                                   7, 6, 5, 4,
+	                                   11, 10, 9, 8,
+	                                   15, 14, 13, 12);
+	const __m128 m2f  = _mm_set1_ps(5280.0f);
+	const __m128 mile = _mm_set1_ps(1609.344f);
+	const __m128 half = _mm_set1_ps(0.5f);
+
+	int i = 0;
+	for(; i + 8 <= count; i += 8)
+	{
+		__m128i a = _mm_loadu_si128((const __m128i*)
+		                            &src[4*i]);
+		__m128i b = _mm_loadu_si128((const __m128i*)
+		                            &src[4*i + 16]);
+		if(byteorder == FLT_MSBFIRST)
+		{
+			a = _mm_shuffle_epi8(a, swap);
+			b = _mm_shuffle_epi8(b, swap);
+		}
+
+		__m128 fa = _mm_div_ps(_mm_mul_ps(_mm_castsi128_ps(a),
+		                                  m2f), mile);
+		__m128 fb = _mm_div_ps(_mm_mul_ps(_mm_castsi128_ps(b),
+		                                  m2f), mile);
+		a = _mm_cvttps_epi32(_mm_add_ps(fa, half));
+		b = _mm_cvttps_epi32(_mm_add_ps(fb, half));
+		a = _mm_srai_epi32(_mm_slli_epi32(a, 16), 16);
+		b = _mm_srai_epi32(_mm_slli_epi32(b, 16), 16);
+		_mm_storeu_si128((__m128i*) &dst[i],
+		                 _mm_packs_epi32(a, b));
+	}
+
+	flt_convert_f32Scalar(&dst[i], &src[4*i], count - i,
+	                      byteorder);
+}
+
+__attribute__((target("ssse3")))
+static void
+flt_convert_i16Ssse3(short* dst, const short* src,
+                     int count)
+{
+	ASSERT(dst);
+	ASSERT(src);
+
+	const __m128i nodata = _mm_set1_epi16(FLT_CONVERT_NODATA);
+	const __m128  m2f    = _mm_set1_ps(5280.0f);
+	const __m128  mile   = _mm_set1_ps(1609.344f);
+	const __m128  half   = _mm_set1_ps(0.5f);
+
+	int i = 0;
+	for(; i + 8 <= count; i += 8)
+	{
+		__m128i t = _mm_loadu_si128((const __m128i*) &src[i]);
+		t = _mm_andnot_si128(_mm_cmpeq_epi16(t, nodata), t);
+
+		// sign extend to 32-bits
+		__m128i a = _mm_srai_epi32(_mm_unpacklo_epi16(t, t), 16);
+		__m128i b = _mm_srai_epi32(_mm_unpackhi_epi16(t, t), 16);
+
+		__m128 fa = _mm_div_ps(_mm_mul_ps(_mm_cvtepi32_ps(a),
+		                                  m2f), mile);
+		__m128 fb = _mm_div_ps(_mm_mul_ps(_mm_cvtepi32_ps(b),
+		                                  m2f), mile);
+		a = _mm_cvttps_epi32(_mm_add_ps(fa, half));
+		b = _mm_cvttps_epi32(_mm_add_ps(fb, half));
+		a = _mm_srai_epi32(_mm_slli_epi32(a, 16), 16);
+		b = _mm_srai_epi32(_mm_slli_epi32(b, 16), 16);
+		_mm_storeu_si128((__m128i*) &dst[i],
+		                 _mm_packs_epi32(a, b));
+	}
+
+	flt_convert_i16Scalar(&dst[i], &src[i], count - i);
+}
+
+__attribute__((target("avx2")))
+static void
+flt_convert_f32Avx2(short* dst, const unsigned char* src,
+                    int count, int byteorder)
+{
+	ASSERT(dst);
+	ASSERT(src);
+
+	const __m256i swap = _mm256_setr_epi8(3, 2, 1, 0,
+	                                      7, 6, 5, 4,
+	                                      11, 10, 9, 8,
+	                                      15, 14, 13, 12,
+	                                      3, 2, 1, 0,
+	                                      7, 6, 5, 4,
+	                                      11, 10, 9, 8,
+	                                      15, 14, 13, 12);
+	const __m256 m2f  = _mm256_set1_ps(5280.0f);
+	const __m256 mile = _mm256_set1_ps(1609.344f);
+	const __m256 half = _mm256_set1_ps(0.5f);
+
+	int i = 0;
+	for(; i + 16 <= count; i += 16)
+	{
+		__m256i a = _mm256_loadu_si256((const __m256i*)
+		                               &src[4*i]);
+		__m256i b = _mm256_loadu_si256((const __m256i*)
+		                               &src[4*i + 32]);
+		if(byteorder == FLT_MSBFIRST)
+		{
+			a = _mm256_shuffle_epi8(a, swap);
+			b = _mm256_shuffle_epi8(b, swap);
+		}
+
+		__m256 fa = _mm256_div_ps(_mm256_mul_ps(_mm256_castsi256_ps(a),
+		                                        m2f), mile);
+		__m256 fb = _mm256_div_ps(_mm256_mul_ps(_mm256_castsi256_ps(b),
+		                                        m2f), mile);
+		a = _mm256_cvttps_epi32(_mm256_add_ps(fa, half));
+		b = _mm256_cvttps_epi32(_mm256_add_ps(fb, half));
+		a = _mm256_srai_epi32(_mm256_slli_epi32(a, 16), 16);
+		b = _mm256_srai_epi32(_mm256_slli_epi32(b, 16), 16);
+
+		// packs interleaves the 128-bit lanes
+		__m256i c = _mm256_packs_epi32(a, b);
+		c = _mm256_permute4x64_epi64(c, 0xD8);
+		_mm256_storeu_si256((__m256i*) &dst[i], c);
+	}
+
+	flt_convert_f32Scalar(&dst[i], &src[4*i], count - i,
+	                      byteorder);
+}
+
+__attribute__((target("avx2")))
+static void
+flt_convert_i16Avx2(short* dst, const short* src,
+                    int count)
+{
+	ASSERT(dst);
+	ASSERT(src);
+
+	const __m256i nodata = _mm256_set1_epi16(FLT_CONVERT_NODATA);
+	const __m256  m2f    = _mm256_set1_ps(5280.0f);
+	const __m256  mile   = _mm256_set1_ps(1609.344f);
+	const __m256  half   = _mm256_set1_ps(0.5f);
+
+	int i = 0;
+	for(; i + 16 <= count; i += 16)
+	{
+		__m256i t = _mm256_loadu_si256((const __m256i*)
+		                               &src[i]);
+		t = _mm256_andnot_si256(_mm256_cmpeq_epi16(t, nodata), t);
+
+		// sign extend to 32-bits
+		__m256i a = _mm256_cvtepi16_epi32(_mm256_castsi256_si128(t));
+		__m256i b = _mm256_cvtepi16_epi32(_mm256_extracti128_si256(t, 1));
+
+		__m256 fa = _mm256_div_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(a),
+		                                        m2f), mile);
+		__m256 fb = _mm256_div_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(b),
+		                                        m2f), mile);
+		a = _mm256_cvttps_epi32(_mm256_add_ps(fa, half));
+		b = _mm256_cvttps_epi32(_mm256_add_ps(fb, half));
+		a = _mm256_srai_epi32(_mm256_slli_epi32(a, 16), 16);
+		b = _mm256_srai_epi32(_mm256_slli_epi32(b, 16), 16);
+
+		// packs interleaves the 128-bit lanes
+		__m256i c = _mm256_packs_epi32(a, b);
+		c = _mm256_permute4x64_epi64(c, 0xD8);
+		_mm256_storeu_si256((__m256i*) &dst[i], c);
+	}
+
+	flt_convert_i16Scalar(&dst[i], &src[i], count - i);
+}
+
+#endif
+
+static int flt_convert_detect(void)
+{
+	#ifdef FLT_CONVERT_X86
+	__builtin_cpu_init();
+	if(__builtin_cpu_supports("avx2"))
+	{
+		return FLT_CONVERT_AVX2;
+	}
+	else if(__builtin_cpu_supports("ssse3"))
+	{
+		return FLT_CONVERT_SSSE3;
+	}
+	#endif
+
+	return FLT_CONVERT_SCALAR;
+}
+
+static int flt_convert_get(void)
+{
+	int kernel = __atomic_load_n(&flt_convert_kernel,
+	                             __ATOMIC_RELAXED);
+	if(kernel < 0)
+	{
+		kernel = flt_convert_detect();
+		__atomic_store_n(&flt_convert_kernel, kernel,
+		                 __ATOMIC_RELAXED);
+	}
+
+	return kernel;
+}
+
+/***********************************************************
+* public                                                   *
+***********************************************************/
+
+int flt_convert_select(int kernel)
+{
+	// the kernel is limited to those supported by the CPU
+	int supported = flt_convert_detect();
+	if(kernel > supported)
+	{
+		kernel = supported;
+	}
+	else if(kernel < FLT_CONVERT_SCALAR)
+	{
+		kernel = FLT_CONVERT_SCALAR;
+	}
+
+	__atomic_store_n(&flt_convert_kernel, kernel,
+	                 __ATOMIC_RELAXED);
+
+	return kernel;
+}
+
+void flt_convert_f32(short* dst, const unsigned char* src,
+                     int count, int byteorder)
+{
+	ASSERT(dst);
+	ASSERT(src);
+
+	#ifdef FLT_CONVERT_X86
+	int kernel = flt_convert_get();
+	if(kernel == FLT_CONVERT_AVX2)
+	{
+		flt_convert_f32Avx2(dst, src, count, byteorder);
+		return;
+	}
+	else if(kernel == FLT_CONVERT_SSSE3)
+	{
+		flt_convert_f32Ssse3(dst, src, count, byteorder);
+		return;
+	}
+	#endif
+
+	flt_convert_f32Scalar(dst, src, count, byteorder);
+}
+
+void flt_convert_i16(short* dst, const short* src,
+                     int count)
+{
+	ASSERT(dst);
+	ASSERT(src);
+
+	#ifdef FLT_CONVERT_X86
+	int kernel = flt_convert_get();
+	if(kernel == FLT_CONVERT_AVX2)
+	{
+		flt_convert_i16Avx2(dst, src, count);
+		return;
+	}
+	else if(kernel == FLT_CONVERT_SSSE3)
+	{
+		flt_convert_i16Ssse3(dst, src, count);
+		return;
+	}
+	#endif
+
+	flt_convert_i16Scalar(dst, src, count);
+}
@@ -0,0 +1,43 @@
+/*
+ * Copyright (c) 2020 Jeff Boody
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#ifndef flt_convert_H
+#define flt_convert_H
+
+// conversion kernels
+#define FLT_CONVERT_SCALAR 0
+#define FLT_CONVERT_SSSE3  1
+#define FLT_CONVERT_AVX2   2
+
+// The conversion kernels convert heights in meters to
+// heights in feet with the same rounding as the scalar
+// expression (short) (meters2feet(m) + 0.5f). The kernel
+// is selected on first use from the features supported by
+// the CPU.
+int  flt_convert_select(int kernel);
+void flt_convert_f32(short* dst, const unsigned char* src,
+                     int count, int byteorder);
+void flt_convert_i16(short* dst, const short* src,
+                     int count);
+
+#endif
@@ -0,0 +1,548 @@
+/*
+ * Copyright (c) 2020 Jeff Boody
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define LOG_TAG "flt"
+#include "../../libcc/cc_log.h"
+#include "../../libcc/cc_memory.h"
+#include "../../libxmlstream/xml_istream.h"
+#include "flt_extent.h"
+
+#define FLT_EXTENT_MAGIC   "FLTEXT"
+#define FLT_EXTENT_VERSION 1
+#define FLT_EXTENT_DIR     "ASTERv3/zip"
+
+// files is the number of xml files scanned which may
+// exceed count when xml files are invalid
+typedef struct
+{
+	char     magic[8];
+	uint32_t version;
+	uint32_t count;
+	uint32_t files;
+	uint32_t pad;
+} flt_extentHeader_t;
+
+// extent table
+// records are referenced in place from the map or are
+// allocated when the table cannot be persisted
+static pthread_mutex_t     flt_extent_mutex    = PTHREAD_MUTEX_INITIALIZER;
+static int                 flt_extent_loaded   = 0;
+static void*               flt_extent_map      = NULL;
+static size_t              flt_extent_mapSize  = 0;
+static flt_extentRecord_t* flt_extent_records  = NULL;
+static int                 flt_extent_count    = 0;
+
+/***********************************************************
+* private                                                  *
+***********************************************************/
+
+static int
+flt_extent_xmlStart(void* priv, int line, float progress,
+                    const char* name, const char** atts)
+{
+	// ignore
+	return 1;
+}
+
+static int
+flt_extent_xmlEnd(void* priv, int line, float progress,
+                  const char* name, const char* content)
+{
+	// content may be NULL
+	ASSERT(priv);
+	ASSERT(name);
+
+	flt_extentRecord_t* self = (flt_extentRecord_t*) priv;
+
+	double* coord = NULL;
+	if(strcmp(name, "NorthBoundingCoordinate") == 0)
+	{
+		coord = &self->latT;
+	}
+	else if(strcmp(name, "WestBoundingCoordinate") == 0)
+	{
+		coord = &self->lonL;
+	}
+	else if(strcmp(name, "SouthBoundingCoordinate") == 0)
+	{
+		coord = &self->latB;
+	}
+	else if(strcmp(name, "EastBoundingCoordinate") == 0)
+	{
+		coord = &self->lonR;
+	}
+	else
+	{
+		// ignore
+		return 1;
+	}
+
+	if(content == NULL)
+	{
+		LOGE("%i/%i: content is NULL",
+		     (int) self->lat, (int) self->lon);
+		return 0;
+	}
+	*coord = strtod(content, NULL);
+
+	return 1;
+}
+
+static void
+flt_extent_xmlName(int lat, int lon, char* fname)
+{
+	ASSERT(fname);
+
+	snprintf(fname, 256,
+	         "%s/ASTGTMV003_%s%02i%s%03i.zip.xml",
+	         FLT_EXTENT_DIR,
+	         (lat >= 0) ? "N" : "S", abs(lat),
+	         (lon >= 0) ? "E" : "W", abs(lon));
+}
+
+static int
+flt_extent_parse(flt_extentRecord_t* rec, int lat, int lon)
+{
+	ASSERT(rec);
+
+	char fname[256];
+	flt_extent_xmlName(lat, lon, fname);
+
+	// default to the nominal extent like flt_tile
+	memset(rec, 0, sizeof(flt_extentRecord_t));
+	rec->lat  = (int16_t) lat;
+	rec->lon  = (int16_t) lon;
+	rec->lonL = (double) lon;
+	rec->latB = (double) lat;
+	rec->lonR = (double) lon + 1.0;
+	rec->latT = (double) lat + 1.0;
+
+	return xml_istream_parse((void*) rec,
+	                         flt_extent_xmlStart,
+	                         flt_extent_xmlEnd,
+	                         fname);
+}
+
+static int
+flt_extent_name(const char* name, int* _lat, int* _lon)
+{
+	ASSERT(name);
+	ASSERT(_lat);
+	ASSERT(_lon);
+
+	// names are matched by regenerating them since
+	// sscanf accepts variations such as a missing zero
+	// padding or a suffix
+	char ns;
+	char ew;
+	int  lat;
+	int  lon;
+	char buf[256];
+	if(sscanf(name, "ASTGTMV003_%c%2d%c%3d", &ns, &lat,
+	          &ew, &lon) != 4)
+	{
+		return 0;
+	}
+	snprintf(buf, 256, "ASTGTMV003_%c%02i%c%03i.zip.xml",
+	         ns, lat, ew, lon);
+	if((strcmp(buf, name) != 0)         ||
+	   ((ns != 'N') && (ns != 'S')) ||
+	   ((ew != 'E') && (ew != 'W')))
+	{
+		return 0;
+	}
+
+	*_lat = (ns == 'N') ? lat : -lat;
+	*_lon = (ew == 'E') ? lon : -lon;
+	return 1;
+}
+
+static int
+flt_extent_scan(time_t mtime, int* _files)
+{
+	ASSERT(_files);
+
+	// count the xml files and check if any are newer
+	// than mtime
+	int newer = 0;
+	*_files = 0;
+
+	DIR* dir = opendir(FLT_EXTENT_DIR);
+	if(dir == NULL)
+	{
+		return 0;
+	}
+
+	int lat;
+	int lon;
+	struct stat    st;
+	struct dirent* de;
+	char fname[512];
+	while((de = readdir(dir)))
+	{
+		if(flt_extent_name(de->d_name, &lat, &lon) == 0)
+		{
+			continue;
+		}
+
+		*_files += 1;
+
+		snprintf(fname, 512, "%s/%s", FLT_EXTENT_DIR,
+		         de->d_name);
+		if((stat(fname, &st) != 0) || (st.st_mtime > mtime))
+		{
+			newer = 1;
+		}
+	}
+
+	closedir(dir);
+
+	return newer;
+}
+
+static int flt_extent_compare(const void* a, const void* b)
+{
+	ASSERT(a);
+	ASSERT(b);
+
+	const flt_extentRecord_t* ra = (const flt_extentRecord_t*) a;
+	const flt_extentRecord_t* rb = (const flt_extentRecord_t*) b;
+
+	if(ra->lat != rb->lat)
+	{
+		return (ra->lat < rb->lat) ? -1 : 1;
+	}
+	if(ra->lon != rb->lon)
+	{
+		return (ra->lon < rb->lon) ? -1 : 1;
+	}
+	return 0;
+}
+
+static int flt_extent_import(void)
+{
+	int fd = open(FLT_EXTENT_FNAME, O_RDONLY);
+	if(fd < 0)
+	{
+		// rebuild silently
+		return 0;
+	}
+
+	struct stat st;
+	if(fstat(fd, &st) != 0)
+	{
+		LOGE("fstat %s failed", FLT_EXTENT_FNAME);
+		goto fail_stat;
+	}
+
+	size_t size = (size_t) st.st_size;
+	if(size < sizeof(flt_extentHeader_t))
+	{
+		LOGW("invalid %s", FLT_EXTENT_FNAME);
+		goto fail_stat;
+	}
+
+	void* map = mmap(NULL, size, PROT_READ, MAP_PRIVATE,
+	                 fd, 0);
+	if(map == MAP_FAILED)
+	{
+		LOGE("mmap %s failed", FLT_EXTENT_FNAME);
+		goto fail_stat;
+	}
+
+	// validate the header
+	flt_extentHeader_t* hdr = (flt_extentHeader_t*) map;
+	if((strncmp(hdr->magic, FLT_EXTENT_MAGIC, 8) != 0) ||
+	   (hdr->version != FLT_EXTENT_VERSION)             ||
+	   (size != sizeof(flt_extentHeader_t) +
+	            hdr->count*sizeof(flt_extentRecord_t)))
+	{
+		LOGW("invalid %s", FLT_EXTENT_FNAME);
+		goto fail_header;
+	}
+
+	// check if the xml files were modified
+	int files = 0;
+	if(flt_extent_scan(st.st_mtime, &files) ||
+	   (files != (int) hdr->files))
+	{
+		goto fail_header;
+	}
+
+	close(fd);
+
+	flt_extent_map     = map;
+	flt_extent_mapSize = size;
+	flt_extent_count   = (int) hdr->count;
+	flt_extent_records = (flt_extentRecord_t*)
+	                     ((unsigned char*) map +
+	                      sizeof(flt_extentHeader_t));
+
+	// success
+	return 1;
+
+	// failure
+	fail_header:
+		munmap(map, size);
+	fail_stat:
+		close(fd);
+	return 0;
+}
+
+static int
+flt_extent_export(flt_extentRecord_t* records, int count,
+                  int files)
+{
+	ASSERT(records || (count == 0));
+
+	char tname[256];
+	snprintf(tname, 256, "%s.part", FLT_EXTENT_FNAME);
+
+	FILE* f = fopen(tname, "w");
+	if(f == NULL)
+	{
+		LOGW("fopen %s failed", tname);
+		return 0;
+	}
+
+	flt_extentHeader_t hdr;
+	memset(&hdr, 0, sizeof(flt_extentHeader_t));
+	strncpy(hdr.magic, FLT_EXTENT_MAGIC, 8);
+	hdr.version = FLT_EXTENT_VERSION;
+	hdr.count   = (uint32_t) count;
+	hdr.files   = (uint32_t) files;
+	if((fwrite(&hdr, sizeof(hdr), 1, f) != 1) ||
+	   (fwrite(records, sizeof(flt_extentRecord_t),
+	           count, f) != count))
+	{
+		LOGW("fwrite %s failed", tname);
+		goto fail_write;
+	}
+
+	if(fclose(f) != 0)
+	{
+		LOGW("fclose %s failed", tname);
+		goto fail_close;
+	}
+
+	// readers never observe a partial table
+	if(rename(tname, FLT_EXTENT_FNAME) != 0)
+	{
+		LOGW("rename %s failed", FLT_EXTENT_FNAME);
+		goto fail_close;
+	}
+
+	// success
+	return 1;
+
+	// failure
+	fail_write:
+		fclose(f);
+	fail_close:
+		unlink(tname);
+	return 0;
+}
+
+static void flt_extent_build(void)
+{
+	DIR* dir = opendir(FLT_EXTENT_DIR);
+	if(dir == NULL)
+	{
+		// ASTERv3 is optional
+		return;
+	}
+
+	int                 lat;
+	int                 lon;
+	int                 files   = 0;
+	int                 count   = 0;
+	int                 size    = 0;
+	flt_extentRecord_t* records = NULL;
+	struct dirent*      de;
+	while((de = readdir(dir)))
+	{
+		if(flt_extent_name(de->d_name, &lat, &lon) == 0)
+		{
+			continue;
+		}
+
+		++files;
+
+		if(count == size)
+		{
+			int   size2 = size ? 2*size : 1024;
+			void* tmp   = REALLOC(records, size2*
+			                      sizeof(flt_extentRecord_t));
+			if(tmp == NULL)
+			{
+				LOGE("REALLOC failed");
+				goto fail_realloc;
+			}
+			records = (flt_extentRecord_t*) tmp;
+			size    = size2;
+		}
+
+		if(flt_extent_parse(&records[count], lat, lon) == 0)
+		{
+			LOGW("invalid %s", de->d_name);
+			continue;
+		}
+		++count;
+	}
+	closedir(dir);
+
+	qsort(records, count, sizeof(flt_extentRecord_t),
+	      flt_extent_compare);
+
+	// prefer mapping the persisted table but fall back to
+	// the records if the table cannot be written
+	if(flt_extent_export(records, count, files) &&
+	   flt_extent_import())
+	{
+		FREE(records);
+	}
+	else
+	{
+		flt_extent_records = records;
+		flt_extent_count   = count;
+	}
+
+	LOGI("parsed %i/%i extents", count, files);
+
+	// success
+	return;
+
+	// failure
+	fail_realloc:
+		FREE(records);
+		closedir(dir);
+}
+
+/***********************************************************
+* public                                                   *
+***********************************************************/
+
+int flt_extent_load(void)
+{
+	pthread_mutex_lock(&flt_extent_mutex);
+
+	if(flt_extent_loaded == 0)
+	{
+		if(flt_extent_import() == 0)
+		{
+			flt_extent_build();
+		}
+
+		__atomic_store_n(&flt_extent_loaded, 1,
+		                 __ATOMIC_RELEASE);
+	}
+
+	int count = flt_extent_count;
+
+	pthread_mutex_unlock(&flt_extent_mutex);
+
+	return count ? 1 : 0;
+}
+
+void flt_extent_unload(void)
+{
+	pthread_mutex_lock(&flt_extent_mutex);
+
+	if(flt_extent_map)
+	{
+		munmap(flt_extent_map, flt_extent_mapSize);
+	}
+	else
+	{
+		FREE(flt_extent_records);
+	}
+
+	flt_extent_map     = NULL;
+	flt_extent_mapSize = 0;
+	flt_extent_records = NULL;
+	flt_extent_count   = 0;
+
+	__atomic_store_n(&flt_extent_loaded, 0,
+	                 __ATOMIC_RELEASE);
+
+	pthread_mutex_unlock(&flt_extent_mutex);
+}
+
+int flt_extent_lookup(int lat, int lon,
+                      double* lonL, double* latB,
+                      double* lonR, double* latT)
+{
+	ASSERT(lonL);
+	ASSERT(latB);
+	ASSERT(lonR);
+	ASSERT(latT);
+
+	if(__atomic_load_n(&flt_extent_loaded,
+	                   __ATOMIC_ACQUIRE) == 0)
+	{
+		flt_extent_load();
+	}
+
+	flt_extentRecord_t key;
+	memset(&key, 0, sizeof(flt_extentRecord_t));
+	key.lat = (int16_t) lat;
+	key.lon = (int16_t) lon;
+
+	flt_extentRecord_t  rec;
+	flt_extentRecord_t* found = NULL;
+	if(flt_extent_count)
+	{
+		found = (flt_extentRecord_t*)
+		        bsearch(&key, flt_extent_records,
+		                flt_extent_count,
+		                sizeof(flt_extentRecord_t),
+		                flt_extent_compare);
+	}
+
+	if(found == NULL)
+	{
+		// parse xml files which are missing from the table
+		if(flt_extent_parse(&rec, lat, lon) == 0)
+		{
+			return 0;
+		}
+		found = &rec;
+	}
+
+	*lonL = found->lonL;
+	*latB = found->latB;
+	*lonR = found->lonR;
+	*latT = found->latT;
+	return 1;
+}
@@ -0,0 +1,56 @@
+/*
+ * Copyright (c) 2020 Jeff Boody
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+
+#ifndef flt_extent_H
+#define flt_extent_H
+
+#include <stdint.h>
+
+#define FLT_EXTENT_FNAME "ASTERv3/extent.bin"
+
+// The ASTERv3 extents are parsed from the
+// ASTERv3/zip/*.zip.xml files once and stored as a sorted
+// table in FLT_EXTENT_FNAME which is mapped on first use.
+// The table is rebuilt when an xml file is newer than the
+// table or when the number of xml files changes. Tiles
+// missing from the table fall back to parsing their xml
+// file.
+typedef struct
+{
+	int16_t lat;
+	int16_t lon;
+	int32_t pad;
+	double  lonL;
+	double  latB;
+	double  lonR;
+	double  latT;
+} flt_extentRecord_t;
+
+int  flt_extent_load(void);
+void flt_extent_unload(void);
+int  flt_extent_lookup(int lat, int lon,
+                       double* lonL, double* latB,
+                       double* lonR, double* latT);
+
+#endif
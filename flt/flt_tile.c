@@ -21,26 +21,84 @@
  *
  */
 
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <tiffio.h>
 #include <unistd.h>
+#include <zlib.h>
+
+#if defined(__SSE2__)
+	#include <emmintrin.h>
+#endif
 
 #define LOG_TAG "flt"
 #include "../../libcc/cc_log.h"
 #include "../../libcc/cc_memory.h"
-#include "../../libxmlstream/xml_istream.h"
+#include "flt_convert.h"
+#include "flt_extent.h"
 #include "flt_tile.h"
+#include "flt_zip.h"
+
+// int16 sidecar format
+// The header is padded to FLT_TILE_I16_HEADER bytes so that
+// raw heights are page aligned and may be mapped in place.
+// Zlib sidecars are followed by a table of chunks+1 file
+// offsets and each chunk contains FLT_TILE_BAND rows.
+#define FLT_TILE_I16_MAGIC   "FLTI16"
+#define FLT_TILE_I16_VERSION 1
+#define FLT_TILE_I16_HEADER  4096
+
+typedef struct
+{
+	char     magic[8];
+	uint32_t version;
+	int32_t  type;
+	int32_t  lat;
+	int32_t  lon;
+	int32_t  nrows;
+	int32_t  ncols;
+	int32_t  codec;
+	int32_t  band;
+	int32_t  chunks;
+	float    nodata;
+	double   lonL;
+	double   latB;
+	double   lonR;
+	double   latT;
+} flt_tileI16_t;
 
 /***********************************************************
 * private                                                  *
 ***********************************************************/
 
-static float meters2feet(float m)
+static void flt_tile_inflateBand(flt_tile_t* self, int band,
+                                 int row0, int row1)
 {
-	return m*5280.0f/1609.344f;
+	ASSERT(self);
+	ASSERT(self->map);
+
+	const unsigned char* map = (const unsigned char*) self->map;
+	const uint64_t* offset;
+	offset = (const uint64_t*) &map[FLT_TILE_I16_HEADER];
+
+	uLongf size = (uLongf) (row1 - row0)*self->ncols*
+	              sizeof(short);
+	uLongf dsize = size;
+	if((uncompress((Bytef*) &self->height[row0*self->ncols],
+	               &dsize, &map[offset[band]],
+	               (uLong) (offset[band + 1] - offset[band])) != Z_OK) ||
+	   (dsize != size))
+	{
+		LOGE("invalid %i/%i: band=%i",
+		     self->lat, self->lon, band);
+		memset(&self->height[row0*self->ncols], 0, size);
+	}
 }
 
 static int keyval(char* s, const char** k, const char** v)
@@ -93,21 +151,37 @@ static int keyval(char* s, const char** k, const char** v)
 	return 1;
 }
 
+static FILE*
+flt_tile_fopen(const char* zname, const char* fname)
+{
+	ASSERT(fname);
+
+	// read the file from the archive when zname is set
+	if(zname)
+	{
+		return flt_zip_stream(zname, fname);
+	}
+
+	return fopen(fname, "r");
+}
+
 static int
-flt_tile_importhdr(flt_tile_t* self, const char* fname)
+flt_tile_importhdr(flt_tile_t* self, const char* zname,
+                   const char* fname)
 {
 	ASSERT(self);
 	ASSERT(fname);
 
 	// ignore if file does not exist
-	if(access(fname, F_OK) != 0)
+	if((zname == NULL) && (access(fname, F_OK) != 0))
 	{
 		return 0;
 	}
 
-	LOGI("fname=%s", fname);
+	LOGI("fname=%s%s%s", zname ? zname : "",
+	     zname ? ":" : "", fname);
 
-	FILE* f = fopen(fname, "r");
+	FILE* f = flt_tile_fopen(zname, fname);
 	if(f == NULL)
 	{
 		LOGE("fopen %s failed", fname);
@@ -199,12 +273,13 @@ flt_tile_importhdr(flt_tile_t* self, const char* fname)
 }
 
 static int
-flt_tile_importprj(flt_tile_t* self, const char* fname)
+flt_tile_importprj(flt_tile_t* self, const char* zname,
+                   const char* fname)
 {
 	ASSERT(self);
 	ASSERT(fname);
 
-	FILE* f = fopen(fname, "r");
+	FILE* f = flt_tile_fopen(zname, fname);
 	if(f == NULL)
 	{
 		// skip silently
@@ -287,12 +362,13 @@ flt_tile_importprj(flt_tile_t* self, const char* fname)
 }
 
 static int
-flt_tile_importflt(flt_tile_t* self, const char* fname)
+flt_tile_importflt(flt_tile_t* self, const char* zname,
+                   const char* fname)
 {
 	ASSERT(self);
 	ASSERT(fname);
 
-	FILE* f = fopen(fname, "r");
+	FILE* f = flt_tile_fopen(zname, fname);
 	if(f == NULL)
 	{
 		// skip silently
@@ -333,41 +409,10 @@ flt_tile_importflt(flt_tile_t* self, const char* fname)
 			data += bytes;
 		}
 
-		// need to swap byte order for big endian
-		data = (unsigned char*) rdata;
-		if(self->byteorder == FLT_MSBFIRST)
-		{
-			int i;
-			for(i = 0; i < self->ncols; ++i)
-			{
-				unsigned char d0 = data[4*i + 0];
-				unsigned char d1 = data[4*i + 1];
-				unsigned char d2 = data[4*i + 2];
-				unsigned char d3 = data[4*i + 3];
-				data[4*i + 0] = d3;
-				data[4*i + 1] = d2;
-				data[4*i + 2] = d1;
-				data[4*i + 3] = d0;
-
-				// convert data to feet
-				float* height = (float*) &data[4*i];
-				int    idx    = row*self->ncols + i;
-				self->height[idx] = (short)
-				                    (meters2feet(*height) + 0.5f);
-			}
-		}
-		else
-		{
-			int i;
-			for(i = 0; i < self->ncols; ++i)
-			{
-				// convert data to feet
-				float* height = (float*) &data[4*i];
-				int    idx    = row*self->ncols + i;
-				self->height[idx] = (short)
-				                    (meters2feet(*height) + 0.5f);
-			}
-		}
+		// swap byte order and convert data to feet
+		flt_convert_f32(&self->height[row*self->ncols],
+		                (const unsigned char*) rdata,
+		                self->ncols, self->byteorder);
 	}
 
 	FREE(rdata);
@@ -387,317 +432,1677 @@ flt_tile_importflt(flt_tile_t* self, const char* fname)
 	return 0;
 }
 
-static int
-flt_tile_importtif(flt_tile_t* self, const char* fname)
+static int flt_tile_initLazy(flt_tile_t* self)
 {
 	ASSERT(self);
-	ASSERT(fname);
 
-	// ASTER v3
-	// https://lpdaac.usgs.gov/products/astgtmv003/
-
-	// ignore if file does not exist
-	if(access(fname, F_OK) != 0)
+	// pages of the height array are only committed once
+	// the corresponding band is converted
+	self->height_size = self->nrows*self->ncols*sizeof(short);
+	self->height = (short*)
+	               mmap(NULL, self->height_size,
+	                    PROT_READ | PROT_WRITE,
+	                    MAP_PRIVATE | MAP_ANONYMOUS |
+	                    MAP_NORESERVE, -1, 0);
+	if(self->height == MAP_FAILED)
 	{
-		return 0;
+		LOGE("mmap failed");
+		goto fail_height;
 	}
 
-	LOGI("fname=%s", fname);
+	int count = (self->nrows + FLT_TILE_BAND - 1)/FLT_TILE_BAND;
+	self->bands = (unsigned char*)
+	              CALLOC(count, sizeof(unsigned char));
+	if(self->bands == NULL)
+	{
+		LOGE("CALLOC failed");
+		goto fail_bands;
+	}
 
-	TIFF *tiff = TIFFOpen(fname, "r");
-	if(tiff == NULL)
+	if(pthread_mutex_init(&self->mutex, NULL) != 0)
 	{
-		LOGE("TIFFOpen failed");
-		return 0;
+		LOGE("pthread_mutex_init failed");
+		goto fail_mutex;
 	}
 
-	uint32_t w;
-	uint32_t h;
-	uint32_t tw;
-	uint32_t th;
-	uint16_t samples;
-	uint16_t bits;
-	uint16_t format;
-	TIFFGetField(tiff, TIFFTAG_IMAGEWIDTH, &w);
-	TIFFGetField(tiff, TIFFTAG_IMAGELENGTH, &h);
-	TIFFGetField(tiff, TIFFTAG_SAMPLESPERPIXEL, &samples);
-	TIFFGetField(tiff, TIFFTAG_BITSPERSAMPLE, &bits);
-	TIFFGetField(tiff, TIFFTAG_SAMPLEFORMAT, &format);
-	TIFFGetField(tiff, TIFFTAG_TILEWIDTH, &tw);
-	TIFFGetField(tiff, TIFFTAG_TILELENGTH, &th);
+	self->lazy = 1;
 
-	if((samples != 1) || (bits != 16) ||
-	   (format != SAMPLEFORMAT_INT))
+	// success
+	return 1;
+
+	// failure
+	fail_mutex:
+		FREE(self->bands);
+		self->bands = NULL;
+	fail_bands:
+		munmap(self->height, self->height_size);
+	fail_height:
+		self->height      = NULL;
+		self->height_size = 0;
+	return 0;
+}
+
+static int
+flt_tile_mapflt(flt_tile_t* self, const char* fname)
+{
+	ASSERT(self);
+	ASSERT(fname);
+
+	int fd = open(fname, O_RDONLY);
+	if(fd < 0)
 	{
-		LOGE("invalid params");
-		goto fail_param;
+		// skip silently
+		return 0;
 	}
 
-	short* tile = (short*) MALLOC(tw*th*sizeof(short));
-	if(tile == NULL)
+	struct stat st;
+	size_t rsize = self->ncols*sizeof(float);
+	size_t size  = self->nrows*rsize;
+	if((fstat(fd, &st) != 0) || (st.st_size < size))
 	{
-		LOGE("MALLOC failed");
-		goto fail_tile;
+		LOGE("invalid %s", fname);
+		goto fail_stat;
 	}
 
-	self->height = (short*) MALLOC(w*h*sizeof(short));
-	if(self->height == NULL)
+	self->map = mmap(NULL, size, PROT_READ, MAP_PRIVATE,
+	                 fd, 0);
+	if(self->map == MAP_FAILED)
 	{
-		LOGE("MALLOC failed");
-		goto fail_height;
+		LOGE("mmap %s failed", fname);
+		goto fail_map;
 	}
+	self->map_size = size;
 
-	// read tiles
-	int i;
-	int j;
-	int m;
-	int n;
-	for(i = 0; i < h; i += th)
+	if(flt_tile_initLazy(self) == 0)
 	{
-		for(j = 0; j < w; j += tw)
-		{
-			TIFFReadTile(tiff, tile, j, i, 0, 0);
-
-			// untile data and convert to feet
-			for(m = 0; m < th; ++m)
-			{
-				if(i + m >= h)
-				{
-					break;
-				}
-
-				for(n = 0; n < tw; ++n)
-				{
-					if(j + n >= w)
-					{
-						break;
-					}
-
-					// ignore nodata values
-					short t = tile[m*tw + n];
-					if(t == -9999)
-					{
-						t = 0;
-					}
-
-					int idx = (i+m)*w + j + n;
-					self->height[idx] = (short)
-					                    (meters2feet((float) t) + 0.5f);
-				}
-			}
-		}
+		goto fail_lazy;
 	}
-
-	self->nrows = h;
-	self->ncols = w;
-
-	FREE(tile);
-	TIFFClose(tiff);
+	close(fd);
 
 	// success
 	return 1;
 
 	// failure
-	fail_height:
-		FREE(tile);
-	fail_tile:
-	fail_param:
-		TIFFClose(tiff);
+	fail_lazy:
+		munmap(self->map, self->map_size);
+	fail_map:
+		self->map = NULL;
+	fail_stat:
+		close(fd);
 	return 0;
 }
 
 static int
-flt_tile_xmlStart(void* priv, int line, float progress,
-                  const char* name, const char** atts)
+flt_tile_importi16(flt_tile_t* self, const char* fname,
+                   int lazy)
 {
-	// ignore
-	return 1;
-}
+	ASSERT(self);
+	ASSERT(fname);
 
-static int
-flt_tile_xmlEnd(void* priv, int line, float progress,
-                const char* name, const char* content)
-{
-	// content may be NULL
-	ASSERT(priv);
-	ASSERT(name);
+	int fd = open(fname, O_RDONLY);
+	if(fd < 0)
+	{
+		// skip silently
+		return 0;
+	}
+
+	struct stat st;
+	if((fstat(fd, &st) != 0) ||
+	   (st.st_size < FLT_TILE_I16_HEADER))
+	{
+		LOGE("invalid %s", fname);
+		goto fail_stat;
+	}
 
-	flt_tile_t* self = (flt_tile_t*) priv;
+	size_t size = (size_t) st.st_size;
+	self->map = mmap(NULL, size, PROT_READ, MAP_PRIVATE,
+	                 fd, 0);
+	if(self->map == MAP_FAILED)
+	{
+		LOGE("mmap %s failed", fname);
+		goto fail_map;
+	}
+	self->map_size = size;
+
+	// validate the header
+	const unsigned char* map = (const unsigned char*) self->map;
+	const flt_tileI16_t* hdr = (const flt_tileI16_t*) map;
+	size_t hsize = ((size_t) hdr->nrows)*hdr->ncols*
+	               sizeof(short);
+	if((strncmp(hdr->magic, FLT_TILE_I16_MAGIC, 8) != 0) ||
+	   (hdr->version != FLT_TILE_I16_VERSION) ||
+	   (hdr->type    != self->type)           ||
+	   (hdr->lat     != self->lat)            ||
+	   (hdr->lon     != self->lon)            ||
+	   (hdr->nrows   <= 0)                    ||
+	   (hdr->ncols   <= 0))
+	{
+		LOGE("invalid %s", fname);
+		goto fail_header;
+	}
 
-	if(strcmp(name, "NorthBoundingCoordinate") == 0)
+	if(hdr->codec == FLT_TILE_I16_RAW)
 	{
-		if(content == NULL)
+		if(size < FLT_TILE_I16_HEADER + hsize)
 		{
-			goto fail_content;
+			LOGE("invalid %s", fname);
+			goto fail_header;
 		}
-		self->latT = strtod(content, NULL);
 	}
-	else if(strcmp(name, "WestBoundingCoordinate") == 0)
+	else if(hdr->codec == FLT_TILE_I16_ZLIB)
 	{
-		if(content == NULL)
+		// bands must match the lazy band size
+		int chunks = (hdr->nrows + FLT_TILE_BAND - 1)/
+		             FLT_TILE_BAND;
+		size_t tsize = (chunks + 1)*sizeof(uint64_t);
+		if((hdr->band   != FLT_TILE_BAND) ||
+		   (hdr->chunks != chunks)        ||
+		   (size < FLT_TILE_I16_HEADER + tsize))
+		{
+			LOGE("invalid %s", fname);
+			goto fail_header;
+		}
+
+		const uint64_t* offset;
+		offset = (const uint64_t*) &map[FLT_TILE_I16_HEADER];
+		if(offset[0] < FLT_TILE_I16_HEADER + tsize)
+		{
+			LOGE("invalid %s", fname);
+			goto fail_header;
+		}
+
+		int i;
+		for(i = 0; i < chunks; ++i)
 		{
-			goto fail_content;
+			if((offset[i + 1] < offset[i]) ||
+			   (offset[i + 1] > size))
+			{
+				LOGE("invalid %s", fname);
+				goto fail_header;
+			}
 		}
-		self->lonL = strtod(content, NULL);
 	}
-	else if(strcmp(name, "SouthBoundingCoordinate") == 0)
+	else
+	{
+		LOGE("invalid %s: codec=%i", fname, hdr->codec);
+		goto fail_header;
+	}
+
+	self->lonL   = hdr->lonL;
+	self->latB   = hdr->latB;
+	self->lonR   = hdr->lonR;
+	self->latT   = hdr->latT;
+	self->nodata = hdr->nodata;
+	self->nrows  = hdr->nrows;
+	self->ncols  = hdr->ncols;
+	self->codec  = hdr->codec;
+
+	if(self->codec == FLT_TILE_I16_RAW)
+	{
+		// reference the heights in place
+		self->height = (short*) &map[FLT_TILE_I16_HEADER];
+	}
+	else if(lazy)
 	{
-		if(content == NULL)
+		if(flt_tile_initLazy(self) == 0)
 		{
-			goto fail_content;
+			goto fail_header;
 		}
-		self->latB = strtod(content, NULL);
 	}
-	else if(strcmp(name, "EastBoundingCoordinate") == 0)
+	else
 	{
-		if(content == NULL)
+		self->height = (short*) MALLOC(hsize);
+		if(self->height == NULL)
 		{
-			goto fail_content;
+			LOGE("MALLOC failed");
+			goto fail_header;
+		}
+
+		int row0;
+		int band = 0;
+		for(row0 = 0; row0 < self->nrows;
+		    row0 += FLT_TILE_BAND)
+		{
+			int row1 = row0 + FLT_TILE_BAND;
+			if(row1 > self->nrows)
+			{
+				row1 = self->nrows;
+			}
+			flt_tile_inflateBand(self, band, row0, row1);
+			++band;
 		}
-		self->lonR = strtod(content, NULL);
+
+		// the compressed data is no longer required
+		munmap(self->map, self->map_size);
+		self->map      = NULL;
+		self->map_size = 0;
 	}
 
+	close(fd);
+
 	// success
 	return 1;
 
 	// failure
-	fail_content:
-		LOGE("%i/%i: content is NULL",
-		     self->lat, self->lon);
+	fail_header:
+		self->codec = FLT_TILE_I16_NONE;
+		munmap(self->map, self->map_size);
+		self->map_size = 0;
+	fail_map:
+		self->map = NULL;
+	fail_stat:
+		close(fd);
 	return 0;
 }
 
-/***********************************************************
-* public                                                   *
-***********************************************************/
-
-flt_tile_t*
-flt_tile_import(int type, int lat, int lon)
+static int
+flt_tile_writeAll(FILE* f, const void* data, size_t size)
 {
-	char flt_fbase[256];
-	char flt_fname[256];
-	char hdr_fname[256];
-	char prj_fname[256];
-	char tif_fname[256];
-	char xml_fname[256];
-
-	// USGS is top-left origin
-	// ASTERv3 is bottom-left origin
-	int ulat = lat + 1;
-	snprintf(flt_fbase, 256, "%s%i%s%03i",
-	         (ulat >= 0) ? "n" : "s", abs(ulat),
-	         (lon >= 0) ? "e" : "w", abs(lon));
-	snprintf(flt_fname, 256, "usgs-ned/data/%s/float%s_13",
-	         flt_fbase, flt_fbase);
-	snprintf(hdr_fname, 256, "%s.hdr", flt_fname);
-	snprintf(prj_fname, 256, "%s.prj", flt_fname);
-	snprintf(tif_fname, 256,
-	         "ASTERv3/data/ASTGTMV003_%s%02i%s%03i_dem.tif",
-	         (lat >= 0) ? "N" : "S", abs(lat),
-	         (lon >= 0) ? "E" : "W", abs(lon));
-	snprintf(xml_fname, 256,
-	         "ASTERv3/zip/ASTGTMV003_%s%02i%s%03i.zip.xml",
-	         (lat >= 0) ? "N" : "S", abs(lat),
-	         (lon >= 0) ? "E" : "W", abs(lon));
+	ASSERT(f);
+	ASSERT(data);
 
-	flt_tile_t* self;
-	self = (flt_tile_t*) MALLOC(sizeof(flt_tile_t));
-	if(self == NULL)
+	if(fwrite(data, size, 1, f) != 1)
 	{
-		LOGE("MALLOC failed");
+		LOGE("fwrite failed");
 		return 0;
 	}
 
-	// init defaults
-	self->type      = type;
-	self->lat       = lat;
-	self->lon       = lon;
-	self->lonL      = (double) lon;
-	self->latB      = (double) lat;
-	self->lonR      = (double) lon + 1.0;
-	self->latT      = (double) lat + 1.0;
-	self->nodata    = 0.0;
-	self->byteorder = FLT_LSBFIRST;
-	self->nrows     = 0;
-	self->ncols     = 0;
-	self->height    = NULL;
+	return 1;
+}
 
-	if(type == FLT_TILE_TYPE_USGS)
+static int
+flt_tile_writeI16(flt_tile_t* self, FILE* f, int codec)
+{
+	ASSERT(self);
+	ASSERT(f);
+
+	unsigned char* header;
+	header = (unsigned char*)
+	         CALLOC(1, FLT_TILE_I16_HEADER);
+	if(header == NULL)
 	{
-		// import flt/tif files but prefer flt files since
-		// they are higher resolution
-		if(flt_tile_importhdr(self, hdr_fname) == 0)
-		{
-			// silently fail
-			goto fail_import;
-		}
+		LOGE("CALLOC failed");
+		return 0;
 	}
-	else
+
+	int chunks = (self->nrows + FLT_TILE_BAND - 1)/
+	             FLT_TILE_BAND;
+
+	flt_tileI16_t* hdr = (flt_tileI16_t*) header;
+	strncpy(hdr->magic, FLT_TILE_I16_MAGIC, 8);
+	hdr->version = FLT_TILE_I16_VERSION;
+	hdr->type    = self->type;
+	hdr->lat     = self->lat;
+	hdr->lon     = self->lon;
+	hdr->nrows   = self->nrows;
+	hdr->ncols   = self->ncols;
+	hdr->codec   = codec;
+	hdr->band    = FLT_TILE_BAND;
+	hdr->chunks  = (codec == FLT_TILE_I16_ZLIB) ? chunks : 0;
+	hdr->nodata  = self->nodata;
+	hdr->lonL    = self->lonL;
+	hdr->latB    = self->latB;
+	hdr->lonR    = self->lonR;
+	hdr->latT    = self->latT;
+
+	if(flt_tile_writeAll(f, header, FLT_TILE_I16_HEADER) == 0)
+	{
+		goto fail_header;
+	}
+
+	size_t rsize = self->ncols*sizeof(short);
+	if(codec == FLT_TILE_I16_RAW)
 	{
-		if(flt_tile_importtif(self, tif_fname))
+		int row;
+		for(row = 0; row < self->nrows; ++row)
 		{
-			// parse extent
-			if(xml_istream_parse((void*) self,
-			                     flt_tile_xmlStart,
-			                     flt_tile_xmlEnd,
-			                     xml_fname) == 0)
+			if(flt_tile_writeAll(f, flt_tile_row(self, row),
+			                     rsize) == 0)
 			{
-				LOGE("invalid %s", xml_fname);
-				goto fail_import;
+				goto fail_header;
 			}
-
-			// success
-			return self;
 		}
 
-		// silently fail
-		goto fail_import;
+		FREE(header);
+
+		// success
+		return 1;
 	}
 
-	// if hdr exists then prj and flt
-	// must also exist
-	if(flt_tile_importprj(self, prj_fname) == 0)
+	size_t    tsize  = (chunks + 1)*sizeof(uint64_t);
+	uint64_t* offset = (uint64_t*) CALLOC(1, tsize);
+	if(offset == NULL)
 	{
-		LOGE("flt_tile_importprj %s failed", prj_fname);
-		goto fail_prj;
+		LOGE("CALLOC failed");
+		goto fail_offset;
 	}
 
-	if(flt_tile_importflt(self, flt_fname) == 0)
+	uLong bsize = compressBound(FLT_TILE_BAND*rsize);
+	Bytef* buf  = (Bytef*) MALLOC(bsize);
+	if(buf == NULL)
 	{
-		// filenames in source files are inconsistent
-		snprintf(flt_fname, 256,
-		         "usgs-ned/data/%s/float%s_13.flt",
-		         flt_fbase, flt_fbase);
-		if(flt_tile_importflt(self, flt_fname) == 0)
+		LOGE("MALLOC failed");
+		goto fail_buf;
+	}
+
+	// reserve the chunk table
+	if(flt_tile_writeAll(f, offset, tsize) == 0)
+	{
+		goto fail_write;
+	}
+
+	int band;
+	offset[0] = FLT_TILE_I16_HEADER + tsize;
+	for(band = 0; band < chunks; ++band)
+	{
+		int row0 = band*FLT_TILE_BAND;
+		int row1 = row0 + FLT_TILE_BAND;
+		if(row1 > self->nrows)
 		{
-			LOGE("flt_tile_importflt %s failed", flt_fname);
-			goto fail_flt;
+			row1 = self->nrows;
+		}
+
+		// flt_tile_row converts the band of lazy tiles
+		const short* src = flt_tile_row(self, row0);
+
+		uLongf csize = bsize;
+		if(compress2(buf, &csize, (const Bytef*) src,
+		             (uLong) (row1 - row0)*rsize,
+		             Z_DEFAULT_COMPRESSION) != Z_OK)
+		{
+			LOGE("compress2 failed");
+			goto fail_write;
+		}
+
+		if(flt_tile_writeAll(f, buf, csize) == 0)
+		{
+			goto fail_write;
 		}
+		offset[band + 1] = offset[band] + csize;
+	}
+
+	// update the chunk table
+	if((fseek(f, FLT_TILE_I16_HEADER, SEEK_SET) != 0) ||
+	   (flt_tile_writeAll(f, offset, tsize) == 0))
+	{
+		LOGE("invalid chunk table");
+		goto fail_write;
 	}
 
+	FREE(buf);
+	FREE(offset);
+	FREE(header);
+
 	// success
-	return self;
+	return 1;
 
 	// failure
-	fail_flt:
-	fail_prj:
-	fail_import:
-		FREE(self);
-	return NULL;
+	fail_write:
+		FREE(buf);
+	fail_buf:
+		FREE(offset);
+	fail_offset:
+	fail_header:
+		FREE(header);
+	return 0;
 }
 
-void flt_tile_delete(flt_tile_t** _self)
+// in-memory TIFF for archive entries
+// the data is shared by the decoder threads and is only
+// freed by the owner
+typedef struct
 {
-	ASSERT(_self);
+	int            owner;
+	unsigned char* data;
+	toff_t         size;
+	toff_t         pos;
+} flt_tileMem_t;
+
+// TIFF decoder thread state for flt_tile_importtif
+// each decoder opens its own TIFF handle (unless tiff is
+// set) and decodes the TIFF tile rows in [i0, i1)
+typedef struct
+{
+	flt_tile_t*    self;
+	const char*    fname;
+	unsigned char* data;
+	toff_t         size;
+	TIFF*          tiff;
+	uint32_t       w;
+	uint32_t       h;
+	uint32_t       tw;
+	uint32_t       th;
+	uint32_t       i0;
+	uint32_t       i1;
+	int            ret;
+} flt_tileDecoder_t;
+
+// number of TIFF decoder threads
+static int flt_tile_decoders = 1;
+
+static tmsize_t
+flt_tile_memRead(thandle_t h, void* buf, tmsize_t size)
+{
+	ASSERT(h);
+	ASSERT(buf);
 
-	flt_tile_t* self = *_self;
-	if(self)
+	flt_tileMem_t* mem = (flt_tileMem_t*) h;
+	if(mem->pos >= mem->size)
 	{
-		FREE(self->height);
-		FREE(self);
-		*_self = NULL;
+		return 0;
 	}
-}
+
+	if(size > (tmsize_t) (mem->size - mem->pos))
+	{
+		size = (tmsize_t) (mem->size - mem->pos);
+	}
+	memcpy(buf, &mem->data[mem->pos], size);
+	mem->pos += size;
+	return size;
+}
+
+static tmsize_t
+flt_tile_memWrite(thandle_t h, void* buf, tmsize_t size)
+{
+	// read-only
+	return 0;
+}
+
+static toff_t
+flt_tile_memSeek(thandle_t h, toff_t off, int whence)
+{
+	ASSERT(h);
+
+	flt_tileMem_t* mem = (flt_tileMem_t*) h;
+	if(whence == SEEK_SET)
+	{
+		mem->pos = off;
+	}
+	else if(whence == SEEK_CUR)
+	{
+		mem->pos += off;
+	}
+	else if(whence == SEEK_END)
+	{
+		mem->pos = mem->size + off;
+	}
+	return mem->pos;
+}
+
+static int flt_tile_memClose(thandle_t h)
+{
+	ASSERT(h);
+
+	// TIFFClose releases the archive entry
+	flt_tileMem_t* mem = (flt_tileMem_t*) h;
+	if(mem->owner)
+	{
+		FREE(mem->data);
+	}
+	FREE(mem);
+	return 0;
+}
+
+static toff_t flt_tile_memSize(thandle_t h)
+{
+	ASSERT(h);
+
+	flt_tileMem_t* mem = (flt_tileMem_t*) h;
+	return mem->size;
+}
+
+static int
+flt_tile_memMap(thandle_t h, void** base, toff_t* size)
+{
+	ASSERT(h);
+	ASSERT(base);
+	ASSERT(size);
+
+	flt_tileMem_t* mem = (flt_tileMem_t*) h;
+	*base = (void*) mem->data;
+	*size = mem->size;
+	return 1;
+}
+
+static void
+flt_tile_memUnmap(thandle_t h, void* base, toff_t size)
+{
+	// ignore
+}
+
+static TIFF*
+flt_tile_memOpen(const char* fname, unsigned char* data,
+                 toff_t size, int owner)
+{
+	ASSERT(fname);
+	ASSERT(data);
+
+	flt_tileMem_t* mem;
+	mem = (flt_tileMem_t*) CALLOC(1, sizeof(flt_tileMem_t));
+	if(mem == NULL)
+	{
+		LOGE("CALLOC failed");
+		goto fail_mem;
+	}
+	mem->owner = owner;
+	mem->data  = data;
+	mem->size  = size;
+
+	TIFF* tiff = TIFFClientOpen(fname, "r", (thandle_t) mem,
+	                            flt_tile_memRead,
+	                            flt_tile_memWrite,
+	                            flt_tile_memSeek,
+	                            flt_tile_memClose,
+	                            flt_tile_memSize,
+	                            flt_tile_memMap,
+	                            flt_tile_memUnmap);
+	if(tiff == NULL)
+	{
+		LOGE("TIFFClientOpen failed");
+		goto fail_tiff;
+	}
+
+	// success
+	return tiff;
+
+	// failure
+	fail_tiff:
+		FREE(mem);
+	fail_mem:
+	{
+		if(owner)
+		{
+			FREE(data);
+		}
+	}
+	return NULL;
+}
+
+static TIFF*
+flt_tile_openziptif(const char* zname, const char* fname,
+                    unsigned char** _data, toff_t* _size)
+{
+	ASSERT(zname);
+	ASSERT(fname);
+
+	size_t size = 0;
+	unsigned char* data;
+	data = (unsigned char*) flt_zip_load(zname, fname, &size);
+	if(data == NULL)
+	{
+		// skip silently
+		return NULL;
+	}
+
+	LOGI("fname=%s:%s", zname, fname);
+
+	TIFF* tiff = flt_tile_memOpen(fname, data, (toff_t) size, 1);
+	if(tiff == NULL)
+	{
+		return NULL;
+	}
+
+	if(_data)
+	{
+		*_data = data;
+		*_size = (toff_t) size;
+	}
+
+	return tiff;
+}
+
+static TIFF*
+flt_tile_opentif(const char* zname, const char* fname,
+                 unsigned char** _data, toff_t* _size,
+                 uint32_t* w, uint32_t* h,
+                 uint32_t* tw, uint32_t* th)
+{
+	ASSERT(fname);
+	ASSERT(w);
+	ASSERT(h);
+	ASSERT(tw);
+	ASSERT(th);
+
+	// ASTER v3
+	// https://lpdaac.usgs.gov/products/astgtmv003/
+
+	TIFF* tiff;
+	if(zname)
+	{
+		tiff = flt_tile_openziptif(zname, fname, _data, _size);
+		if(tiff == NULL)
+		{
+			return NULL;
+		}
+	}
+	else
+	{
+		// ignore if file does not exist
+		if(access(fname, F_OK) != 0)
+		{
+			return NULL;
+		}
+
+		LOGI("fname=%s", fname);
+
+		tiff = TIFFOpen(fname, "r");
+	}
+
+	if(tiff == NULL)
+	{
+		LOGE("TIFFOpen failed");
+		return NULL;
+	}
+
+	uint16_t samples;
+	uint16_t bits;
+	uint16_t format;
+	TIFFGetField(tiff, TIFFTAG_IMAGEWIDTH, w);
+	TIFFGetField(tiff, TIFFTAG_IMAGELENGTH, h);
+	TIFFGetField(tiff, TIFFTAG_SAMPLESPERPIXEL, &samples);
+	TIFFGetField(tiff, TIFFTAG_BITSPERSAMPLE, &bits);
+	TIFFGetField(tiff, TIFFTAG_SAMPLEFORMAT, &format);
+	TIFFGetField(tiff, TIFFTAG_TILEWIDTH, tw);
+	TIFFGetField(tiff, TIFFTAG_TILELENGTH, th);
+
+	if((samples != 1) || (bits != 16) ||
+	   (format != SAMPLEFORMAT_INT))
+	{
+		LOGE("invalid params");
+		TIFFClose(tiff);
+		return NULL;
+	}
+
+	return tiff;
+}
+
+static void* flt_tile_decodeThread(void* arg)
+{
+	ASSERT(arg);
+
+	flt_tileDecoder_t* dec  = (flt_tileDecoder_t*) arg;
+	flt_tile_t*        self = dec->self;
+
+	TIFF* tiff = dec->tiff;
+	if(tiff == NULL)
+	{
+		if(dec->data)
+		{
+			tiff = flt_tile_memOpen(dec->fname, dec->data,
+			                        dec->size, 0);
+		}
+		else
+		{
+			tiff = TIFFOpen(dec->fname, "r");
+		}
+
+		if(tiff == NULL)
+		{
+			LOGE("TIFFOpen %s failed", dec->fname);
+			return NULL;
+		}
+	}
+
+	uint32_t w  = dec->w;
+	uint32_t h  = dec->h;
+	uint32_t tw = dec->tw;
+	uint32_t th = dec->th;
+
+	short* tile = (short*) MALLOC(tw*th*sizeof(short));
+	if(tile == NULL)
+	{
+		LOGE("MALLOC failed");
+		goto fail_tile;
+	}
+
+	// read tiles
+	int i;
+	int j;
+	int m;
+	for(i = dec->i0; i < dec->i1; i += th)
+	{
+		for(j = 0; j < w; j += tw)
+		{
+			TIFFReadTile(tiff, tile, j, i, 0, 0);
+
+			// untile data and convert to feet
+			for(m = 0; (m < th) && (i + m < h); ++m)
+			{
+				int count = tw;
+				if(j + count > w)
+				{
+					count = w - j;
+				}
+
+				flt_convert_i16(&self->height[(i + m)*w + j],
+				                &tile[m*tw], count);
+			}
+		}
+	}
+
+	FREE(tile);
+	if(dec->tiff == NULL)
+	{
+		TIFFClose(tiff);
+	}
+	dec->ret = 1;
+
+	// success
+	return NULL;
+
+	// failure
+	fail_tile:
+	{
+		if(dec->tiff == NULL)
+		{
+			TIFFClose(tiff);
+		}
+	}
+	return NULL;
+}
+
+static int
+flt_tile_importtif(flt_tile_t* self, const char* zname,
+                   const char* fname)
+{
+	ASSERT(self);
+	ASSERT(fname);
+
+	uint32_t       w;
+	uint32_t       h;
+	uint32_t       tw;
+	uint32_t       th;
+	unsigned char* data = NULL;
+	toff_t         size = 0;
+	TIFF* tiff = flt_tile_opentif(zname, fname, &data, &size,
+	                              &w, &h, &tw, &th);
+	if(tiff == NULL)
+	{
+		return 0;
+	}
+
+	self->height = (short*) MALLOC(w*h*sizeof(short));
+	if(self->height == NULL)
+	{
+		LOGE("MALLOC failed");
+		goto fail_height;
+	}
+
+	// partition the TIFF tile rows between the decoders
+	int rows = (h + th - 1)/th;
+	int nth  = __atomic_load_n(&flt_tile_decoders,
+	                           __ATOMIC_RELAXED);
+	if(nth > rows)
+	{
+		nth = rows;
+	}
+	if(nth < 1)
+	{
+		nth = 1;
+	}
+
+	flt_tileDecoder_t* decs;
+	decs = (flt_tileDecoder_t*)
+	       CALLOC(nth, sizeof(flt_tileDecoder_t));
+	if(decs == NULL)
+	{
+		LOGE("CALLOC failed");
+		goto fail_decs;
+	}
+
+	pthread_t* threads;
+	threads = (pthread_t*) CALLOC(nth, sizeof(pthread_t));
+	if(threads == NULL)
+	{
+		LOGE("CALLOC failed");
+		goto fail_threads;
+	}
+
+	int k;
+	for(k = 0; k < nth; ++k)
+	{
+		flt_tileDecoder_t* dec = &decs[k];
+		dec->self  = self;
+		dec->fname = fname;
+		dec->data  = data;
+		dec->size  = size;
+		dec->tiff  = (k == 0) ? tiff : NULL;
+		dec->w     = w;
+		dec->h     = h;
+		dec->tw    = tw;
+		dec->th    = th;
+		dec->i0    = (uint32_t) (rows*k/nth)*th;
+		dec->i1    = (uint32_t) (rows*(k + 1)/nth)*th;
+	}
+
+	// the calling thread decodes the first range
+	int started = 1;
+	for(k = 1; k < nth; ++k)
+	{
+		if(pthread_create(&threads[k], NULL,
+		                  flt_tile_decodeThread,
+		                  (void*) &decs[k]) != 0)
+		{
+			LOGW("pthread_create failed");
+			break;
+		}
+		++started;
+	}
+	flt_tile_decodeThread((void*) &decs[0]);
+
+	// the calling thread also decodes the ranges of the
+	// threads which failed to start with its TIFF handle
+	for(k = started; k < nth; ++k)
+	{
+		decs[k].tiff = tiff;
+		flt_tile_decodeThread((void*) &decs[k]);
+	}
+
+	int ret = 1;
+	for(k = 0; k < nth; ++k)
+	{
+		if((k > 0) && (k < started))
+		{
+			pthread_join(threads[k], NULL);
+		}
+		ret = ret && decs[k].ret;
+	}
+
+	if(ret == 0)
+	{
+		goto fail_decode;
+	}
+
+	self->nrows = h;
+	self->ncols = w;
+
+	FREE(threads);
+	FREE(decs);
+	TIFFClose(tiff);
+
+	// success
+	return 1;
+
+	// failure
+	fail_decode:
+		FREE(threads);
+	fail_threads:
+		FREE(decs);
+	fail_decs:
+		FREE(self->height);
+		self->height = NULL;
+	fail_height:
+		TIFFClose(tiff);
+	return 0;
+}
+
+static int
+flt_tile_maptif(flt_tile_t* self, const char* zname,
+                const char* fname)
+{
+	ASSERT(self);
+	ASSERT(fname);
+
+	uint32_t w;
+	uint32_t h;
+	uint32_t tw;
+	uint32_t th;
+	TIFF* tiff = flt_tile_opentif(zname, fname, NULL, NULL,
+	                              &w, &h, &tw, &th);
+	if(tiff == NULL)
+	{
+		return 0;
+	}
+
+	// the LRU holds two rows of TIFF tiles which covers
+	// any band that straddles a TIFF tile row
+	int count = 2*((w + tw - 1)/tw);
+
+	self->tif_key = (int*) CALLOC(count, sizeof(int));
+	if(self->tif_key == NULL)
+	{
+		LOGE("CALLOC failed");
+		goto fail_key;
+	}
+
+	self->tif_stamp = (unsigned int*)
+	                  CALLOC(count, sizeof(unsigned int));
+	if(self->tif_stamp == NULL)
+	{
+		LOGE("CALLOC failed");
+		goto fail_stamp;
+	}
+
+	self->tif_data = (short*)
+	                 MALLOC(count*tw*th*sizeof(short));
+	if(self->tif_data == NULL)
+	{
+		LOGE("MALLOC failed");
+		goto fail_data;
+	}
+
+	int i;
+	for(i = 0; i < count; ++i)
+	{
+		self->tif_key[i] = -1;
+	}
+
+	self->nrows = h;
+	self->ncols = w;
+	if(flt_tile_initLazy(self) == 0)
+	{
+		goto fail_lazy;
+	}
+
+	self->tif       = (void*) tiff;
+	self->tif_tw    = tw;
+	self->tif_th    = th;
+	self->tif_count = count;
+	self->tif_clock = 0;
+
+	// success
+	return 1;
+
+	// failure
+	fail_lazy:
+		FREE(self->tif_data);
+	fail_data:
+		FREE(self->tif_stamp);
+	fail_stamp:
+		FREE(self->tif_key);
+	fail_key:
+		self->tif_key   = NULL;
+		self->tif_stamp = NULL;
+		self->tif_data  = NULL;
+		TIFFClose(tiff);
+	return 0;
+}
+
+static const short*
+flt_tile_getTif(flt_tile_t* self, int x, int y)
+{
+	ASSERT(self);
+	ASSERT(self->tif);
+
+	int tw   = self->tif_tw;
+	int th   = self->tif_th;
+	int key  = (y/th)*((self->ncols + tw - 1)/tw) + x/tw;
+	int lru  = 0;
+	int i;
+	++self->tif_clock;
+	for(i = 0; i < self->tif_count; ++i)
+	{
+		if(self->tif_key[i] == key)
+		{
+			self->tif_stamp[i] = self->tif_clock;
+			return &self->tif_data[i*tw*th];
+		}
+
+		if(self->tif_stamp[i] < self->tif_stamp[lru])
+		{
+			lru = i;
+		}
+	}
+
+	// decode the TIFF tile into the least recently used slot
+	short* data = &self->tif_data[lru*tw*th];
+	if(TIFFReadTile((TIFF*) self->tif, data, x, y, 0, 0) < 0)
+	{
+		LOGE("invalid %i/%i: x=%i, y=%i",
+		     self->lat, self->lon, x, y);
+		memset(data, 0, tw*th*sizeof(short));
+	}
+	self->tif_key[lru]   = key;
+	self->tif_stamp[lru] = self->tif_clock;
+
+	return data;
+}
+
+static void flt_tile_decodeBand(flt_tile_t* self,
+                                int row0, int row1)
+{
+	ASSERT(self);
+	ASSERT(self->tif);
+
+	int tw = self->tif_tw;
+	int th = self->tif_th;
+	int w  = self->ncols;
+
+	// untile data and convert to feet
+	int i;
+	int j;
+	int row;
+	for(i = (row0/th)*th; i < row1; i += th)
+	{
+		for(j = 0; j < w; j += tw)
+		{
+			const short* tile = flt_tile_getTif(self, j, i);
+
+			int count = tw;
+			if(j + count > w)
+			{
+				count = w - j;
+			}
+
+			for(row = i; (row < i + th) && (row < row1); ++row)
+			{
+				if(row < row0)
+				{
+					continue;
+				}
+
+				flt_convert_i16(&self->height[row*w + j],
+				                &tile[(row - i)*tw], count);
+			}
+		}
+	}
+}
+
+static void flt_tile_convertBand(flt_tile_t* self, int band)
+{
+	ASSERT(self);
+
+	int row0 = band*FLT_TILE_BAND;
+	int row1 = row0 + FLT_TILE_BAND;
+	if(row1 > self->nrows)
+	{
+		row1 = self->nrows;
+	}
+
+	if(self->codec == FLT_TILE_I16_ZLIB)
+	{
+		flt_tile_inflateBand(self, band, row0, row1);
+		return;
+	}
+	else if(self->tif)
+	{
+		flt_tile_decodeBand(self, row0, row1);
+		return;
+	}
+
+	size_t rsize = self->ncols*sizeof(float);
+	const unsigned char* map = (const unsigned char*) self->map;
+
+	int row;
+	for(row = row0; row < row1; ++row)
+	{
+		// swap byte order and convert data to feet
+		flt_convert_f32(&self->height[row*self->ncols],
+		                &map[row*rsize], self->ncols,
+		                self->byteorder);
+	}
+
+	// release the page cache for the converted rows
+	size_t page  = (size_t) sysconf(_SC_PAGESIZE);
+	size_t begin = (row0*rsize + page - 1)/page*page;
+	size_t end   = (row1*rsize)/page*page;
+	if(end > begin)
+	{
+		madvise((void*) &map[begin], end - begin,
+		        MADV_DONTNEED);
+	}
+}
+
+static int
+flt_tile_loadflt(flt_tile_t* self, const char* zname,
+                 const char* fname, int lazy)
+{
+	ASSERT(self);
+	ASSERT(fname);
+
+	// archive entries are streamed since they cannot
+	// be mapped
+	if(lazy && (zname == NULL))
+	{
+		return flt_tile_mapflt(self, fname);
+	}
+
+	return flt_tile_importflt(self, zname, fname);
+}
+
+static void
+flt_tile_i16Name(int type, int lat, int lon,
+                 char* dname, char* fname)
+{
+	ASSERT(dname);
+	ASSERT(fname);
+
+	// sidecars are named after the source tiles
+	if(type == FLT_TILE_TYPE_USGS)
+	{
+		int ulat = lat + 1;
+		snprintf(dname, 256, "usgs-ned/i16");
+		snprintf(fname, 256, "%s/%s%i%s%03i.i16", dname,
+		         (ulat >= 0) ? "n" : "s", abs(ulat),
+		         (lon >= 0) ? "e" : "w", abs(lon));
+	}
+	else
+	{
+		snprintf(dname, 256, "ASTERv3/i16");
+		snprintf(fname, 256,
+		         "%s/ASTGTMV003_%s%02i%s%03i.i16", dname,
+		         (lat >= 0) ? "N" : "S", abs(lat),
+		         (lon >= 0) ? "E" : "W", abs(lon));
+	}
+}
+
+static int
+flt_tile_i16Stale(const char* fname, int count,
+                  const char** src)
+{
+	ASSERT(fname);
+	ASSERT(src);
+
+	// missing sidecars are handled by flt_tile_importi16
+	struct stat st;
+	if(stat(fname, &st) != 0)
+	{
+		return 0;
+	}
+
+	// a sidecar is stale when any of its source files is
+	// newer (e.g. a re-downloaded or corrected source)
+	int i;
+	struct stat sst;
+	for(i = 0; i < count; ++i)
+	{
+		if((stat(src[i], &sst) == 0) &&
+		   (sst.st_mtime > st.st_mtime))
+		{
+			LOGW("stale %s", fname);
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+static int
+flt_tile_loadtif(flt_tile_t* self, const char* zname,
+                 const char* fname, int lazy)
+{
+	ASSERT(self);
+	ASSERT(fname);
+
+	if(lazy)
+	{
+		return flt_tile_maptif(self, zname, fname);
+	}
+
+	return flt_tile_importtif(self, zname, fname);
+}
+
+static flt_tile_t*
+flt_tile_importType(int type, int lat, int lon, int lazy)
+{
+	char i16_dname[256];
+	char i16_fname[256];
+	char flt_fbase[256];
+	char flt_fname[256];
+	char hdr_fname[256];
+	char prj_fname[256];
+	char tif_fname[256];
+	char zip_fname[256];
+
+	// USGS is top-left origin
+	// ASTERv3 is bottom-left origin
+	int ulat = lat + 1;
+	snprintf(flt_fbase, 256, "%s%i%s%03i",
+	         (ulat >= 0) ? "n" : "s", abs(ulat),
+	         (lon >= 0) ? "e" : "w", abs(lon));
+	snprintf(flt_fname, 256, "usgs-ned/data/%s/float%s_13",
+	         flt_fbase, flt_fbase);
+	snprintf(hdr_fname, 256, "%s.hdr", flt_fname);
+	snprintf(prj_fname, 256, "%s.prj", flt_fname);
+	snprintf(tif_fname, 256,
+	         "ASTERv3/data/ASTGTMV003_%s%02i%s%03i_dem.tif",
+	         (lat >= 0) ? "N" : "S", abs(lat),
+	         (lon >= 0) ? "E" : "W", abs(lon));
+	flt_tile_i16Name(type, lat, lon, i16_dname, i16_fname);
+	if(type == FLT_TILE_TYPE_USGS)
+	{
+		snprintf(zip_fname, 256, "usgs-ned/zip/%s.zip",
+		         flt_fbase);
+	}
+	else
+	{
+		snprintf(zip_fname, 256,
+		         "ASTERv3/zip/ASTGTMV003_%s%02i%s%03i.zip",
+		         (lat >= 0) ? "N" : "S", abs(lat),
+		         (lon >= 0) ? "E" : "W", abs(lon));
+	}
+
+	flt_tile_t* self;
+	self = (flt_tile_t*) MALLOC(sizeof(flt_tile_t));
+	if(self == NULL)
+	{
+		LOGE("MALLOC failed");
+		return 0;
+	}
+
+	// init defaults
+	self->type      = type;
+	self->lat       = lat;
+	self->lon       = lon;
+	self->lonL      = (double) lon;
+	self->latB      = (double) lat;
+	self->lonR      = (double) lon + 1.0;
+	self->latT      = (double) lat + 1.0;
+	self->nodata    = 0.0;
+	self->byteorder = FLT_LSBFIRST;
+	self->nrows     = 0;
+	self->ncols     = 0;
+	self->height    = NULL;
+	self->lazy      = 0;
+	self->map       = NULL;
+	self->map_size  = 0;
+	self->bands     = NULL;
+	self->codec     = FLT_TILE_I16_NONE;
+	self->tif       = NULL;
+	self->tif_tw    = 0;
+	self->tif_th    = 0;
+	self->tif_count = 0;
+	self->tif_clock = 0;
+	self->tif_key   = NULL;
+	self->tif_stamp = NULL;
+	self->tif_data  = NULL;
+
+	self->height_size = 0;
+
+	// prefer the int16 sidecar which skips parsing and
+	// conversion of the source files unless it is stale
+	char flt_fext[256];
+	snprintf(flt_fext, 256, "%s.flt", flt_fname);
+	const char* usgs_src[] =
+	{
+		hdr_fname,
+		flt_fname,
+		flt_fext,
+		zip_fname,
+	};
+	const char* aster_src[] =
+	{
+		tif_fname,
+		zip_fname,
+	};
+	int stale;
+	if(type == FLT_TILE_TYPE_USGS)
+	{
+		stale = flt_tile_i16Stale(i16_fname, 4, usgs_src);
+	}
+	else
+	{
+		stale = flt_tile_i16Stale(i16_fname, 2, aster_src);
+	}
+
+	if((stale == 0) &&
+	   flt_tile_importi16(self, i16_fname, lazy))
+	{
+		return self;
+	}
+
+	// archive which replaces the unzipped files
+	const char* zname = NULL;
+
+	if(type == FLT_TILE_TYPE_USGS)
+	{
+		// import flt/tif files but prefer flt files since
+		// they are higher resolution
+		if(flt_tile_importhdr(self, NULL, hdr_fname) == 0)
+		{
+			// read the archive if the files were not
+			// unzipped
+			zname = zip_fname;
+			if(flt_tile_importhdr(self, zname, hdr_fname) == 0)
+			{
+				// silently fail
+				goto fail_import;
+			}
+		}
+	}
+	else
+	{
+		if(flt_tile_loadtif(self, NULL, tif_fname, lazy) ||
+		   flt_tile_loadtif(self, zip_fname, tif_fname, lazy))
+		{
+			// lookup extent
+			if(flt_extent_lookup(lat, lon,
+			                     &self->lonL, &self->latB,
+			                     &self->lonR,
+			                     &self->latT) == 0)
+			{
+				LOGE("invalid extent %i/%i", lat, lon);
+				flt_tile_delete(&self);
+				return NULL;
+			}
+
+			// success
+			return self;
+		}
+
+		// silently fail
+		goto fail_import;
+	}
+
+	// if hdr exists then prj and flt
+	// must also exist
+	if(flt_tile_importprj(self, zname, prj_fname) == 0)
+	{
+		LOGE("flt_tile_importprj %s failed", prj_fname);
+		goto fail_prj;
+	}
+
+	if(flt_tile_loadflt(self, zname, flt_fname, lazy) == 0)
+	{
+		// filenames in source files are inconsistent
+		snprintf(flt_fname, 256,
+		         "usgs-ned/data/%s/float%s_13.flt",
+		         flt_fbase, flt_fbase);
+		if(flt_tile_loadflt(self, zname, flt_fname,
+		                    lazy) == 0)
+		{
+			LOGE("flt_tile_loadflt %s failed", flt_fname);
+			goto fail_flt;
+		}
+	}
+
+	// success
+	return self;
+
+	// failure
+	fail_flt:
+	fail_prj:
+	fail_import:
+		FREE(self);
+	return NULL;
+}
+
+// columns per block of the batched samplers
+#define FLT_TILE_SAMPLE_BLOCK 256
+
+static inline float
+flt_tile_sampleClean(float h, float nodata)
+{
+	// workaround for incorrect source data around coastlines
+	if((h > 32000) || (h == nodata))
+	{
+		return 0.0f;
+	}
+	return h;
+}
+
+static void
+flt_tile_sampleCols(flt_tile_t* self, int n0, int count,
+                    int cols, const double* lon,
+                    double lonL, double lonR,
+                    int* col0, int* col1, float* u,
+                    unsigned char* mask)
+{
+	ASSERT(self);
+	ASSERT(col0);
+	ASSERT(col1);
+	ASSERT(u);
+	ASSERT(mask);
+
+	// longitudes are either listed or spaced regularly
+	// between lonL and lonR
+	int    i;
+	double d = (double) (cols - 1);
+	for(i = 0; i < count; ++i)
+	{
+		int    n = n0 + i;
+		double x;
+		if(lon)
+		{
+			x = lon[n];
+		}
+		else
+		{
+			double t = (cols > 1) ? ((double) n)/d : 0.0;
+			x = lonL + t*(lonR - lonL);
+		}
+
+		double lonu = (x - self->lonL)/
+		              (self->lonR - self->lonL);
+		mask[i] = (unsigned char)
+		          flt_tile_sampleIndex(lonu, self->ncols,
+		                               &col0[i], &col1[i],
+		                               &u[i]);
+	}
+}
+
+static int
+flt_tile_sampleRows(flt_tile_t* self,
+                    int rows, const double* lat,
+                    double latT, double latB,
+                    int cols, const double* lon,
+                    double lonL, double lonR,
+                    short* height, unsigned char* mask)
+{
+	ASSERT(self);
+	ASSERT(rows > 0);
+	ASSERT(cols > 0);
+	ASSERT(height);
+	ASSERT(mask);
+
+	int           col0[FLT_TILE_SAMPLE_BLOCK];
+	int           col1[FLT_TILE_SAMPLE_BLOCK];
+	float         u[FLT_TILE_SAMPLE_BLOCK];
+	unsigned char cmask[FLT_TILE_SAMPLE_BLOCK];
+
+	// the column tables of a block are shared by every row
+	// such that only the row indices are computed per row
+	int    m;
+	int    n;
+	int    i;
+	int    covered = 0;
+	double d       = (double) (rows - 1);
+	for(n = 0; n < cols; n += FLT_TILE_SAMPLE_BLOCK)
+	{
+		int count = cols - n;
+		if(count > FLT_TILE_SAMPLE_BLOCK)
+		{
+			count = FLT_TILE_SAMPLE_BLOCK;
+		}
+
+		flt_tile_sampleCols(self, n, count, cols, lon,
+		                    lonL, lonR, col0, col1, u, cmask);
+
+		int ccovered = 0;
+		for(i = 0; i < count; ++i)
+		{
+			ccovered += cmask[i];
+		}
+
+		for(m = 0; m < rows; ++m)
+		{
+			short*         dst  = &height[m*cols + n];
+			unsigned char* dmsk = &mask[m*cols + n];
+
+			double y;
+			if(lat)
+			{
+				y = lat[m];
+			}
+			else
+			{
+				double t = (rows > 1) ? ((double) m)/d : 0.0;
+				y = latT + t*(latB - latT);
+			}
+
+			int   row0;
+			int   row1;
+			float v;
+			double latv = 1.0 - ((y - self->latB)/
+			                     (self->latT - self->latB));
+			if((ccovered == 0) ||
+			   (flt_tile_sampleIndex(latv, self->nrows,
+			                         &row0, &row1, &v) == 0))
+			{
+				memset(dst, 0, count*sizeof(short));
+				memset(dmsk, 0, count);
+				continue;
+			}
+
+			const short* src0 = flt_tile_row(self, row0);
+			const short* src1 = flt_tile_row(self, row1);
+			flt_tile_sampleBlock(self, src0, src1, v,
+			                     col0, col1, u, count, dst);
+
+			// clear the uncovered samples
+			for(i = 0; i < count; ++i)
+			{
+				dst[i]  = cmask[i] ? dst[i] : 0;
+				dmsk[i] = cmask[i];
+			}
+			covered += ccovered;
+		}
+	}
+
+	return covered;
+}
+
+/***********************************************************
+* public                                                   *
+***********************************************************/
+
+flt_tile_t*
+flt_tile_import(int type, int lat, int lon)
+{
+	return flt_tile_importType(type, lat, lon, 0);
+}
+
+flt_tile_t*
+flt_tile_importLazy(int type, int lat, int lon)
+{
+	// ASTERv3 TIFF tiles are decoded on demand
+	return flt_tile_importType(type, lat, lon, 1);
+}
+
+void flt_tile_delete(flt_tile_t** _self)
+{
+	ASSERT(_self);
+
+	flt_tile_t* self = *_self;
+	if(self)
+	{
+		if(self->lazy)
+		{
+			pthread_mutex_destroy(&self->mutex);
+			FREE(self->bands);
+			munmap(self->height, self->height_size);
+		}
+		else if(self->map == NULL)
+		{
+			FREE(self->height);
+		}
+
+		if(self->map)
+		{
+			munmap(self->map, self->map_size);
+		}
+
+		if(self->tif)
+		{
+			TIFFClose((TIFF*) self->tif);
+			FREE(self->tif_key);
+			FREE(self->tif_stamp);
+			FREE(self->tif_data);
+		}
+		FREE(self);
+		*_self = NULL;
+	}
+}
+
+int flt_tile_exportI16(flt_tile_t* self, int codec)
+{
+	ASSERT(self);
+	ASSERT((codec == FLT_TILE_I16_RAW) ||
+	       (codec == FLT_TILE_I16_ZLIB));
+
+	char dname[256];
+	char fname[256];
+	char tname[256];
+	flt_tile_i16Name(self->type, self->lat, self->lon,
+	                 dname, fname);
+	snprintf(tname, 256, "%s.part", fname);
+
+	if((mkdir(dname, S_IRWXU | S_IRWXG | S_IROTH |
+	          S_IXOTH) != 0) && (errno != EEXIST))
+	{
+		LOGE("mkdir %s failed", dname);
+		return 0;
+	}
+
+	FILE* f = fopen(tname, "w");
+	if(f == NULL)
+	{
+		LOGE("fopen %s failed", tname);
+		return 0;
+	}
+
+	if(flt_tile_writeI16(self, f, codec) == 0)
+	{
+		goto fail_write;
+	}
+
+	if(fclose(f) != 0)
+	{
+		LOGE("fclose %s failed", tname);
+		goto fail_close;
+	}
+
+	// readers never observe a partial sidecar
+	if(rename(tname, fname) != 0)
+	{
+		LOGE("rename %s failed", fname);
+		goto fail_close;
+	}
+
+	// success
+	return 1;
+
+	// failure
+	fail_write:
+		fclose(f);
+	fail_close:
+		unlink(tname);
+	return 0;
+}
+
+void flt_tile_setDecoders(int count)
+{
+	ASSERT(count > 0);
+
+	__atomic_store_n(&flt_tile_decoders, count,
+	                 __ATOMIC_RELAXED);
+}
+
+const short* flt_tile_row(flt_tile_t* self, int row)
+{
+	ASSERT(self);
+	ASSERT((row >= 0) && (row < self->nrows));
+
+	if(self->lazy)
+	{
+		// convert the band on first access
+		int band = row/FLT_TILE_BAND;
+		if(__atomic_load_n(&self->bands[band],
+		                   __ATOMIC_ACQUIRE) == 0)
+		{
+			pthread_mutex_lock(&self->mutex);
+			if(self->bands[band] == 0)
+			{
+				flt_tile_convertBand(self, band);
+				__atomic_store_n(&self->bands[band], 1,
+				                 __ATOMIC_RELEASE);
+			}
+			pthread_mutex_unlock(&self->mutex);
+		}
+	}
+
+	return &self->height[row*self->ncols];
+}
 
 int flt_tile_sample(flt_tile_t* self,
                     double lat, double lon,
@@ -748,10 +2153,12 @@ int flt_tile_sample(flt_tile_t* self,
 		float v     = lat - lat0f;
 
 		// sample interpolation values
-		float h00 = (float) self->height[lat0*self->ncols + lon0];
-		float h01 = (float) self->height[lat0*self->ncols + lon1];
-		float h10 = (float) self->height[lat1*self->ncols + lon0];
-		float h11 = (float) self->height[lat1*self->ncols + lon1];
+		const short* row0 = flt_tile_row(self, lat0);
+		const short* row1 = flt_tile_row(self, lat1);
+		float h00 = (float) row0[lon0];
+		float h01 = (float) row0[lon1];
+		float h10 = (float) row1[lon0];
+		float h11 = (float) row1[lon1];
 
 		// workaround for incorrect source data around coastlines
 		if((h00 > 32000) || (h00 == self->nodata))
@@ -783,3 +2190,159 @@ int flt_tile_sample(flt_tile_t* self,
 
 	return 0;
 }
+
+int flt_tile_sampleIndex(double t, int count,
+                         int* _i0, int* _i1, float* _w)
+{
+	ASSERT(_i0);
+	ASSERT(_i1);
+	ASSERT(_w);
+
+	// uncovered samples read index 0 with weight 0
+	*_i0 = 0;
+	*_i1 = 0;
+	*_w  = 0.0f;
+
+	if((t < 0.0) || (t > 1.0))
+	{
+		return 0;
+	}
+
+	// "float indices"
+	float f  = (float) (t*(count - 1));
+	int   i0 = (int) f;
+	int   i1 = (int) (f + 1.0f);
+
+	// double check the indices
+	if(i0 < 0)
+	{
+		i0 = 0;
+	}
+	if(i1 >= count)
+	{
+		i1 = count - 1;
+	}
+
+	*_i0 = i0;
+	*_i1 = i1;
+	*_w  = f - (float) i0;
+	return 1;
+}
+
+void flt_tile_sampleBlock(flt_tile_t* self,
+                          const short* src0,
+                          const short* src1,
+                          float v,
+                          const int* col0,
+                          const int* col1,
+                          const float* u,
+                          int count, short* dst)
+{
+	ASSERT(self);
+	ASSERT(src0);
+	ASSERT(src1);
+	ASSERT(col0);
+	ASSERT(col1);
+	ASSERT(u);
+	ASSERT(dst);
+
+	float nodata = self->nodata;
+
+	int n = 0;
+
+	#if defined(__SSE2__)
+	__m128 vv    = _mm_set1_ps(v);
+	__m128 half  = _mm_set1_ps(0.5f);
+	__m128 limit = _mm_set1_ps(32000.0f);
+	__m128 nd    = _mm_set1_ps(nodata);
+	for(; n + 4 <= count; n += 4)
+	{
+		__m128 h[4];
+		const short* src[4] = { src0, src0, src1, src1 };
+		const int*   col[4] = { col0, col1, col0, col1 };
+
+		// gather and clean the corner samples
+		int k;
+		for(k = 0; k < 4; ++k)
+		{
+			const short* s = src[k];
+			const int*   c = &col[k][n];
+			__m128i hi = _mm_setr_epi32(s[c[0]], s[c[1]],
+			                            s[c[2]], s[c[3]]);
+			__m128  hf   = _mm_cvtepi32_ps(hi);
+			__m128  mask = _mm_or_ps(_mm_cmpgt_ps(hf, limit),
+			                         _mm_cmpeq_ps(hf, nd));
+			h[k] = _mm_andnot_ps(mask, hf);
+		}
+
+		// interpolate longitude
+		__m128 uu    = _mm_loadu_ps(&u[n]);
+		__m128 h0001 = _mm_add_ps(h[0],
+		                          _mm_mul_ps(uu,
+		                                     _mm_sub_ps(h[1], h[0])));
+		__m128 h1011 = _mm_add_ps(h[2],
+		                          _mm_mul_ps(uu,
+		                                     _mm_sub_ps(h[3], h[2])));
+
+		// interpolate latitude
+		__m128 hh = _mm_add_ps(h0001,
+		                       _mm_mul_ps(vv,
+		                                  _mm_sub_ps(h1011, h0001)));
+		hh = _mm_add_ps(hh, half);
+
+		__m128i hs = _mm_cvttps_epi32(hh);
+		_mm_storel_epi64((__m128i*) &dst[n],
+		                 _mm_packs_epi32(hs, hs));
+	}
+	#endif
+
+	for(; n < count; ++n)
+	{
+		float h00 = flt_tile_sampleClean((float) src0[col0[n]], nodata);
+		float h01 = flt_tile_sampleClean((float) src0[col1[n]], nodata);
+		float h10 = flt_tile_sampleClean((float) src1[col0[n]], nodata);
+		float h11 = flt_tile_sampleClean((float) src1[col1[n]], nodata);
+
+		// interpolate longitude
+		float h0001 = h00 + u[n]*(h01 - h00);
+		float h1011 = h10 + u[n]*(h11 - h10);
+
+		// interpolate latitude
+		dst[n] = (short) (h0001 + v*(h1011 - h0001) + 0.5f);
+	}
+}
+
+int flt_tile_sampleRow(flt_tile_t* self, double lat,
+                       int count, const double* lon,
+                       short* height, unsigned char* mask)
+{
+	ASSERT(self);
+	ASSERT(lon);
+
+	if(count <= 0)
+	{
+		return 0;
+	}
+
+	return flt_tile_sampleRows(self, 1, &lat, 0.0, 0.0,
+	                           count, lon, 0.0, 0.0,
+	                           height, mask);
+}
+
+int flt_tile_sampleGrid(flt_tile_t* self,
+                        double latT, double lonL,
+                        double latB, double lonR,
+                        int rows, int cols,
+                        short* height, unsigned char* mask)
+{
+	ASSERT(self);
+
+	if((rows <= 0) || (cols <= 0))
+	{
+		return 0;
+	}
+
+	return flt_tile_sampleRows(self, rows, NULL, latT, latB,
+	                           cols, NULL, lonL, lonR,
+	                           height, mask);
+}
@@ -24,12 +24,23 @@
 #ifndef flt_tile_H
 #define flt_tile_H
 
+#include <pthread.h>
+#include <stddef.h>
+
 #define FLT_MSBFIRST -1
 #define FLT_LSBFIRST 1
 
+// rows per band for lazy conversion
+#define FLT_TILE_BAND 64
+
 #define FLT_TILE_TYPE_USGS    0
 #define FLT_TILE_TYPE_ASTERV3 1
 
+// int16 sidecar codecs (see flt_tile_exportI16)
+#define FLT_TILE_I16_NONE -1
+#define FLT_TILE_I16_RAW  0
+#define FLT_TILE_I16_ZLIB 1
+
 typedef struct
 {
 	int    type;
@@ -44,12 +55,82 @@ typedef struct
 	int    nrows;
 	int    ncols;
 	short* height;
+
+	// lazy conversion (optional)
+	// the flt file is mapped and bands of FLT_TILE_BAND rows
+	// are converted on the first call to flt_tile_row
+	int             lazy;
+	void*           map;
+	size_t          map_size;
+	size_t          height_size;
+	unsigned char*  bands;
+	pthread_mutex_t mutex;
+
+	// int16 sidecar codec
+	// raw heights are referenced in place from the map
+	// and zlib bands are inflated in place of conversion
+	int codec;
+
+	// lazy TIFF decoding (ASTERv3)
+	// bands are converted from TIFF tiles which are decoded
+	// on demand and kept in a small LRU of tif_count tiles
+	void*         tif;
+	int           tif_tw;
+	int           tif_th;
+	int           tif_count;
+	unsigned int  tif_clock;
+	int*          tif_key;
+	unsigned int* tif_stamp;
+	short*        tif_data;
 } flt_tile_t;
 
-flt_tile_t* flt_tile_import(int type, int lat, int lon);
-void        flt_tile_delete(flt_tile_t** _self);
-int         flt_tile_sample(flt_tile_t* self,
-                            double lat, double lon,
-                            short* height);
+flt_tile_t*  flt_tile_import(int type, int lat, int lon);
+flt_tile_t*  flt_tile_importLazy(int type, int lat, int lon);
+void         flt_tile_delete(flt_tile_t** _self);
+int          flt_tile_exportI16(flt_tile_t* self, int codec);
+void         flt_tile_setDecoders(int count);
+const short* flt_tile_row(flt_tile_t* self, int row);
+int          flt_tile_sample(flt_tile_t* self,
+                             double lat, double lon,
+                             short* height);
+
+// batched sampling
+// heights are identical to flt_tile_sample at the same
+// coordinates and the mask is set for covered samples
+// (uncovered heights are 0). sampleRow samples count
+// longitudes at lat and sampleGrid samples a rows x cols
+// grid spaced regularly from latT/lonL to latB/lonR which
+// is stored row major. Returns the number of covered
+// samples.
+int          flt_tile_sampleRow(flt_tile_t* self,
+                                double lat, int count,
+                                const double* lon,
+                                short* height,
+                                unsigned char* mask);
+int          flt_tile_sampleGrid(flt_tile_t* self,
+                                 double latT, double lonL,
+                                 double latB, double lonR,
+                                 int rows, int cols,
+                                 short* height,
+                                 unsigned char* mask);
+
+// sampling kernel
+// sampleIndex computes the indices and weight of the
+// normalized coordinate t in [0, 1] (rows are measured
+// from the top) and returns 0 if t is not covered.
+// sampleBlock interpolates count samples between the
+// rows src0/src1 with the weight v at the columns and
+// weights computed by sampleIndex.
+int          flt_tile_sampleIndex(double t, int count,
+                                  int* _i0, int* _i1,
+                                  float* _w);
+void         flt_tile_sampleBlock(flt_tile_t* self,
+                                  const short* src0,
+                                  const short* src1,
+                                  float v,
+                                  const int* col0,
+                                  const int* col1,
+                                  const float* u,
+                                  int count, short* dst);
 
 #endif
@@ -0,0 +1,603 @@
+/*
+ * Copyright (c) 2020 Jeff Boody
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LOG_TAG "flt"
+#include "../../libcc/cc_log.h"
+#include "../../libcc/cc_memory.h"
+#include "flt_zip.h"
+
+#define FLT_ZIP_SIG_LOCAL   0x04034b50
+#define FLT_ZIP_SIG_CENTRAL 0x02014b50
+#define FLT_ZIP_SIG_END     0x06054b50
+
+#define FLT_ZIP_METHOD_STORED  0
+#define FLT_ZIP_METHOD_DEFLATE 8
+
+typedef struct
+{
+	char           zname[256];
+	unsigned int   stamp;
+	int            count;
+	flt_zipEntry_t entries[FLT_ZIP_ENTRIES];
+} flt_zipDir_t;
+
+// central directory cache
+static pthread_mutex_t flt_zip_mutex = PTHREAD_MUTEX_INITIALIZER;
+static unsigned int    flt_zip_clock = 0;
+static flt_zipDir_t    flt_zip_cache[FLT_ZIP_CACHE];
+
+/***********************************************************
+* private                                                  *
+***********************************************************/
+
+static uint32_t flt_zip_u16(const unsigned char* p)
+{
+	ASSERT(p);
+
+	return ((uint32_t) p[0]) | (((uint32_t) p[1]) << 8);
+}
+
+static uint32_t flt_zip_u32(const unsigned char* p)
+{
+	ASSERT(p);
+
+	return ((uint32_t) p[0])         |
+	       (((uint32_t) p[1]) << 8)  |
+	       (((uint32_t) p[2]) << 16) |
+	       (((uint32_t) p[3]) << 24);
+}
+
+static const char* flt_zip_basename(const char* name)
+{
+	ASSERT(name);
+
+	const char* base = strrchr(name, '/');
+	return base ? base + 1 : name;
+}
+
+static int flt_zip_filter(const char* base)
+{
+	ASSERT(base);
+
+	size_t len = strlen(base);
+	if(strncmp(base, "float", 5) == 0)
+	{
+		return 1;
+	}
+	else if((len > 8) && (strcmp(&base[len - 8], "_dem.tif") == 0))
+	{
+		return 1;
+	}
+
+	return 0;
+}
+
+static int
+flt_zip_parse(flt_zipDir_t* dir, FILE* f, const char* zname)
+{
+	ASSERT(dir);
+	ASSERT(f);
+	ASSERT(zname);
+
+	// find the end of central directory record which is
+	// followed by a comment of up to 64KB
+	if(fseek(f, 0, SEEK_END) != 0)
+	{
+		LOGE("fseek %s failed", zname);
+		return 0;
+	}
+
+	long size = ftell(f);
+	long tail = 22 + 65535;
+	if(tail > size)
+	{
+		tail = size;
+	}
+	if(tail < 22)
+	{
+		LOGE("invalid %s", zname);
+		return 0;
+	}
+
+	unsigned char* buf = (unsigned char*) MALLOC(tail);
+	if(buf == NULL)
+	{
+		LOGE("MALLOC failed");
+		return 0;
+	}
+
+	if((fseek(f, size - tail, SEEK_SET) != 0) ||
+	   (fread(buf, tail, 1, f) != 1))
+	{
+		LOGE("fread %s failed", zname);
+		goto fail_tail;
+	}
+
+	long i;
+	const unsigned char* end = NULL;
+	for(i = tail - 22; i >= 0; --i)
+	{
+		if(flt_zip_u32(&buf[i]) == FLT_ZIP_SIG_END)
+		{
+			end = &buf[i];
+			break;
+		}
+	}
+
+	if(end == NULL)
+	{
+		LOGE("invalid %s", zname);
+		goto fail_tail;
+	}
+
+	uint32_t count  = flt_zip_u16(&end[10]);
+	uint32_t cdsize = flt_zip_u32(&end[12]);
+	uint32_t cdoff  = flt_zip_u32(&end[16]);
+	if((uint64_t) cdoff + cdsize > (uint64_t) size)
+	{
+		LOGE("invalid %s", zname);
+		goto fail_tail;
+	}
+
+	unsigned char* cd = (unsigned char*) MALLOC(cdsize + 1);
+	if(cd == NULL)
+	{
+		LOGE("MALLOC failed");
+		goto fail_cd;
+	}
+
+	if((fseek(f, cdoff, SEEK_SET) != 0) ||
+	   ((cdsize > 0) && (fread(cd, cdsize, 1, f) != 1)))
+	{
+		LOGE("fread %s failed", zname);
+		goto fail_read;
+	}
+
+	snprintf(dir->zname, 256, "%s", zname);
+	dir->count = 0;
+
+	uint32_t n;
+	uint32_t pos = 0;
+	for(n = 0; n < count; ++n)
+	{
+		const unsigned char* e = &cd[pos];
+		if((pos + 46 > cdsize) ||
+		   (flt_zip_u32(e) != FLT_ZIP_SIG_CENTRAL))
+		{
+			LOGE("invalid %s", zname);
+			goto fail_read;
+		}
+
+		uint32_t flags = flt_zip_u16(&e[8]);
+		uint32_t nlen  = flt_zip_u16(&e[28]);
+		uint32_t xlen  = flt_zip_u16(&e[30]);
+		uint32_t clen  = flt_zip_u16(&e[32]);
+		if(pos + 46 + nlen > cdsize)
+		{
+			LOGE("invalid %s", zname);
+			goto fail_read;
+		}
+
+		char name[256];
+		snprintf(name, 256, "%.*s", (int) nlen,
+		         (const char*) &e[46]);
+		pos += 46 + nlen + xlen + clen;
+
+		if(flt_zip_filter(flt_zip_basename(name)) == 0)
+		{
+			continue;
+		}
+
+		flt_zipEntry_t* entry = &dir->entries[dir->count];
+		snprintf(entry->name, 256, "%s", name);
+		entry->method = (int) flt_zip_u16(&e[10]);
+		entry->crc    = flt_zip_u32(&e[16]);
+		entry->csize  = flt_zip_u32(&e[20]);
+		entry->usize  = flt_zip_u32(&e[24]);
+		entry->offset = flt_zip_u32(&e[42]);
+
+		if((entry->csize  == 0xFFFFFFFF) ||
+		   (entry->usize  == 0xFFFFFFFF) ||
+		   (entry->offset == 0xFFFFFFFF))
+		{
+			LOGW("%s: zip64 not supported for %s",
+			     zname, name);
+			continue;
+		}
+		else if(flags & 1)
+		{
+			LOGW("%s: encrypted %s", zname, name);
+			continue;
+		}
+
+		if(dir->count == FLT_ZIP_ENTRIES)
+		{
+			LOGW("%s: too many entries", zname);
+			break;
+		}
+		++dir->count;
+	}
+
+	FREE(cd);
+	FREE(buf);
+
+	// success
+	return 1;
+
+	// failure
+	fail_read:
+		FREE(cd);
+	fail_cd:
+	fail_tail:
+		FREE(buf);
+	return 0;
+}
+
+static int
+flt_zip_find(FILE* f, const char* zname,
+             const char* name, flt_zipEntry_t* entry)
+{
+	ASSERT(f);
+	ASSERT(zname);
+	ASSERT(name);
+	ASSERT(entry);
+
+	flt_zipDir_t* dir = NULL;
+
+	pthread_mutex_lock(&flt_zip_mutex);
+	++flt_zip_clock;
+
+	int i;
+	int lru = 0;
+	for(i = 0; i < FLT_ZIP_CACHE; ++i)
+	{
+		flt_zipDir_t* d = &flt_zip_cache[i];
+		if(strcmp(d->zname, zname) == 0)
+		{
+			dir = d;
+			break;
+		}
+
+		if(d->stamp < flt_zip_cache[lru].stamp)
+		{
+			lru = i;
+		}
+	}
+
+	if(dir == NULL)
+	{
+		// parse the directory into the LRU slot
+		dir = &flt_zip_cache[lru];
+		if(flt_zip_parse(dir, f, zname) == 0)
+		{
+			memset(dir, 0, sizeof(flt_zipDir_t));
+			pthread_mutex_unlock(&flt_zip_mutex);
+			return 0;
+		}
+	}
+	dir->stamp = flt_zip_clock;
+
+	int found = 0;
+	const char* base = flt_zip_basename(name);
+	for(i = 0; i < dir->count; ++i)
+	{
+		if(strcmp(flt_zip_basename(dir->entries[i].name),
+		          base) == 0)
+		{
+			*entry = dir->entries[i];
+			found  = 1;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&flt_zip_mutex);
+
+	return found;
+}
+
+static ssize_t
+flt_zip_cookieRead(void* cookie, char* buf, size_t size)
+{
+	ASSERT(cookie);
+	ASSERT(buf);
+
+	flt_zipFile_t* self = (flt_zipFile_t*) cookie;
+
+	size_t left = self->uleft;
+	size_t bytes = flt_zip_fread(self, buf, size);
+	if((bytes == 0) && (left > 0))
+	{
+		return -1;
+	}
+
+	return (ssize_t) bytes;
+}
+
+static int flt_zip_cookieClose(void* cookie)
+{
+	ASSERT(cookie);
+
+	flt_zipFile_t* self = (flt_zipFile_t*) cookie;
+	flt_zip_fclose(&self);
+	return 0;
+}
+
+/***********************************************************
+* public                                                   *
+***********************************************************/
+
+flt_zipFile_t* flt_zip_fopen(const char* zname,
+                             const char* name)
+{
+	ASSERT(zname);
+	ASSERT(name);
+
+	FILE* f = fopen(zname, "r");
+	if(f == NULL)
+	{
+		// skip silently
+		return NULL;
+	}
+
+	flt_zipEntry_t entry;
+	if(flt_zip_find(f, zname, name, &entry) == 0)
+	{
+		// skip silently
+		goto fail_find;
+	}
+
+	if((entry.method != FLT_ZIP_METHOD_STORED) &&
+	   (entry.method != FLT_ZIP_METHOD_DEFLATE))
+	{
+		LOGE("%s: unsupported method=%i for %s",
+		     zname, entry.method, name);
+		goto fail_find;
+	}
+
+	// skip the local header
+	unsigned char local[30];
+	if((fseek(f, entry.offset, SEEK_SET) != 0) ||
+	   (fread(local, sizeof(local), 1, f) != 1) ||
+	   (flt_zip_u32(local) != FLT_ZIP_SIG_LOCAL))
+	{
+		LOGE("invalid %s: %s", zname, name);
+		goto fail_find;
+	}
+
+	long skip = flt_zip_u16(&local[26]) +
+	            flt_zip_u16(&local[28]);
+	if(fseek(f, skip, SEEK_CUR) != 0)
+	{
+		LOGE("invalid %s: %s", zname, name);
+		goto fail_find;
+	}
+
+	flt_zipFile_t* self;
+	self = (flt_zipFile_t*) CALLOC(1, sizeof(flt_zipFile_t));
+	if(self == NULL)
+	{
+		LOGE("CALLOC failed");
+		goto fail_self;
+	}
+
+	self->f     = f;
+	self->entry = entry;
+	self->cleft = entry.csize;
+	self->uleft = entry.usize;
+	self->crc   = crc32(0L, Z_NULL, 0);
+
+	if((entry.method == FLT_ZIP_METHOD_DEFLATE) &&
+	   (inflateInit2(&self->zs, -MAX_WBITS) != Z_OK))
+	{
+		LOGE("inflateInit2 failed");
+		goto fail_inflate;
+	}
+
+	// success
+	return self;
+
+	// failure
+	fail_inflate:
+		FREE(self);
+	fail_self:
+	fail_find:
+		fclose(f);
+	return NULL;
+}
+
+void flt_zip_fclose(flt_zipFile_t** _self)
+{
+	ASSERT(_self);
+
+	flt_zipFile_t* self = *_self;
+	if(self)
+	{
+		if(self->entry.method == FLT_ZIP_METHOD_DEFLATE)
+		{
+			inflateEnd(&self->zs);
+		}
+		fclose(self->f);
+		FREE(self);
+		*_self = NULL;
+	}
+}
+
+size_t flt_zip_fread(flt_zipFile_t* self,
+                     void* data, size_t size)
+{
+	ASSERT(self);
+	ASSERT(data);
+
+	if(size > self->uleft)
+	{
+		size = self->uleft;
+	}
+
+	size_t bytes = 0;
+	if(self->entry.method == FLT_ZIP_METHOD_STORED)
+	{
+		bytes = fread(data, 1, size, self->f);
+	}
+	else
+	{
+		// stream the compressed data through inflate
+		z_stream* zs  = &self->zs;
+		zs->next_out  = (Bytef*) data;
+		zs->avail_out = (uInt) size;
+		while(zs->avail_out > 0)
+		{
+			if((zs->avail_in == 0) && (self->cleft > 0))
+			{
+				uint32_t count = self->cleft;
+				if(count > FLT_ZIP_BUFSIZE)
+				{
+					count = FLT_ZIP_BUFSIZE;
+				}
+
+				if(fread(self->buf, count, 1, self->f) != 1)
+				{
+					LOGE("fread %s failed", self->entry.name);
+					break;
+				}
+				self->cleft  -= count;
+				zs->next_in   = self->buf;
+				zs->avail_in  = count;
+			}
+
+			int ret = inflate(zs, Z_NO_FLUSH);
+			if((ret != Z_OK) && (ret != Z_STREAM_END))
+			{
+				LOGE("inflate %s failed", self->entry.name);
+				break;
+			}
+			else if((ret == Z_STREAM_END) ||
+			        ((zs->avail_in == 0) && (self->cleft == 0)))
+			{
+				break;
+			}
+		}
+		bytes = size - zs->avail_out;
+	}
+
+	self->crc    = crc32(self->crc, (const Bytef*) data,
+	                     (uInt) bytes);
+	self->uleft -= (uint32_t) bytes;
+
+	if(bytes < size)
+	{
+		LOGE("truncated %s", self->entry.name);
+		return bytes;
+	}
+	else if((self->uleft == 0) && (self->crc != self->entry.crc))
+	{
+		LOGE("invalid crc %s", self->entry.name);
+		return 0;
+	}
+
+	return bytes;
+}
+
+size_t flt_zip_size(flt_zipFile_t* self)
+{
+	ASSERT(self);
+
+	return self->entry.usize;
+}
+
+void* flt_zip_load(const char* zname, const char* name,
+                   size_t* _size)
+{
+	ASSERT(zname);
+	ASSERT(name);
+	ASSERT(_size);
+
+	flt_zipFile_t* zf = flt_zip_fopen(zname, name);
+	if(zf == NULL)
+	{
+		return NULL;
+	}
+
+	// the data is terminated for text parsing
+	size_t size = flt_zip_size(zf);
+	unsigned char* data = (unsigned char*) MALLOC(size + 1);
+	if(data == NULL)
+	{
+		LOGE("MALLOC failed");
+		goto fail_data;
+	}
+
+	if(flt_zip_fread(zf, data, size) != size)
+	{
+		goto fail_read;
+	}
+	data[size] = '\0';
+
+	flt_zip_fclose(&zf);
+
+	*_size = size;
+
+	// success
+	return (void*) data;
+
+	// failure
+	fail_read:
+		FREE(data);
+	fail_data:
+		flt_zip_fclose(&zf);
+	return NULL;
+}
+
+FILE* flt_zip_stream(const char* zname, const char* name)
+{
+	ASSERT(zname);
+	ASSERT(name);
+
+	flt_zipFile_t* zf = flt_zip_fopen(zname, name);
+	if(zf == NULL)
+	{
+		return NULL;
+	}
+
+	cookie_io_functions_t io =
+	{
+		.read  = flt_zip_cookieRead,
+		.write = NULL,
+		.seek  = NULL,
+		.close = flt_zip_cookieClose,
+	};
+
+	FILE* f = fopencookie((void*) zf, "r", io);
+	if(f == NULL)
+	{
+		LOGE("fopencookie failed");
+		flt_zip_fclose(&zf);
+		return NULL;
+	}
+
+	return f;
+}
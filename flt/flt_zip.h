@@ -0,0 +1,81 @@
+/*
+ * Copyright (c) 2020 Jeff Boody
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#ifndef flt_zip_H
+#define flt_zip_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <zlib.h>
+
+// maximum flt entries per archive
+#define FLT_ZIP_ENTRIES 16
+
+// number of archive directories cached
+#define FLT_ZIP_CACHE 64
+
+// size of the compressed input buffer
+#define FLT_ZIP_BUFSIZE 65536
+
+// Zip archives are read in place of the unzipped source
+// files. The central directory of each archive is parsed
+// once and cached (limited to the entries named float* or
+// *_dem.tif). Entries are found by the base name of the
+// requested file and must be stored or deflated. Zip64 is not supported.
+// flt_zip_stream wraps an entry as a read-only FILE.
+typedef struct
+{
+	char     name[256];
+	int      method;
+	uint32_t crc;
+	uint32_t csize;
+	uint32_t usize;
+	uint32_t offset;
+} flt_zipEntry_t;
+
+typedef struct
+{
+	FILE*          f;
+	flt_zipEntry_t entry;
+
+	uint32_t cleft;
+	uint32_t uleft;
+	uint32_t crc;
+
+	z_stream      zs;
+	unsigned char buf[FLT_ZIP_BUFSIZE];
+} flt_zipFile_t;
+
+flt_zipFile_t* flt_zip_fopen(const char* zname,
+                             const char* name);
+void           flt_zip_fclose(flt_zipFile_t** _self);
+size_t         flt_zip_fread(flt_zipFile_t* self,
+                             void* data, size_t size);
+size_t         flt_zip_size(flt_zipFile_t* self);
+void*          flt_zip_load(const char* zname,
+                            const char* name,
+                            size_t* _size);
+FILE*          flt_zip_stream(const char* zname,
+                              const char* name);
+
+#endif
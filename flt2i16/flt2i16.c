@@ -0,0 +1,92 @@
+/*
+ * Copyright (c) 2020 Jeff Boody
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#define LOG_TAG "flt2i16"
+#include "libcc/cc_log.h"
+#include "flt/flt_tile.h"
+
+// flt2i16 converts the source tiles in a range to int16
+// sidecars which are preferred by flt_tile_import
+// existing sidecars are re-encoded so remove the i16
+// directory after the source tiles are updated
+
+int main(int argc, char** argv)
+{
+	if((argc != 6) && (argc != 7))
+	{
+		LOGE("usage: %s [USGS|ASTERv3] [latT] [lonL] [latB] [lonR] [raw|zlib]",
+		     argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	int type = FLT_TILE_TYPE_USGS;
+	if(strcmp(argv[1], "ASTERv3") == 0)
+	{
+		type = FLT_TILE_TYPE_ASTERV3;
+	}
+
+	int latT = (int) strtol(argv[2], NULL, 0);
+	int lonL = (int) strtol(argv[3], NULL, 0);
+	int latB = (int) strtol(argv[4], NULL, 0);
+	int lonR = (int) strtol(argv[5], NULL, 0);
+
+	int codec = FLT_TILE_I16_RAW;
+	if((argc == 7) && (strcmp(argv[6], "zlib") == 0))
+	{
+		codec = FLT_TILE_I16_ZLIB;
+	}
+
+	int lat;
+	int lon;
+	int count = 0;
+	for(lat = latB; lat <= latT; ++lat)
+	{
+		for(lon = lonL; lon <= lonR; ++lon)
+		{
+			flt_tile_t* tile = flt_tile_import(type, lat, lon);
+			if(tile == NULL)
+			{
+				// skip missing tiles
+				continue;
+			}
+
+			if(flt_tile_exportI16(tile, codec) == 0)
+			{
+				flt_tile_delete(&tile);
+				return EXIT_FAILURE;
+			}
+			flt_tile_delete(&tile);
+
+			LOGI("converted %i/%i", lat, lon);
+			++count;
+		}
+	}
+
+	LOGI("converted %i tiles", count);
+
+	// success
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,4 @@
+ln -s ../../libcc
+ln -s ../../libexpat
+ln -s ../../libxmlstream
+ln -s ../flt
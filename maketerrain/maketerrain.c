@@ -23,6 +23,7 @@
 
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 
 #define LOG_TAG "maketerrain"
 #include "libcc/cc_log.h"
@@ -32,10 +33,24 @@
 
 int main(int argc, char** argv)
 {
-	if(argc != 6)
+	if(argc < 6)
 	{
-		LOGE("usage: %s [latT] [lonL] [latB] [lonR] [path]",
+		LOGE("usage: %s [latT] [lonL] [latB] [lonR] [path] [options]",
 		     argv[0]);
+		LOGE("options:");
+		LOGE("--threads=N: build z13 subtrees on N threads");
+		LOGE("--stream: build z13 tiles in Morton order with bounded memory");
+		LOGE("--order=hilbert: build z13 tiles in Hilbert order of the flt cells");
+		LOGE("--budget=MB: cache budget (default %i or MAKETERRAIN_BUDGET)",
+		     MK_STATE_BUDGET);
+		LOGE("--writers=N: export tiles on N background threads");
+		LOGE("--prefetch=N: prefetch flt objects for the next N cells");
+		LOGE("--mmap: map USGS flt files and decode ASTER TIFF tiles on first use");
+		LOGE("--decoders=N: decode ASTER TIFF files on N threads");
+		LOGE("--pack: append tiles to z%i packs rather than terrainv2 files",
+		     TERRAIN_PACK_ZOOM);
+		LOGE("--codec=NAME[:LEVEL]: compress tiles with deflate, raw, zstd or lz4");
+		LOGE("--filter=NAME[+planes]: filter tiles with none, sub, up, paeth or med");
 		return EXIT_FAILURE;
 	}
 
@@ -45,21 +60,201 @@ int main(int argc, char** argv)
 	int   lonR = (int) strtol(argv[4], NULL, 0);
 	char* path = argv[5];
 
+	int i;
+	int threads  = 1;
+	int stream   = 0;
+	int budget   = MK_STATE_BUDGET;
+	int order    = MK_STATE_ORDER_ROWMAJOR;
+	int writers  = 0;
+	int prefetch = 0;
+	int lazy     = 0;
+	int decoders = 0;
+	int pack     = 0;
+	int codec    = TERRAIN_CODEC_DEFLATE;
+	int level    = TERRAIN_CODEC_LEVEL_DEFAULT;
+	int filter   = TERRAIN_FILTER_NONE;
+
+	// the command line budget overrides the environment
+	const char* env = getenv("MAKETERRAIN_BUDGET");
+	if(env)
+	{
+		budget = (int) strtol(env, NULL, 0);
+		if(budget < 1)
+		{
+			LOGE("invalid MAKETERRAIN_BUDGET=%s", env);
+			return EXIT_FAILURE;
+		}
+	}
+	for(i = 6; i < argc; ++i)
+	{
+		if(strncmp(argv[i], "--threads=", 10) == 0)
+		{
+			threads = (int) strtol(&argv[i][10], NULL, 0);
+			if(threads < 1)
+			{
+				LOGE("invalid %s", argv[i]);
+				return EXIT_FAILURE;
+			}
+		}
+		else if(strncmp(argv[i], "--budget=", 9) == 0)
+		{
+			budget = (int) strtol(&argv[i][9], NULL, 0);
+			if(budget < 1)
+			{
+				LOGE("invalid %s", argv[i]);
+				return EXIT_FAILURE;
+			}
+		}
+		else if(strncmp(argv[i], "--writers=", 10) == 0)
+		{
+			writers = (int) strtol(&argv[i][10], NULL, 0);
+			if(writers < 1)
+			{
+				LOGE("invalid %s", argv[i]);
+				return EXIT_FAILURE;
+			}
+		}
+		else if(strncmp(argv[i], "--prefetch=", 11) == 0)
+		{
+			prefetch = (int) strtol(&argv[i][11], NULL, 0);
+			if(prefetch < 1)
+			{
+				LOGE("invalid %s", argv[i]);
+				return EXIT_FAILURE;
+			}
+		}
+		else if(strncmp(argv[i], "--decoders=", 11) == 0)
+		{
+			decoders = (int) strtol(&argv[i][11], NULL, 0);
+			if(decoders < 1)
+			{
+				LOGE("invalid %s", argv[i]);
+				return EXIT_FAILURE;
+			}
+		}
+		else if(strcmp(argv[i], "--order=hilbert") == 0)
+		{
+			order = MK_STATE_ORDER_HILBERT;
+		}
+		else if(strcmp(argv[i], "--stream") == 0)
+		{
+			stream = 1;
+		}
+		else if(strcmp(argv[i], "--mmap") == 0)
+		{
+			lazy = 1;
+		}
+		else if(strcmp(argv[i], "--pack") == 0)
+		{
+			pack = 1;
+		}
+		else if(strncmp(argv[i], "--codec=", 8) == 0)
+		{
+			if(terrain_codec_parse(&argv[i][8], &codec,
+			                       &level) == 0)
+			{
+				LOGE("invalid %s", argv[i]);
+				return EXIT_FAILURE;
+			}
+		}
+		else if(strncmp(argv[i], "--filter=", 9) == 0)
+		{
+			if(terrain_codec_parseFilter(&argv[i][9],
+			                             &filter) == 0)
+			{
+				LOGE("invalid %s", argv[i]);
+				return EXIT_FAILURE;
+			}
+		}
+		else
+		{
+			LOGE("invalid %s", argv[i]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	if(stream && (threads > 1))
+	{
+		LOGE("--stream does not support --threads");
+		return EXIT_FAILURE;
+	}
+	else if(stream && (order != MK_STATE_ORDER_ROWMAJOR))
+	{
+		LOGE("--stream does not support --order");
+		return EXIT_FAILURE;
+	}
+
+	// codecs and filters are only written by the exporter
+	int encode = (codec  != TERRAIN_CODEC_DEFLATE)       ||
+	             (level  != TERRAIN_CODEC_LEVEL_DEFAULT) ||
+	             (filter != TERRAIN_FILTER_NONE);
+	if(encode && (writers < 1))
+	{
+		writers = 1;
+	}
+
 	mk_state_t* state;
-	state = mk_state_new(latT, lonL, latB, lonR, path);
+	state = mk_state_new(latT, lonL, latB, lonR, path,
+	                     ((size_t) budget)*1024*1024,
+	                     writers, pack);
 	if(state == NULL)
 	{
 		return EXIT_FAILURE;
 	}
 
+	if(encode &&
+	   (mk_state_setCodec(state, codec, level, filter) == 0))
+	{
+		goto fail_codec;
+	}
+
+	if(prefetch)
+	{
+		mk_state_enablePrefetch(state, prefetch);
+	}
+
+	if(lazy)
+	{
+		mk_state_enableLazyFlt(state);
+	}
+
+	if(decoders)
+	{
+		flt_tile_setDecoders(decoders);
+	}
+
+	// build the z13 subtrees in parallel or in the
+	// requested order and then merge the z0-z12 ancestors
+	// from the cached tiles
+	if((threads > 1) || (order != MK_STATE_ORDER_ROWMAJOR))
+	{
+		if(mk_state_build13(state, threads, order) == 0)
+		{
+			goto fail_get;
+		}
+	}
+
 	mk_object_t* obj;
-	obj = mk_state_getTerrain(state, 0, 0, 0);
+	if(stream)
+	{
+		obj = mk_state_stream(state);
+	}
+	else
+	{
+		obj = mk_state_getTerrain(state, 0, 0, 0);
+	}
 	if(obj == NULL)
 	{
 		goto fail_get;
 	}
 
 	mk_state_put(state, &obj);
+
+	if(mk_state_finish(state) == 0)
+	{
+		goto fail_finish;
+	}
+
 	mk_state_delete(&state);
 
 	// check for memory leak
@@ -72,7 +267,9 @@ int main(int argc, char** argv)
 	return EXIT_SUCCESS;
 
 	// failure
+	fail_finish:
 	fail_get:
+	fail_codec:
 		mk_state_delete(&state);
 	return EXIT_FAILURE;
 }
@@ -0,0 +1,166 @@
+/*
+ * Copyright (c) 2020 Jeff Boody
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#define LOG_TAG "mk_bench"
+#include "libcc/cc_log.h"
+#include "libcc/cc_map.h"
+#include "libcc/cc_memory.h"
+#include "libcc/cc_timestamp.h"
+#include "mk_index.h"
+
+// microbenchmark which compares the mk_state object
+// lookups using cc_map string keys and mk_index keys
+
+#define MK_BENCH_SIZE 128
+#define MK_BENCH_REPS 16
+
+static int mk_bench_val = 1;
+
+static double mk_bench_map(cc_map_t* map)
+{
+	ASSERT(map);
+
+	int    x;
+	int    y;
+	int    r;
+	int    found = 0;
+	double t0    = cc_timestamp();
+	for(r = 0; r < MK_BENCH_REPS; ++r)
+	{
+		for(y = 0; y < MK_BENCH_SIZE; ++y)
+		{
+			for(x = 0; x < MK_BENCH_SIZE; ++x)
+			{
+				if(cc_map_findf(map, "T/%i/%i/%i", 15,
+				                6000 + x, 3000 + y))
+				{
+					++found;
+				}
+			}
+		}
+	}
+	double dt = cc_timestamp() - t0;
+
+	if(found != MK_BENCH_REPS*MK_BENCH_SIZE*MK_BENCH_SIZE)
+	{
+		LOGW("found=%i", found);
+	}
+	return dt;
+}
+
+static double mk_bench_index(mk_index_t* index)
+{
+	ASSERT(index);
+
+	int    x;
+	int    y;
+	int    r;
+	int    found = 0;
+	double t0    = cc_timestamp();
+	for(r = 0; r < MK_BENCH_REPS; ++r)
+	{
+		for(y = 0; y < MK_BENCH_SIZE; ++y)
+		{
+			for(x = 0; x < MK_BENCH_SIZE; ++x)
+			{
+				uint64_t key;
+				key = mk_index_keyTerrain(15, 6000 + x,
+				                          3000 + y);
+				if(mk_index_find(index, key))
+				{
+					++found;
+				}
+			}
+		}
+	}
+	double dt = cc_timestamp() - t0;
+
+	if(found != MK_BENCH_REPS*MK_BENCH_SIZE*MK_BENCH_SIZE)
+	{
+		LOGW("found=%i", found);
+	}
+	return dt;
+}
+
+int main(int argc, char** argv)
+{
+	cc_map_t* map = cc_map_new();
+	if(map == NULL)
+	{
+		return EXIT_FAILURE;
+	}
+
+	mk_index_t* index = mk_index_new();
+	if(index == NULL)
+	{
+		goto fail_index;
+	}
+
+	int x;
+	int y;
+	for(y = 0; y < MK_BENCH_SIZE; ++y)
+	{
+		for(x = 0; x < MK_BENCH_SIZE; ++x)
+		{
+			if(cc_map_addf(map, (const void*) &mk_bench_val,
+			               "T/%i/%i/%i", 15,
+			               6000 + x, 3000 + y) == NULL)
+			{
+				goto fail_add;
+			}
+
+			if(mk_index_add(index,
+			                mk_index_keyTerrain(15, 6000 + x,
+			                                    3000 + y),
+			                (void*) &mk_bench_val) == 0)
+			{
+				goto fail_add;
+			}
+		}
+	}
+
+	double ops = (double)
+	             (MK_BENCH_REPS*MK_BENCH_SIZE*MK_BENCH_SIZE);
+	double dt_map   = mk_bench_map(map);
+	double dt_index = mk_bench_index(index);
+	LOGI("cc_map:   %0.1lf ns/op", 1.0e9*dt_map/ops);
+	LOGI("mk_index: %0.1lf ns/op", 1.0e9*dt_index/ops);
+
+	mk_index_delete(&index);
+	cc_map_discard(map);
+	cc_map_delete(&map);
+
+	// success
+	return EXIT_SUCCESS;
+
+	// failure
+	fail_add:
+		mk_index_delete(&index);
+	fail_index:
+		cc_map_discard(map);
+		cc_map_delete(&map);
+	return EXIT_FAILURE;
+}
@@ -0,0 +1,369 @@
+/*
+ * Copyright (c) 2020 Jeff Boody
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+
+#include <dirent.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LOG_TAG "mk_benchcodec"
+#include "libcc/cc_log.h"
+#include "libcc/cc_memory.h"
+#include "libcc/cc_timestamp.h"
+#include "terrain/terrain_codec.h"
+#include "terrain/terrain_decoder.h"
+#include "terrain/terrain_tile.h"
+
+// benchmark which compares the compression ratio and the
+// encode/decode throughput of the tile codecs and filters
+// for the terrainv2 tiles of a terrain tree
+
+#define MK_BENCHCODEC_TILES 256
+#define MK_BENCHCODEC_REPS  4
+
+typedef struct
+{
+	int codec;
+	int level;
+	int filter;
+} mk_benchcodecConfig_t;
+
+#define MK_BENCHCODEC_MEDP (TERRAIN_FILTER_MED | \
+                            TERRAIN_FILTER_PLANES)
+
+static const mk_benchcodecConfig_t MK_BENCHCODEC_CONFIG[] =
+{
+	{ TERRAIN_CODEC_DEFLATE, TERRAIN_CODEC_LEVEL_DEFAULT, TERRAIN_FILTER_NONE   },
+	{ TERRAIN_CODEC_DEFLATE, 1,                           TERRAIN_FILTER_NONE   },
+	{ TERRAIN_CODEC_DEFLATE, 9,                           TERRAIN_FILTER_NONE   },
+	{ TERRAIN_CODEC_RAW,     TERRAIN_CODEC_LEVEL_DEFAULT, TERRAIN_FILTER_NONE   },
+	{ TERRAIN_CODEC_ZSTD,    1,                           TERRAIN_FILTER_NONE   },
+	{ TERRAIN_CODEC_ZSTD,    TERRAIN_CODEC_LEVEL_DEFAULT, TERRAIN_FILTER_NONE   },
+	{ TERRAIN_CODEC_ZSTD,    9,                           TERRAIN_FILTER_NONE   },
+	{ TERRAIN_CODEC_ZSTD,    19,                          TERRAIN_FILTER_NONE   },
+	{ TERRAIN_CODEC_LZ4,     TERRAIN_CODEC_LEVEL_DEFAULT, TERRAIN_FILTER_NONE   },
+	{ TERRAIN_CODEC_LZ4,     9,                           TERRAIN_FILTER_NONE   },
+	{ TERRAIN_CODEC_DEFLATE, TERRAIN_CODEC_LEVEL_DEFAULT, TERRAIN_FILTER_PLANES },
+	{ TERRAIN_CODEC_DEFLATE, TERRAIN_CODEC_LEVEL_DEFAULT, TERRAIN_FILTER_SUB    },
+	{ TERRAIN_CODEC_DEFLATE, TERRAIN_CODEC_LEVEL_DEFAULT, TERRAIN_FILTER_UP     },
+	{ TERRAIN_CODEC_DEFLATE, TERRAIN_CODEC_LEVEL_DEFAULT, TERRAIN_FILTER_PAETH  },
+	{ TERRAIN_CODEC_DEFLATE, TERRAIN_CODEC_LEVEL_DEFAULT, TERRAIN_FILTER_MED    },
+	{ TERRAIN_CODEC_DEFLATE, TERRAIN_CODEC_LEVEL_DEFAULT, MK_BENCHCODEC_MEDP    },
+	{ TERRAIN_CODEC_DEFLATE, 9,                           MK_BENCHCODEC_MEDP    },
+	{ TERRAIN_CODEC_ZSTD,    TERRAIN_CODEC_LEVEL_DEFAULT, MK_BENCHCODEC_MEDP    },
+	{ TERRAIN_CODEC_ZSTD,    19,                          MK_BENCHCODEC_MEDP    },
+	{ TERRAIN_CODEC_LZ4,     TERRAIN_CODEC_LEVEL_DEFAULT, MK_BENCHCODEC_MEDP    },
+	{ TERRAIN_CODEC_LZ4,     9,                           MK_BENCHCODEC_MEDP    },
+};
+
+static const char* MK_BENCHCODEC_FILTER[] =
+{
+	"",
+	"+sub",
+	"+up",
+	"+paeth",
+	"+med",
+};
+
+#define MK_BENCHCODEC_CONFIGS \
+	(int) (sizeof(MK_BENCHCODEC_CONFIG)/ \
+	       sizeof(mk_benchcodecConfig_t))
+
+/***********************************************************
+* protected                                                *
+***********************************************************/
+
+extern size_t terrain_tile_exportd(terrain_tile_t* self,
+                                   int codec, int level,
+                                   int filter, size_t size,
+                                   unsigned char* buffer);
+extern size_t terrain_tile_bound(void);
+
+/***********************************************************
+* private                                                  *
+***********************************************************/
+
+static int
+mk_benchcodec_load(const char* base, int max,
+                   terrain_tile_t* tiles)
+{
+	ASSERT(base);
+	ASSERT(tiles);
+
+	// load the first max tiles of each zoom level
+	// starting from the deepest zoom level since most
+	// tiles of a tree are leaves
+	int  count = 0;
+	int  zoom;
+	char path[256];
+	for(zoom = 24; (zoom >= 0) && (count < max); --zoom)
+	{
+		snprintf(path, 256, "%s/terrainv2/%i", base, zoom);
+		DIR* zdir = opendir(path);
+		if(zdir == NULL)
+		{
+			continue;
+		}
+
+		struct dirent* xde;
+		while((count < max) && (xde = readdir(zdir)))
+		{
+			if(xde->d_name[0] == '.')
+			{
+				continue;
+			}
+
+			int x = (int) strtol(xde->d_name, NULL, 0);
+
+			char xpath[512];
+			snprintf(xpath, 512, "%s/%s", path, xde->d_name);
+			DIR* xdir = opendir(xpath);
+			if(xdir == NULL)
+			{
+				continue;
+			}
+
+			struct dirent* yde;
+			while((count < max) && (yde = readdir(xdir)))
+			{
+				if(yde->d_name[0] == '.')
+				{
+					continue;
+				}
+
+				int y = (int) strtol(yde->d_name, NULL, 0);
+
+				terrain_tile_t* tile;
+				tile = terrain_tile_import(base, x, y, zoom);
+				if(tile == NULL)
+				{
+					continue;
+				}
+
+				memcpy(&tiles[count], tile,
+				       sizeof(terrain_tile_t));
+				terrain_tile_delete(&tile);
+				++count;
+			}
+			closedir(xdir);
+		}
+		closedir(zdir);
+	}
+
+	return count;
+}
+
+static void
+mk_benchcodec_run(const mk_benchcodecConfig_t* config,
+                  int count, terrain_tile_t* tiles,
+                  terrain_tile_t* tile,
+                  terrain_decoder_t* decoder,
+                  size_t bound, unsigned char* buffer,
+                  size_t* sizes)
+{
+	ASSERT(config);
+	ASSERT(tiles);
+	ASSERT(tile);
+	ASSERT(decoder);
+	ASSERT(buffer);
+	ASSERT(sizes);
+
+	// encode
+	int    i;
+	size_t total = 0;
+	double t0    = cc_timestamp();
+	for(i = 0; i < count; ++i)
+	{
+		sizes[i] = terrain_tile_exportd(&tiles[i],
+		                                config->codec,
+		                                config->level,
+		                                config->filter,
+		                                bound,
+		                                &buffer[i*bound]);
+		if(sizes[i] == 0)
+		{
+			LOGE("encode failed");
+			return;
+		}
+		total += sizes[i];
+	}
+	double t1 = cc_timestamp();
+
+	// decode
+	int r;
+	int mismatch = 0;
+	for(r = 0; r < MK_BENCHCODEC_REPS; ++r)
+	{
+		for(i = 0; i < count; ++i)
+		{
+			if(terrain_decoder_importd(decoder, sizes[i],
+			                           &buffer[i*bound],
+			                           tiles[i].x, tiles[i].y,
+			                           tiles[i].zoom,
+			                           tile) == 0)
+			{
+				LOGE("decode failed");
+				return;
+			}
+
+			if((r == 0) &&
+			   memcmp(tile->data, tiles[i].data,
+			          sizeof(tile->data)))
+			{
+				mismatch = 1;
+			}
+		}
+	}
+	double t2 = cc_timestamp();
+
+	double raw = ((double) count)*sizeof(tile->data);
+	double mb  = raw/(1024.0*1024.0);
+	char   level[16];
+	char   name[64];
+	level[0] = '\0';
+	if(config->level != TERRAIN_CODEC_LEVEL_DEFAULT)
+	{
+		snprintf(level, 16, ":%i", config->level);
+	}
+	snprintf(name, 64, "%s%s%s%s",
+	         terrain_codec_name(config->codec), level,
+	         MK_BENCHCODEC_FILTER[config->filter &
+	                              TERRAIN_FILTER_MASK],
+	         (config->filter & TERRAIN_FILTER_PLANES) ?
+	         "+planes" : "");
+
+	LOGI("%-20s: ratio=%0.2lf, bytes/tile=%i, encode=%0.1lf MB/s, decode=%0.1lf MB/s%s",
+	     name, raw/((double) total), (int) (total/count),
+	     mb/(t1 - t0),
+	     MK_BENCHCODEC_REPS*mb/(t2 - t1),
+	     mismatch ? " (mismatch)" : "");
+}
+
+/***********************************************************
+* public                                                   *
+***********************************************************/
+
+int main(int argc, char** argv)
+{
+	if((argc != 2) && (argc != 3))
+	{
+		LOGE("usage: %s [base] [tiles]", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	const char* base = argv[1];
+
+	int max = MK_BENCHCODEC_TILES;
+	if(argc == 3)
+	{
+		max = (int) strtol(argv[2], NULL, 0);
+		if(max < 1)
+		{
+			LOGE("invalid tiles=%s", argv[2]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	terrain_tile_t* tiles;
+	tiles = (terrain_tile_t*)
+	        MALLOC(max*sizeof(terrain_tile_t));
+	if(tiles == NULL)
+	{
+		LOGE("MALLOC failed");
+		return EXIT_FAILURE;
+	}
+
+	terrain_tile_t* tile = terrain_tile_new(0, 0, 0);
+	if(tile == NULL)
+	{
+		goto fail_tile;
+	}
+
+	terrain_decoder_t* decoder = terrain_decoder_new();
+	if(decoder == NULL)
+	{
+		goto fail_decoder;
+	}
+
+	size_t         bound  = terrain_tile_bound();
+	unsigned char* buffer;
+	buffer = (unsigned char*) MALLOC(max*bound);
+	if(buffer == NULL)
+	{
+		LOGE("MALLOC failed");
+		goto fail_buffer;
+	}
+
+	size_t* sizes = (size_t*) CALLOC(max, sizeof(size_t));
+	if(sizes == NULL)
+	{
+		LOGE("CALLOC failed");
+		goto fail_sizes;
+	}
+
+	int count = mk_benchcodec_load(base, max, tiles);
+	if(count == 0)
+	{
+		LOGE("invalid base=%s", base);
+		goto fail_load;
+	}
+	LOGI("tiles=%i", count);
+
+	int i;
+	for(i = 0; i < MK_BENCHCODEC_CONFIGS; ++i)
+	{
+		const mk_benchcodecConfig_t* config;
+		config = &MK_BENCHCODEC_CONFIG[i];
+		if(terrain_codec_supported(config->codec) == 0)
+		{
+			continue;
+		}
+
+		mk_benchcodec_run(config, count, tiles, tile,
+		                  decoder, bound, buffer, sizes);
+	}
+
+	FREE(sizes);
+	FREE(buffer);
+	terrain_decoder_delete(&decoder);
+	terrain_tile_delete(&tile);
+	FREE(tiles);
+
+	// success
+	return EXIT_SUCCESS;
+
+	// failure
+	fail_load:
+		FREE(sizes);
+	fail_sizes:
+		FREE(buffer);
+	fail_buffer:
+		terrain_decoder_delete(&decoder);
+	fail_decoder:
+		terrain_tile_delete(&tile);
+	fail_tile:
+		FREE(tiles);
+	return EXIT_FAILURE;
+}
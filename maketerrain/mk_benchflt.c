@@ -0,0 +1,206 @@
+/*
+ * Copyright (c) 2020 Jeff Boody
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LOG_TAG "mk_benchflt"
+#include "libcc/cc_log.h"
+#include "libcc/cc_memory.h"
+#include "libcc/cc_timestamp.h"
+#include "flt/flt_convert.h"
+#include "flt/flt_tile.h"
+
+// microbenchmark which compares the flt ingest conversion
+// kernels for USGS float rows and ASTERv3 int16 tiles
+
+#define MK_BENCHFLT_COLS 10812
+#define MK_BENCHFLT_ROWS 256
+#define MK_BENCHFLT_REPS 8
+
+static const char* MK_BENCHFLT_NAME[] =
+{
+	"scalar",
+	"ssse3",
+	"avx2",
+};
+
+static double
+mk_benchflt_f32(short* dst, const unsigned char* src,
+                int byteorder)
+{
+	ASSERT(dst);
+	ASSERT(src);
+
+	int    r;
+	int    row;
+	size_t rsize = MK_BENCHFLT_COLS*sizeof(float);
+	double t0    = cc_timestamp();
+	for(r = 0; r < MK_BENCHFLT_REPS; ++r)
+	{
+		for(row = 0; row < MK_BENCHFLT_ROWS; ++row)
+		{
+			flt_convert_f32(&dst[row*MK_BENCHFLT_COLS],
+			                &src[row*rsize],
+			                MK_BENCHFLT_COLS, byteorder);
+		}
+	}
+	return cc_timestamp() - t0;
+}
+
+static double
+mk_benchflt_i16(short* dst, const short* src)
+{
+	ASSERT(dst);
+	ASSERT(src);
+
+	int    r;
+	int    row;
+	double t0 = cc_timestamp();
+	for(r = 0; r < MK_BENCHFLT_REPS; ++r)
+	{
+		for(row = 0; row < MK_BENCHFLT_ROWS; ++row)
+		{
+			flt_convert_i16(&dst[row*MK_BENCHFLT_COLS],
+			                &src[row*MK_BENCHFLT_COLS],
+			                MK_BENCHFLT_COLS);
+		}
+	}
+	return cc_timestamp() - t0;
+}
+
+int main(int argc, char** argv)
+{
+	int    count = MK_BENCHFLT_ROWS*MK_BENCHFLT_COLS;
+	size_t fsize = count*sizeof(float);
+	size_t ssize = count*sizeof(short);
+
+	unsigned char* src_f32;
+	src_f32 = (unsigned char*) MALLOC(fsize);
+	if(src_f32 == NULL)
+	{
+		LOGE("MALLOC failed");
+		return EXIT_FAILURE;
+	}
+
+	short* src_i16 = (short*) MALLOC(ssize);
+	if(src_i16 == NULL)
+	{
+		LOGE("MALLOC failed");
+		goto fail_src_i16;
+	}
+
+	short* dst = (short*) MALLOC(ssize);
+	if(dst == NULL)
+	{
+		LOGE("MALLOC failed");
+		goto fail_dst;
+	}
+
+	short* ref = (short*) MALLOC(ssize);
+	if(ref == NULL)
+	{
+		LOGE("MALLOC failed");
+		goto fail_ref;
+	}
+
+	// heights in meters including nodata samples
+	int i;
+	srand(1);
+	for(i = 0; i < count; ++i)
+	{
+		float h = (float) (rand()%500000)/100.0f - 100.0f;
+		if(rand()%64 == 0)
+		{
+			h = -3.4028231e+38f;
+		}
+		memcpy(&src_f32[4*i], &h, sizeof(float));
+
+		src_i16[i] = (rand()%64 == 0) ? -9999 :
+		             (short) (rand()%9000 - 500);
+	}
+
+	int byteorder[2] =
+	{
+		FLT_LSBFIRST,
+		FLT_MSBFIRST,
+	};
+
+	int    k;
+	int    b;
+	double mb = ((double) MK_BENCHFLT_REPS)*fsize/(1024.0*1024.0);
+	for(b = 0; b < 2; ++b)
+	{
+		flt_convert_select(FLT_CONVERT_SCALAR);
+		mk_benchflt_f32(ref, src_f32, byteorder[b]);
+		for(k = FLT_CONVERT_SCALAR; k <= FLT_CONVERT_AVX2; ++k)
+		{
+			if(flt_convert_select(k) != k)
+			{
+				continue;
+			}
+
+			double dt = mk_benchflt_f32(dst, src_f32,
+			                            byteorder[b]);
+			LOGI("f32 %s %s: %0.1lf MB/s%s",
+			     (byteorder[b] == FLT_LSBFIRST) ?
+			     "LSBFIRST" : "MSBFIRST",
+			     MK_BENCHFLT_NAME[k], mb/dt,
+			     memcmp(dst, ref, ssize) ? " (mismatch)" : "");
+		}
+	}
+
+	mb = ((double) MK_BENCHFLT_REPS)*ssize/(1024.0*1024.0);
+	flt_convert_select(FLT_CONVERT_SCALAR);
+	mk_benchflt_i16(ref, src_i16);
+	for(k = FLT_CONVERT_SCALAR; k <= FLT_CONVERT_AVX2; ++k)
+	{
+		if(flt_convert_select(k) != k)
+		{
+			continue;
+		}
+
+		double dt = mk_benchflt_i16(dst, src_i16);
+		LOGI("i16 %s: %0.1lf MB/s%s",
+		     MK_BENCHFLT_NAME[k], mb/dt,
+		     memcmp(dst, ref, ssize) ? " (mismatch)" : "");
+	}
+
+	FREE(ref);
+	FREE(dst);
+	FREE(src_i16);
+	FREE(src_f32);
+
+	// success
+	return EXIT_SUCCESS;
+
+	// failure
+	fail_ref:
+		FREE(dst);
+	fail_dst:
+		FREE(src_i16);
+	fail_src_i16:
+		FREE(src_f32);
+	return EXIT_FAILURE;
+}
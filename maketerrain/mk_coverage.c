@@ -0,0 +1,380 @@
+/*
+ * Copyright (c) 2020 Jeff Boody
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#include <sys/stat.h>
+#include <dirent.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define LOG_TAG "maketerrain"
+#include "libcc/cc_log.h"
+#include "libcc/cc_memory.h"
+#include "mk_coverage.h"
+
+#define MK_COVERAGE_MAGIC   0x564F434BU
+#define MK_COVERAGE_VERSION 2
+
+// source, int16 sidecar and archive directories per type
+static const char*
+MK_COVERAGE_DIR[MK_COVERAGE_TYPES][MK_COVERAGE_KINDS] =
+{
+	{ "usgs-ned/data", "usgs-ned/i16", "usgs-ned/zip" },
+	{ "ASTERv3/data",  "ASTERv3/i16",  "ASTERv3/zip"  },
+};
+
+// file suffix per type and kind
+static const char*
+MK_COVERAGE_SUFFIX[MK_COVERAGE_TYPES][MK_COVERAGE_KINDS] =
+{
+	{ "",         ".i16", ".zip" },
+	{ "_dem.tif", ".i16", ".zip" },
+};
+
+/***********************************************************
+* private                                                  *
+***********************************************************/
+
+static int mk_coverage_index(int lat, int lon)
+{
+	if((lat < -90) || (lat >= 90) ||
+	   (lon < -180) || (lon >= 180))
+	{
+		return -1;
+	}
+
+	return (lat + 90)*360 + (lon + 180);
+}
+
+static void
+mk_coverage_set(mk_coverage_t* self, int type,
+                int lat, int lon)
+{
+	ASSERT(self);
+
+	int idx = mk_coverage_index(lat, lon);
+	if(idx >= 0)
+	{
+		self->bits[type][idx/8] |= (unsigned char) (1 << (idx%8));
+	}
+}
+
+static int64_t mk_coverage_mtime(const char* dname)
+{
+	ASSERT(dname);
+
+	struct stat st;
+	if(stat(dname, &st) != 0)
+	{
+		return 0;
+	}
+
+	return (int64_t) st.st_mtime;
+}
+
+static int
+mk_coverage_parse(int type, int kind,
+                  const char* name, int* _lat, int* _lon)
+{
+	ASSERT(name);
+	ASSERT(_lat);
+	ASSERT(_lon);
+
+	// names are matched by regenerating them since
+	// sscanf accepts variations such as a missing zero
+	// padding or a suffix
+	char ns;
+	char ew;
+	int  lat;
+	int  lon;
+	char buf[256];
+	if(type == FLT_TILE_TYPE_USGS)
+	{
+		// USGS is top-left origin
+		if(sscanf(name, "%c%d%c%d", &ns, &lat, &ew, &lon) != 4)
+		{
+			return 0;
+		}
+		snprintf(buf, 256, "%c%i%c%03i%s", ns, lat, ew, lon,
+		         MK_COVERAGE_SUFFIX[type][kind]);
+		lat = ((ns == 'n') ? lat : -lat) - 1;
+		lon = (ew == 'e') ? lon : -lon;
+		if(((ns != 'n') && (ns != 's')) ||
+		   ((ew != 'e') && (ew != 'w')))
+		{
+			return 0;
+		}
+	}
+	else
+	{
+		// ASTERv3 is bottom-left origin
+		if(sscanf(name, "ASTGTMV003_%c%2d%c%3d", &ns, &lat,
+		          &ew, &lon) != 4)
+		{
+			return 0;
+		}
+		snprintf(buf, 256, "ASTGTMV003_%c%02i%c%03i%s",
+		         ns, lat, ew, lon,
+		         MK_COVERAGE_SUFFIX[type][kind]);
+		lat = (ns == 'N') ? lat : -lat;
+		lon = (ew == 'E') ? lon : -lon;
+		if(((ns != 'N') && (ns != 'S')) ||
+		   ((ew != 'E') && (ew != 'W')))
+		{
+			return 0;
+		}
+	}
+
+	if(strcmp(buf, name) != 0)
+	{
+		return 0;
+	}
+
+	*_lat = lat;
+	*_lon = lon;
+	return 1;
+}
+
+static void
+mk_coverage_scan(mk_coverage_t* self, int type, int kind)
+{
+	ASSERT(self);
+
+	const char* dname = MK_COVERAGE_DIR[type][kind];
+
+	self->mtime[type][kind] = mk_coverage_mtime(dname);
+
+	DIR* dir = opendir(dname);
+	if(dir == NULL)
+	{
+		// sources are optional
+		return;
+	}
+
+	int lat;
+	int lon;
+	struct dirent* de;
+	char fname[512];
+	while((de = readdir(dir)))
+	{
+		if(mk_coverage_parse(type, kind, de->d_name,
+		                     &lat, &lon) == 0)
+		{
+			continue;
+		}
+
+		// the hdr file is required for USGS sources
+		if((type == FLT_TILE_TYPE_USGS) &&
+		   (kind == MK_COVERAGE_KIND_DATA))
+		{
+			snprintf(fname, 512, "%s/%s/float%s_13.hdr",
+			         dname, de->d_name, de->d_name);
+			if(access(fname, F_OK) != 0)
+			{
+				continue;
+			}
+		}
+
+		mk_coverage_set(self, type, lat, lon);
+	}
+
+	closedir(dir);
+}
+
+static int
+mk_coverage_import(mk_coverage_t* self, const char* fname)
+{
+	ASSERT(self);
+	ASSERT(fname);
+
+	FILE* f = fopen(fname, "r");
+	if(f == NULL)
+	{
+		// rebuild silently
+		return 0;
+	}
+
+	uint32_t hdr[2];
+	if((fread(hdr, sizeof(hdr), 1, f) != 1) ||
+	   (hdr[0] != MK_COVERAGE_MAGIC)       ||
+	   (hdr[1] != MK_COVERAGE_VERSION)     ||
+	   (fread(self, sizeof(mk_coverage_t), 1, f) != 1))
+	{
+		LOGW("invalid %s", fname);
+		fclose(f);
+		return 0;
+	}
+	fclose(f);
+
+	// check if the sources were modified
+	int type;
+	int kind;
+	for(type = 0; type < MK_COVERAGE_TYPES; ++type)
+	{
+		for(kind = 0; kind < MK_COVERAGE_KINDS; ++kind)
+		{
+			const char* dname = MK_COVERAGE_DIR[type][kind];
+			if(self->mtime[type][kind] !=
+			   mk_coverage_mtime(dname))
+			{
+				return 0;
+			}
+		}
+	}
+
+	return 1;
+}
+
+static void
+mk_coverage_export(mk_coverage_t* self, const char* path,
+                   const char* fname)
+{
+	ASSERT(self);
+	ASSERT(path);
+	ASSERT(fname);
+
+	if((mkdir(path, S_IRWXU | S_IRWXG | S_IROTH |
+	          S_IXOTH) != 0) && (errno != EEXIST))
+	{
+		LOGW("mkdir %s failed", path);
+		return;
+	}
+
+	FILE* f = fopen(fname, "w");
+	if(f == NULL)
+	{
+		LOGW("fopen %s failed", fname);
+		return;
+	}
+
+	uint32_t hdr[2] =
+	{
+		MK_COVERAGE_MAGIC,
+		MK_COVERAGE_VERSION,
+	};
+	if((fwrite(hdr, sizeof(hdr), 1, f) != 1) ||
+	   (fwrite(self, sizeof(mk_coverage_t), 1, f) != 1))
+	{
+		LOGW("fwrite %s failed", fname);
+		fclose(f);
+		unlink(fname);
+		return;
+	}
+
+	if(fclose(f) != 0)
+	{
+		LOGW("fclose %s failed", fname);
+		unlink(fname);
+	}
+}
+
+/***********************************************************
+* public                                                   *
+***********************************************************/
+
+mk_coverage_t* mk_coverage_new(const char* path)
+{
+	ASSERT(path);
+
+	mk_coverage_t* self;
+	self = (mk_coverage_t*) CALLOC(1, sizeof(mk_coverage_t));
+	if(self == NULL)
+	{
+		LOGE("CALLOC failed");
+		return NULL;
+	}
+
+	char fname[256];
+	snprintf(fname, 256, "%s/%s", path, MK_COVERAGE_FNAME);
+	if(mk_coverage_import(self, fname))
+	{
+		LOGI("imported %s", fname);
+		return self;
+	}
+
+	// scan the source directories
+	memset(self, 0, sizeof(mk_coverage_t));
+
+	int type;
+	int kind;
+	for(type = 0; type < MK_COVERAGE_TYPES; ++type)
+	{
+		for(kind = 0; kind < MK_COVERAGE_KINDS; ++kind)
+		{
+			mk_coverage_scan(self, type, kind);
+		}
+	}
+
+	// the index is rebuilt if it cannot be persisted
+	mk_coverage_export(self, path, fname);
+
+	LOGI("scanned usgs=%i, aster=%i",
+	     mk_coverage_count(self, FLT_TILE_TYPE_USGS),
+	     mk_coverage_count(self, FLT_TILE_TYPE_ASTERV3));
+
+	return self;
+}
+
+void mk_coverage_delete(mk_coverage_t** _self)
+{
+	ASSERT(_self);
+
+	mk_coverage_t* self = *_self;
+	if(self)
+	{
+		FREE(self);
+		*_self = NULL;
+	}
+}
+
+int mk_coverage_exists(mk_coverage_t* self,
+                       int type, int lat, int lon)
+{
+	ASSERT(self);
+	ASSERT((type >= 0) && (type < MK_COVERAGE_TYPES));
+
+	int idx = mk_coverage_index(lat, lon);
+	if(idx < 0)
+	{
+		return 0;
+	}
+
+	return (self->bits[type][idx/8] >> (idx%8)) & 1;
+}
+
+int mk_coverage_count(mk_coverage_t* self, int type)
+{
+	ASSERT(self);
+	ASSERT((type >= 0) && (type < MK_COVERAGE_TYPES));
+
+	int i;
+	int count = 0;
+	for(i = 0; i < MK_COVERAGE_CELLS/8; ++i)
+	{
+		count += __builtin_popcount(self->bits[type][i]);
+	}
+
+	return count;
+}
@@ -0,0 +1,61 @@
+/*
+ * Copyright (c) 2020 Jeff Boody
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#ifndef mk_coverage_H
+#define mk_coverage_H
+
+#include <stdint.h>
+
+#include "flt/flt_tile.h"
+
+#define MK_COVERAGE_TYPES 2
+#define MK_COVERAGE_CELLS (360*180)
+
+// scanned directories per source
+#define MK_COVERAGE_KIND_DATA 0
+#define MK_COVERAGE_KIND_I16  1
+#define MK_COVERAGE_KIND_ZIP  2
+#define MK_COVERAGE_KINDS     3
+
+// coverage file stored in the output directory
+#define MK_COVERAGE_FNAME "coverage.bin"
+
+// The coverage index is a global 1-degree bitmap per flt
+// source (indexed by FLT_TILE_TYPE) which replaces file
+// probes for each flt lookup. Unzipped sources, int16
+// sidecars and zip archives are scanned. The index is
+// rebuilt when the modification time of a scanned
+// directory changes.
+typedef struct
+{
+	int64_t       mtime[MK_COVERAGE_TYPES][MK_COVERAGE_KINDS];
+	unsigned char bits[MK_COVERAGE_TYPES][MK_COVERAGE_CELLS/8];
+} mk_coverage_t;
+
+mk_coverage_t* mk_coverage_new(const char* path);
+void           mk_coverage_delete(mk_coverage_t** _self);
+int            mk_coverage_exists(mk_coverage_t* self,
+                                  int type, int lat, int lon);
+int            mk_coverage_count(mk_coverage_t* self, int type);
+
+#endif
@@ -0,0 +1,267 @@
+/*
+ * Copyright (c) 2020 Jeff Boody
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#include <stdlib.h>
+
+#define LOG_TAG "maketerrain"
+#include "libcc/cc_log.h"
+#include "libcc/cc_memory.h"
+#include "mk_index.h"
+
+#define MK_INDEX_SIZE 1024
+
+/***********************************************************
+* private                                                  *
+***********************************************************/
+
+static uint64_t
+mk_index_pack(int kind, int a, int b, int c)
+{
+	ASSERT(kind);
+
+	return (((uint64_t) kind) << 60)                 |
+	       (((uint64_t) (a & 0xFF)) << 52)           |
+	       (((uint64_t) (b & 0x3FFFFFF)) << 26)      |
+	       ((uint64_t) (c & 0x3FFFFFF));
+}
+
+static uint32_t mk_index_hash(uint64_t key)
+{
+	// 64-bit finalizer from MurmurHash3
+	key ^= key >> 33;
+	key *= 0xFF51AFD7ED558CCDULL;
+	key ^= key >> 33;
+	key *= 0xC4CEB9FE1A85EC53ULL;
+	key ^= key >> 33;
+	return (uint32_t) key;
+}
+
+static int mk_index_resize(mk_index_t* self, int size)
+{
+	ASSERT(self);
+
+	mk_indexEntry_t* entries;
+	entries = (mk_indexEntry_t*)
+	          CALLOC(size, sizeof(mk_indexEntry_t));
+	if(entries == NULL)
+	{
+		LOGE("CALLOC failed");
+		return 0;
+	}
+
+	// rehash entries
+	int i;
+	int mask = size - 1;
+	for(i = 0; i < self->size; ++i)
+	{
+		mk_indexEntry_t* e = &self->entries[i];
+		if(e->key == 0)
+		{
+			continue;
+		}
+
+		int idx = mk_index_hash(e->key) & mask;
+		while(entries[idx].key)
+		{
+			idx = (idx + 1) & mask;
+		}
+		entries[idx] = *e;
+	}
+
+	FREE(self->entries);
+	self->entries = entries;
+	self->size    = size;
+
+	return 1;
+}
+
+/***********************************************************
+* public                                                   *
+***********************************************************/
+
+mk_index_t* mk_index_new(void)
+{
+	mk_index_t* self;
+	self = (mk_index_t*) CALLOC(1, sizeof(mk_index_t));
+	if(self == NULL)
+	{
+		LOGE("CALLOC failed");
+		return NULL;
+	}
+
+	if(mk_index_resize(self, MK_INDEX_SIZE) == 0)
+	{
+		goto fail_resize;
+	}
+
+	// success
+	return self;
+
+	// failure
+	fail_resize:
+		FREE(self);
+	return NULL;
+}
+
+void mk_index_delete(mk_index_t** _self)
+{
+	ASSERT(_self);
+
+	mk_index_t* self = *_self;
+	if(self)
+	{
+		FREE(self->entries);
+		FREE(self);
+		*_self = NULL;
+	}
+}
+
+uint64_t mk_index_keyTerrain(int zoom, int x, int y)
+{
+	return mk_index_pack(MK_INDEX_KIND_TERRAIN, zoom, x, y);
+}
+
+uint64_t mk_index_keyFlt(int type, int lat, int lon)
+{
+	return mk_index_pack(MK_INDEX_KIND_FLT, type, lon, lat);
+}
+
+void* mk_index_find(mk_index_t* self, uint64_t key)
+{
+	ASSERT(self);
+	ASSERT(key);
+
+	int mask = self->size - 1;
+	int idx  = mk_index_hash(key) & mask;
+	while(self->entries[idx].key)
+	{
+		if(self->entries[idx].key == key)
+		{
+			return self->entries[idx].val;
+		}
+		idx = (idx + 1) & mask;
+	}
+
+	return NULL;
+}
+
+int mk_index_add(mk_index_t* self, uint64_t key, void* val)
+{
+	ASSERT(self);
+	ASSERT(key);
+	ASSERT(val);
+
+	// maintain a load factor below 0.5
+	if(2*(self->count + 1) > self->size)
+	{
+		if(mk_index_resize(self, 2*self->size) == 0)
+		{
+			return 0;
+		}
+	}
+
+	int mask = self->size - 1;
+	int idx  = mk_index_hash(key) & mask;
+	while(self->entries[idx].key)
+	{
+		if(self->entries[idx].key == key)
+		{
+			self->entries[idx].val = val;
+			return 1;
+		}
+		idx = (idx + 1) & mask;
+	}
+
+	self->entries[idx].key = key;
+	self->entries[idx].val = val;
+	++self->count;
+
+	return 1;
+}
+
+void* mk_index_remove(mk_index_t* self, uint64_t key)
+{
+	ASSERT(self);
+	ASSERT(key);
+
+	int mask = self->size - 1;
+	int idx  = mk_index_hash(key) & mask;
+	while(self->entries[idx].key != key)
+	{
+		if(self->entries[idx].key == 0)
+		{
+			return NULL;
+		}
+		idx = (idx + 1) & mask;
+	}
+
+	void* val = self->entries[idx].val;
+
+	// shift back entries in the cluster which would
+	// otherwise be unreachable from their home slot
+	int hole = idx;
+	int next = (idx + 1) & mask;
+	while(self->entries[next].key)
+	{
+		int home = mk_index_hash(self->entries[next].key) & mask;
+		if(((next - home) & mask) >= ((next - hole) & mask))
+		{
+			self->entries[hole] = self->entries[next];
+			hole = next;
+		}
+		next = (next + 1) & mask;
+	}
+	self->entries[hole].key = 0;
+	self->entries[hole].val = NULL;
+	--self->count;
+
+	return val;
+}
+
+int mk_index_next(mk_index_t* self, int* _idx,
+                  uint64_t* _key, void** _val)
+{
+	ASSERT(self);
+	ASSERT(_idx);
+
+	int idx;
+	for(idx = *_idx; idx < self->size; ++idx)
+	{
+		if(self->entries[idx].key)
+		{
+			if(_key)
+			{
+				*_key = self->entries[idx].key;
+			}
+			if(_val)
+			{
+				*_val = self->entries[idx].val;
+			}
+			*_idx = idx + 1;
+			return 1;
+		}
+	}
+
+	*_idx = idx;
+	return 0;
+}
@@ -0,0 +1,60 @@
+/*
+ * Copyright (c) 2020 Jeff Boody
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#ifndef mk_index_H
+#define mk_index_H
+
+#include <stdint.h>
+
+// packed object keys
+// kind:4 | zoom/type:8 | x/lon:26 | y/lat:26
+#define MK_INDEX_KIND_TERRAIN 1
+#define MK_INDEX_KIND_FLT     2
+
+typedef struct
+{
+	uint64_t key;
+	void*    val;
+} mk_indexEntry_t;
+
+// open-addressing hash table with linear probing
+// key 0 marks an empty entry and values must not be NULL
+typedef struct
+{
+	int count;
+	int size;
+	mk_indexEntry_t* entries;
+} mk_index_t;
+
+mk_index_t* mk_index_new(void);
+void        mk_index_delete(mk_index_t** _self);
+uint64_t    mk_index_keyTerrain(int zoom, int x, int y);
+uint64_t    mk_index_keyFlt(int type, int lat, int lon);
+void*       mk_index_find(mk_index_t* self, uint64_t key);
+int         mk_index_add(mk_index_t* self, uint64_t key,
+                         void* val);
+void*       mk_index_remove(mk_index_t* self, uint64_t key);
+int         mk_index_next(mk_index_t* self, int* _idx,
+                          uint64_t* _key, void** _val);
+
+#endif
@@ -0,0 +1,139 @@
+/*
+ * Copyright (c) 2020 Jeff Boody
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#define LOG_TAG "maketerrain"
+#include "libcc/cc_log.h"
+#include "mk_mosaic.h"
+
+/***********************************************************
+* private                                                  *
+***********************************************************/
+
+static void
+mk_mosaic_range(const int* valid, int* _i0, int* _i1)
+{
+	ASSERT(valid);
+	ASSERT(_i0);
+	ASSERT(_i1);
+
+	// the valid samples are contiguous since the samples
+	// are linear in lat/lon
+	int i0 = 0;
+	int i1 = TERRAIN_SAMPLES_TOTAL;
+	while((i0 < i1) && (valid[i0] == 0))
+	{
+		++i0;
+	}
+	while((i1 > i0) && (valid[i1 - 1] == 0))
+	{
+		--i1;
+	}
+
+	*_i0 = i0;
+	*_i1 = i1;
+}
+
+/***********************************************************
+* public                                                   *
+***********************************************************/
+
+int mk_mosaic_init(mk_mosaic_t* self,
+                   terrain_tile_t* tile,
+                   int count, flt_tile_t** flt)
+{
+	ASSERT(self);
+	ASSERT(tile);
+	ASSERT(count <= MK_MOSAIC_SOURCES);
+	ASSERT(flt || (count == 0));
+
+	const int S = TERRAIN_SAMPLES_TOTAL;
+
+	memset(self->owner, -1, sizeof(self->owner));
+
+	// assign owners in reverse priority such that the
+	// first source which covers a sample wins
+	int i;
+	int covered = 0;
+	self->count = 0;
+	for(i = count - 1; i >= 0; --i)
+	{
+		mk_resample_t* rs = &self->rs[i];
+		if(mk_resample_init(rs, tile, flt[i]) == 0)
+		{
+			continue;
+		}
+
+		int m;
+		int m0;
+		int m1;
+		int n0;
+		int n1;
+		mk_mosaic_range(rs->row_valid, &m0, &m1);
+		mk_mosaic_range(rs->col_valid, &n0, &n1);
+		for(m = m0; m < m1; ++m)
+		{
+			memset(&self->owner[m*S + n0], i, n1 - n0);
+		}
+		covered = 1;
+	}
+	self->count = count;
+
+	return covered;
+}
+
+void mk_mosaic_paint(mk_mosaic_t* self,
+                     terrain_tile_t* tile)
+{
+	ASSERT(self);
+	ASSERT(tile);
+
+	const int S = TERRAIN_SAMPLES_TOTAL;
+
+	// interpolate each run of samples with the same owner
+	int m;
+	for(m = 0; m < S; ++m)
+	{
+		const signed char* owner = &self->owner[m*S];
+
+		int n0 = 0;
+		while(n0 < S)
+		{
+			int i  = owner[n0];
+			int n1 = n0 + 1;
+			while((n1 < S) && (owner[n1] == i))
+			{
+				++n1;
+			}
+
+			if(i >= 0)
+			{
+				mk_resample_paintRow(&self->rs[i], tile,
+				                     m, n0, n1);
+			}
+			n0 = n1;
+		}
+	}
+}
@@ -0,0 +1,53 @@
+/*
+ * Copyright (c) 2020 Jeff Boody
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#ifndef mk_mosaic_H
+#define mk_mosaic_H
+
+#include "mk_resample.h"
+
+// maximum sources for the 3x3 USGS and ASTERv3
+// neighborhoods
+#define MK_MOSAIC_SOURCES 18
+
+// The mosaic combines the flt neighborhood of a tile into
+// one virtual raster. Sources are given in priority order
+// and the owner table resolves the first source which
+// covers each sample (or -1) such that every sample is
+// interpolated exactly once from the winning source.
+typedef struct
+{
+	int           count;
+	mk_resample_t rs[MK_MOSAIC_SOURCES];
+
+	signed char owner[TERRAIN_SAMPLES_TOTAL*
+	                  TERRAIN_SAMPLES_TOTAL];
+} mk_mosaic_t;
+
+int  mk_mosaic_init(mk_mosaic_t* self,
+                    terrain_tile_t* tile,
+                    int count, flt_tile_t** flt);
+void mk_mosaic_paint(mk_mosaic_t* self,
+                     terrain_tile_t* tile);
+
+#endif
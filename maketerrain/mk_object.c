@@ -23,6 +23,12 @@
 
 #include <stdlib.h>
 
+#if defined(__AVX2__)
+	#include <immintrin.h>
+#elif defined(__SSE2__)
+	#include <emmintrin.h>
+#endif
+
 #define LOG_TAG "maketerrain"
 #include "libcc/cc_log.h"
 #include "libcc/cc_memory.h"
@@ -34,20 +40,113 @@
 
 extern int terrain_tile_export(terrain_tile_t* self,
                                const char* base);
-extern void terrain_tile_set(terrain_tile_t* self,
-                             int m, int n,
-                             short h);
 extern void terrain_tile_adjustMinMax(terrain_tile_t* self,
                                       short min,
                                       short max);
 extern void terrain_tile_exists(terrain_tile_t* self,
                                 int flags);
 
+/***********************************************************
+* private                                                  *
+***********************************************************/
+
+static void
+mk_object_decimate(short* dst, const short* src, int count)
+{
+	ASSERT(dst);
+	ASSERT(src);
+
+	// dst[i] = src[2*i]
+	// reads are limited to src[0..2*count-2]
+	int i = 0;
+
+	#if defined(__AVX2__)
+	for(; i + 17 <= count; i += 16)
+	{
+		__m256i a = _mm256_loadu_si256((const __m256i*)
+		                               &src[2*i]);
+		__m256i b = _mm256_loadu_si256((const __m256i*)
+		                               &src[2*i + 16]);
+
+		// sign extend the even samples and pack
+		a = _mm256_srai_epi32(_mm256_slli_epi32(a, 16), 16);
+		b = _mm256_srai_epi32(_mm256_slli_epi32(b, 16), 16);
+		__m256i c = _mm256_packs_epi32(a, b);
+
+		// packs interleaves the 128-bit lanes
+		c = _mm256_permute4x64_epi64(c, 0xD8);
+		_mm256_storeu_si256((__m256i*) &dst[i], c);
+	}
+	#endif
+
+	#if defined(__SSE2__)
+	for(; i + 9 <= count; i += 8)
+	{
+		__m128i a = _mm_loadu_si128((const __m128i*)
+		                            &src[2*i]);
+		__m128i b = _mm_loadu_si128((const __m128i*)
+		                            &src[2*i + 8]);
+
+		// sign extend the even samples and pack
+		a = _mm_srai_epi32(_mm_slli_epi32(a, 16), 16);
+		b = _mm_srai_epi32(_mm_slli_epi32(b, 16), 16);
+		_mm_storeu_si128((__m128i*) &dst[i],
+		                 _mm_packs_epi32(a, b));
+	}
+	#endif
+
+	for(; i < count; ++i)
+	{
+		dst[i] = src[2*i];
+	}
+}
+
+static void
+mk_object_sampleRow(terrain_tile_t* tile,
+                    mk_object_t** next, int m, int mm)
+{
+	ASSERT(tile);
+	ASSERT(next);
+
+	// next contains the 4 children in the row and
+	// mm is the child row for the parent row m
+	const int S   = TERRAIN_SAMPLES_TOTAL;
+	const int B   = TERRAIN_SAMPLES_BORDER;
+	short*    dst = &tile->data[(m + B)*S];
+
+	// left border sample
+	if(next[0])
+	{
+		short* src = &next[0]->terrain->data[(mm + B)*S];
+		dst[-1 + B] = src[TERRAIN_SAMPLES_TILE - 3 + B];
+	}
+
+	// center samples
+	if(next[1])
+	{
+		short* src = &next[1]->terrain->data[(mm + B)*S];
+		mk_object_decimate(&dst[B], &src[B], 129);
+	}
+	if(next[2])
+	{
+		short* src = &next[2]->terrain->data[(mm + B)*S];
+		mk_object_decimate(&dst[128 + B], &src[B], 129);
+	}
+
+	// right border sample
+	if(next[3])
+	{
+		short* src = &next[3]->terrain->data[(mm + B)*S];
+		dst[257 + B] = src[2 + B];
+	}
+}
+
 /***********************************************************
 * public                                                   *
 ***********************************************************/
 
-mk_object_t* mk_object_newTerrain(int x, int y, int zoom)
+mk_object_t* mk_object_newTerrain(terrain_pool_t* pool,
+                                  int x, int y, int zoom)
 {
 	mk_object_t* self;
 	self = (mk_object_t*)
@@ -59,8 +158,16 @@ mk_object_t* mk_object_newTerrain(int x, int y, int zoom)
 	}
 
 	self->type = MK_OBJECT_TYPE_TERRAIN;
+	self->pool = pool;
 
-	self->terrain = terrain_tile_new(x, y, zoom);
+	if(pool)
+	{
+		self->terrain = terrain_pool_newTile(pool, x, y, zoom);
+	}
+	else
+	{
+		self->terrain = terrain_tile_new(x, y, zoom);
+	}
 	if(self->terrain == NULL)
 	{
 		goto fail_terrain;
@@ -76,7 +183,8 @@ mk_object_t* mk_object_newTerrain(int x, int y, int zoom)
 }
 
 mk_object_t*
-mk_object_importTerrain(const char* base,
+mk_object_importTerrain(terrain_pool_t* pool,
+                        const char* base,
                         int x, int y, int zoom)
 {
 	mk_object_t* self;
@@ -89,24 +197,77 @@ mk_object_importTerrain(const char* base,
 	}
 
 	self->type = MK_OBJECT_TYPE_TERRAIN;
+	self->pool = pool;
+
+	if(pool)
+	{
+		self->terrain = terrain_pool_importTile(pool, base,
+		                                        x, y, zoom);
+	}
+	else
+	{
+		self->terrain = terrain_tile_import(base, x, y, zoom);
+	}
+	if(self->terrain == NULL)
+	{
+		goto fail_terrain;
+	}
+
+	// success
+	return self;
+
+	// failure
+	fail_terrain:
+		FREE(self);
+	return NULL;
+}
+
+mk_object_t*
+mk_object_importPack(terrain_pool_t* pool,
+                     terrain_exporter_t* exporter,
+                     int x, int y, int zoom)
+{
+	ASSERT(pool);
+	ASSERT(exporter);
+
+	mk_object_t* self;
+	self = (mk_object_t*)
+	       CALLOC(1, sizeof(mk_object_t));
+	if(self == NULL)
+	{
+		LOGE("CALLOC failed");
+		return NULL;
+	}
+
+	self->type = MK_OBJECT_TYPE_TERRAIN;
+	self->pool = pool;
 
-	self->terrain = terrain_tile_import(base, x, y, zoom);
+	self->terrain = terrain_pool_newTile(pool, x, y, zoom);
 	if(self->terrain == NULL)
 	{
 		goto fail_terrain;
 	}
 
+	// tiles are sparse so a missing tile is not an error
+	if(terrain_exporter_read(exporter, x, y, zoom,
+	                         self->terrain) == 0)
+	{
+		goto fail_read;
+	}
+
 	// success
 	return self;
 
 	// failure
+	fail_read:
+		terrain_pool_put(pool, &self->terrain);
 	fail_terrain:
 		FREE(self);
 	return NULL;
 }
 
 mk_object_t*
-mk_object_importFlt(int type, int lat, int lon)
+mk_object_importFlt(int type, int lat, int lon, int lazy)
 {
 	mk_object_t* self;
 	self = (mk_object_t*)
@@ -119,7 +280,14 @@ mk_object_importFlt(int type, int lat, int lon)
 
 	self->type = MK_OBJECT_TYPE_FLT;
 
-	self->flt = flt_tile_import(type, lat, lon);
+	if(lazy)
+	{
+		self->flt = flt_tile_importLazy(type, lat, lon);
+	}
+	else
+	{
+		self->flt = flt_tile_import(type, lat, lon);
+	}
 	if(self->flt == NULL)
 	{
 		goto fail_flt;
@@ -143,7 +311,14 @@ void mk_object_delete(mk_object_t** _self)
 	{
 		if(self->type == MK_OBJECT_TYPE_TERRAIN)
 		{
-			terrain_tile_delete(&self->terrain);
+			if(self->pool)
+			{
+				terrain_pool_put(self->pool, &self->terrain);
+			}
+			else
+			{
+				terrain_tile_delete(&self->terrain);
+			}
 		}
 		else
 		{
@@ -159,22 +334,24 @@ void mk_object_incref(mk_object_t* self)
 {
 	ASSERT(self);
 
-	++self->refcount;
+	__atomic_add_fetch(&self->refcount, 1, __ATOMIC_SEQ_CST);
 }
 
 int mk_object_decref(mk_object_t* self)
 {
 	ASSERT(self);
 
-	--self->refcount;
-	return (self->refcount == 0) ? 1 : 0;
+	int refcount;
+	refcount = __atomic_sub_fetch(&self->refcount, 1,
+	                              __ATOMIC_SEQ_CST);
+	return (refcount == 0) ? 1 : 0;
 }
 
 int mk_object_refcount(mk_object_t* self)
 {
 	ASSERT(self);
 
-	return self->refcount;
+	return __atomic_load_n(&self->refcount, __ATOMIC_SEQ_CST);
 }
 
 int mk_object_exportTerrain(mk_object_t* self,
@@ -187,374 +364,101 @@ int mk_object_exportTerrain(mk_object_t* self,
 	return terrain_tile_export(self->terrain, base);
 }
 
-void mk_object_key(mk_object_t* self, char* key)
+uint64_t mk_object_key(mk_object_t* self)
 {
 	ASSERT(self);
-	ASSERT(key);
 
 	if(self->type == MK_OBJECT_TYPE_TERRAIN)
 	{
-		snprintf(key, 256, "T/%i/%i/%i",
-		         self->terrain->zoom,
-		         self->terrain->x,
-		         self->terrain->y);
+		return mk_index_keyTerrain(self->terrain->zoom,
+		                           self->terrain->x,
+		                           self->terrain->y);
 	}
-	else
-	{
-		snprintf(key, 256, "F/%i/%i/%i", self->flt->type,
-		         self->flt->lat, self->flt->lon);
-	}
-}
-
-void mk_object_sample00(mk_object_t* self, mk_object_t* next)
-{
-	ASSERT(self);
 
-	if(next == NULL)
-	{
-		return;
-	}
-
-	// top-left border sample
-	short h = terrain_tile_get(next->terrain,
-	                           TERRAIN_SAMPLES_TILE - 3,
-	                           TERRAIN_SAMPLES_TILE - 3);
-	terrain_tile_set(self->terrain, -1, -1, h);
+	return mk_index_keyFlt(self->flt->type,
+	                       self->flt->lat, self->flt->lon);
 }
 
-void mk_object_sample01(mk_object_t* self, mk_object_t* next)
+size_t mk_object_size(mk_object_t* self)
 {
 	ASSERT(self);
 
-	if(next == NULL)
-	{
-		return;
-	}
-
-	// top border samples
-	int nn;
-	int n = 0;
-	for(nn = 0; nn < TERRAIN_SAMPLES_TILE; nn += 2)
-	{
-		short h;
-		h = terrain_tile_get(next->terrain,
-		                     TERRAIN_SAMPLES_TILE - 3,
-		                     nn);
-		terrain_tile_set(self->terrain, -1, n++, h);
-	}
-}
-
-void mk_object_sample02(mk_object_t* self, mk_object_t* next)
-{
-	ASSERT(self);
-
-	if(next == NULL)
-	{
-		return;
-	}
-
-	// top border samples
-	int nn;
-	int n = 128;
-	for(nn = 0; nn < TERRAIN_SAMPLES_TILE; nn += 2)
+	size_t size = sizeof(mk_object_t);
+	if(self->type == MK_OBJECT_TYPE_TERRAIN)
 	{
-		short h;
-		h = terrain_tile_get(next->terrain,
-		                     TERRAIN_SAMPLES_TILE - 3,
-		                     nn);
-		terrain_tile_set(self->terrain, -1, n++, h);
+		size += sizeof(terrain_tile_t);
 	}
-}
-
-void mk_object_sample03(mk_object_t* self, mk_object_t* next)
-{
-	ASSERT(self);
-
-	if(next == NULL)
+	else
 	{
-		return;
+		// lazy flt objects are charged for the entire height
+		// array since bands are converted after insert
+		flt_tile_t* flt = self->flt;
+		size += sizeof(flt_tile_t) +
+		        ((size_t) flt->nrows)*flt->ncols*sizeof(short);
 	}
 
-	// top-right border sample
-	short h;
-	h = terrain_tile_get(next->terrain,
-	                     TERRAIN_SAMPLES_TILE - 3,
-	                     2);
-	terrain_tile_set(self->terrain, -1, 257, h);
+	return size;
 }
 
-void mk_object_sample10(mk_object_t* self, mk_object_t* next)
+void mk_object_sample(mk_object_t* self, mk_object_t** next)
 {
 	ASSERT(self);
+	ASSERT(next);
 
-	if(next == NULL)
-	{
-		return;
-	}
+	terrain_tile_t* tile = self->terrain;
 
-	// left border samples
-	int mm;
-	int m = 0;
-	for(mm = 0; mm < TERRAIN_SAMPLES_TILE; mm += 2)
+	// update min/max and flags from the center children
+	// note: the min/max are taken from the next LOD rather
+	// than the sampled heights
+	int i;
+	int flags[4] =
 	{
-		short h;
-		h = terrain_tile_get(next->terrain, mm,
-		                     TERRAIN_SAMPLES_TILE - 3);
-		terrain_tile_set(self->terrain, m++, -1, h);
-	}
-}
-
-void mk_object_sample11(mk_object_t* self, mk_object_t* next)
-{
-	ASSERT(self);
-
-	if(next == NULL)
+		TERRAIN_NEXT_TL, TERRAIN_NEXT_TR,
+		TERRAIN_NEXT_BL, TERRAIN_NEXT_BR,
+	};
+	mk_object_t* center[4] =
 	{
-		terrain_tile_adjustMinMax(self->terrain, 0, 0);
-		return;
-	}
-
-	short min = terrain_tile_min(next->terrain);
-	short max = terrain_tile_max(next->terrain);
-	terrain_tile_adjustMinMax(self->terrain, min, max);
-	terrain_tile_exists(self->terrain, TERRAIN_NEXT_TL);
-
-	// center border samples
-	int mm;
-	int nn;
-	int m = 0;
-	int n = 0;
-	for(mm = 0; mm < TERRAIN_SAMPLES_TILE; mm += 2)
+		next[5], next[6], next[9], next[10],
+	};
+	for(i = 0; i < 4; ++i)
 	{
-		for(nn = 0; nn < TERRAIN_SAMPLES_TILE; nn += 2)
+		if(center[i])
 		{
-			short h = terrain_tile_get(next->terrain, mm, nn);
-			terrain_tile_set(self->terrain, m, n++, h);
+			short min = terrain_tile_min(center[i]->terrain);
+			short max = terrain_tile_max(center[i]->terrain);
+			terrain_tile_adjustMinMax(tile, min, max);
+			terrain_tile_exists(tile, flags[i]);
 		}
-		++m;
-		n = 0;
-	}
-}
-
-void mk_object_sample12(mk_object_t* self, mk_object_t* next)
-{
-	ASSERT(self);
-
-	if(next == NULL)
-	{
-		terrain_tile_adjustMinMax(self->terrain, 0, 0);
-		return;
-	}
-
-	short min = terrain_tile_min(next->terrain);
-	short max = terrain_tile_max(next->terrain);
-	terrain_tile_adjustMinMax(self->terrain, min, max);
-	terrain_tile_exists(self->terrain, TERRAIN_NEXT_TR);
-
-	// center border samples
-	int mm;
-	int nn;
-	int m = 0;
-	int n = 128;
-	for(mm = 0; mm < TERRAIN_SAMPLES_TILE; mm += 2)
-	{
-		for(nn = 0; nn < TERRAIN_SAMPLES_TILE; nn += 2)
+		else
 		{
-			short h = terrain_tile_get(next->terrain, mm, nn);
-			terrain_tile_set(self->terrain, m, n++, h);
+			terrain_tile_adjustMinMax(tile, 0, 0);
 		}
-		++m;
-		n = 128;
-	}
-}
-
-void mk_object_sample13(mk_object_t* self, mk_object_t* next)
-{
-	ASSERT(self);
-
-	if(next == NULL)
-	{
-		return;
-	}
-
-	// right border samples
-	int mm;
-	int m = 0;
-	for(mm = 0; mm < TERRAIN_SAMPLES_TILE; mm += 2)
-	{
-		short h = terrain_tile_get(next->terrain, mm, 2);
-		terrain_tile_set(self->terrain, m++, 257, h);
 	}
-}
 
-void mk_object_sample20(mk_object_t* self, mk_object_t* next)
-{
-	ASSERT(self);
+	// sample the next LOD one parent row at a time
+	// the row/column 128 samples are shared by adjacent
+	// children which are applied in the order 00,01,...,33
+	// such that the last child wins
 
-	if(next == NULL)
-	{
-		return;
-	}
-
-	// left border samples
-	int mm;
-	int m = 128;
-	for(mm = 0; mm < TERRAIN_SAMPLES_TILE; mm += 2)
-	{
-		short h;
-		h = terrain_tile_get(next->terrain, mm,
-		                     TERRAIN_SAMPLES_TILE - 3);
-		terrain_tile_set(self->terrain, m++, -1, h);
-	}
-}
-
-void mk_object_sample21(mk_object_t* self, mk_object_t* next)
-{
-	ASSERT(self);
-
-	if(next == NULL)
-	{
-		terrain_tile_adjustMinMax(self->terrain, 0, 0);
-		return;
-	}
+	// top border samples
+	mk_object_sampleRow(tile, &next[0], -1,
+	                    TERRAIN_SAMPLES_TILE - 3);
 
-	short min = terrain_tile_min(next->terrain);
-	short max = terrain_tile_max(next->terrain);
-	terrain_tile_adjustMinMax(self->terrain, min, max);
-	terrain_tile_exists(self->terrain, TERRAIN_NEXT_BL);
-
-	// center border samples
-	int mm;
-	int nn;
-	int m = 128;
-	int n = 0;
-	for(mm = 0; mm < TERRAIN_SAMPLES_TILE; mm += 2)
+	// center samples
+	int m;
+	for(m = 0; m < TERRAIN_SAMPLES_TILE; ++m)
 	{
-		for(nn = 0; nn < TERRAIN_SAMPLES_TILE; nn += 2)
+		if(m <= 128)
 		{
-			short h = terrain_tile_get(next->terrain, mm, nn);
-			terrain_tile_set(self->terrain, m, n++, h);
+			mk_object_sampleRow(tile, &next[4], m, 2*m);
 		}
-		++m;
-		n = 0;
-	}
-}
-
-void mk_object_sample22(mk_object_t* self, mk_object_t* next)
-{
-	ASSERT(self);
-
-	if(next == NULL)
-	{
-		terrain_tile_adjustMinMax(self->terrain, 0, 0);
-		return;
-	}
-
-	short min = terrain_tile_min(next->terrain);
-	short max = terrain_tile_max(next->terrain);
-	terrain_tile_adjustMinMax(self->terrain, min, max);
-	terrain_tile_exists(self->terrain, TERRAIN_NEXT_BR);
-
-	// center border samples
-	int mm;
-	int nn;
-	int m = 128;
-	int n = 128;
-	for(mm = 0; mm < TERRAIN_SAMPLES_TILE; mm += 2)
-	{
-		for(nn = 0; nn < TERRAIN_SAMPLES_TILE; nn += 2)
+		if(m >= 128)
 		{
-			short h = terrain_tile_get(next->terrain, mm, nn);
-			terrain_tile_set(self->terrain, m, n++, h);
+			mk_object_sampleRow(tile, &next[8], m,
+			                    2*(m - 128));
 		}
-		++m;
-		n = 128;
-	}
-}
-
-void mk_object_sample23(mk_object_t* self, mk_object_t* next)
-{
-	ASSERT(self);
-
-	if(next == NULL)
-	{
-		return;
-	}
-
-	// right border samples
-	int mm;
-	int m = 128;
-	for(mm = 0; mm < TERRAIN_SAMPLES_TILE; mm += 2)
-	{
-		short h = terrain_tile_get(next->terrain, mm, 2);
-		terrain_tile_set(self->terrain, m++, 257, h);
-	}
-}
-
-void mk_object_sample30(mk_object_t* self, mk_object_t* next)
-{
-	ASSERT(self);
-
-	if(next == NULL)
-	{
-		return;
-	}
-
-	// bottom-left border sample
-	short h;
-	h = terrain_tile_get(next->terrain, 2,
-	                     TERRAIN_SAMPLES_TILE - 3);
-	terrain_tile_set(self->terrain, 257, -1, h);
-}
-
-void mk_object_sample31(mk_object_t* self, mk_object_t* next)
-{
-	ASSERT(self);
-
-	if(next == NULL)
-	{
-		return;
 	}
 
 	// bottom border samples
-	int nn;
-	int n = 0;
-	for(nn = 0; nn < TERRAIN_SAMPLES_TILE; nn += 2)
-	{
-		short h = terrain_tile_get(next->terrain, 2, nn);
-		terrain_tile_set(self->terrain, 257, n++, h);
-	}
-}
-
-void mk_object_sample32(mk_object_t* self, mk_object_t* next)
-{
-	ASSERT(self);
-
-	if(next == NULL)
-	{
-		return;
-	}
-
-	// bottom border samples
-	int nn;
-	int n = 128;
-	for(nn = 0; nn < TERRAIN_SAMPLES_TILE; nn += 2)
-	{
-		short h = terrain_tile_get(next->terrain, 2, nn);
-		terrain_tile_set(self->terrain, 257, n++, h);
-	}
-}
-
-void mk_object_sample33(mk_object_t* self, mk_object_t* next)
-{
-	ASSERT(self);
-
-	if(next == NULL)
-	{
-		return;
-	}
-
-	// bottom-right border sample
-	short h = terrain_tile_get(next->terrain, 2, 2);
-	terrain_tile_set(self->terrain, 257, 257, h);
+	mk_object_sampleRow(tile, &next[12], 257, 2);
 }
@@ -24,15 +24,22 @@
 #ifndef mk_object_H
 #define mk_object_H
 
+#include "terrain/terrain_exporter.h"
+#include "terrain/terrain_pool.h"
 #include "terrain/terrain_tile.h"
 #include "flt/flt_tile.h"
+#include "mk_index.h"
 
 #define MK_OBJECT_TYPE_TERRAIN 0
 #define MK_OBJECT_TYPE_FLT     1
+#define MK_OBJECT_TYPE_COUNT   2
 
 typedef struct
 {
 	int type;
+
+	// refcount is updated atomically since objects are
+	// shared between the maketerrain threads
 	int refcount;
 
 	union
@@ -40,35 +47,31 @@ typedef struct
 		terrain_tile_t* terrain;
 		flt_tile_t*     flt;
 	};
+
+	// optional pool which owns the terrain tile
+	terrain_pool_t* pool;
 } mk_object_t;
 
-mk_object_t* mk_object_newTerrain(int x, int y, int zoom);
-mk_object_t* mk_object_importTerrain(const char* base,
+mk_object_t* mk_object_newTerrain(terrain_pool_t* pool,
+                                  int x, int y, int zoom);
+mk_object_t* mk_object_importTerrain(terrain_pool_t* pool,
+                                     const char* base,
                                      int x, int y, int zoom);
+mk_object_t* mk_object_importPack(terrain_pool_t* pool,
+                                  terrain_exporter_t* exporter,
+                                  int x, int y, int zoom);
 mk_object_t* mk_object_importFlt(int type,
-                                 int lat, int lon);
+                                 int lat, int lon,
+                                 int lazy);
 void         mk_object_delete(mk_object_t** _self);
 void         mk_object_incref(mk_object_t* self);
 int          mk_object_decref(mk_object_t* self);
 int          mk_object_refcount(mk_object_t* self);
 int          mk_object_exportTerrain(mk_object_t* self,
                                      const char* base);
-void         mk_object_key(mk_object_t* self, char* key);
-void         mk_object_sample00(mk_object_t* self, mk_object_t* next);
-void         mk_object_sample01(mk_object_t* self, mk_object_t* next);
-void         mk_object_sample02(mk_object_t* self, mk_object_t* next);
-void         mk_object_sample03(mk_object_t* self, mk_object_t* next);
-void         mk_object_sample10(mk_object_t* self, mk_object_t* next);
-void         mk_object_sample11(mk_object_t* self, mk_object_t* next);
-void         mk_object_sample12(mk_object_t* self, mk_object_t* next);
-void         mk_object_sample13(mk_object_t* self, mk_object_t* next);
-void         mk_object_sample20(mk_object_t* self, mk_object_t* next);
-void         mk_object_sample21(mk_object_t* self, mk_object_t* next);
-void         mk_object_sample22(mk_object_t* self, mk_object_t* next);
-void         mk_object_sample23(mk_object_t* self, mk_object_t* next);
-void         mk_object_sample30(mk_object_t* self, mk_object_t* next);
-void         mk_object_sample31(mk_object_t* self, mk_object_t* next);
-void         mk_object_sample32(mk_object_t* self, mk_object_t* next);
-void         mk_object_sample33(mk_object_t* self, mk_object_t* next);
+uint64_t     mk_object_key(mk_object_t* self);
+size_t       mk_object_size(mk_object_t* self);
+void         mk_object_sample(mk_object_t* self,
+                              mk_object_t** next);
 
 #endif
@@ -0,0 +1,267 @@
+/*
+ * Copyright (c) 2020 Jeff Boody
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#include <stdlib.h>
+
+#define LOG_TAG "maketerrain"
+#include "libcc/cc_log.h"
+#include "libcc/cc_memory.h"
+#include "mk_pool.h"
+
+typedef struct
+{
+	mk_pool_t* pool;
+	int        tid;
+} mk_poolArg_t;
+
+/***********************************************************
+* private                                                  *
+***********************************************************/
+
+static int mk_pool_pop(mk_pool_t* self, int tid, int* task)
+{
+	ASSERT(self);
+	ASSERT(task);
+
+	mk_deque_t* deque = &self->deques[tid];
+
+	int ret = 0;
+	pthread_mutex_lock(&deque->mutex);
+	if(deque->head < deque->tail)
+	{
+		*task = deque->head;
+		++deque->head;
+		ret = 1;
+	}
+	pthread_mutex_unlock(&deque->mutex);
+
+	return ret;
+}
+
+static int mk_pool_steal(mk_pool_t* self, int tid)
+{
+	ASSERT(self);
+
+	// steal the upper half of the first non-empty
+	// queue which preserves locality for both threads
+	int i;
+	for(i = 1; i < self->nth; ++i)
+	{
+		mk_deque_t* victim;
+		victim = &self->deques[(tid + i)%self->nth];
+
+		int head = 0;
+		int tail = 0;
+		pthread_mutex_lock(&victim->mutex);
+		int count = victim->tail - victim->head;
+		if(count > 0)
+		{
+			tail = victim->tail;
+			head = tail - (count + 1)/2;
+			victim->tail = head;
+		}
+		pthread_mutex_unlock(&victim->mutex);
+
+		if(head < tail)
+		{
+			mk_deque_t* deque = &self->deques[tid];
+			pthread_mutex_lock(&deque->mutex);
+			deque->head = head;
+			deque->tail = tail;
+			pthread_mutex_unlock(&deque->mutex);
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+static void* mk_pool_thread(void* arg)
+{
+	ASSERT(arg);
+
+	mk_poolArg_t* parg = (mk_poolArg_t*) arg;
+	mk_pool_t*    self = parg->pool;
+	int           tid  = parg->tid;
+
+	int task;
+	while(__atomic_load_n(&self->abort, __ATOMIC_RELAXED) == 0)
+	{
+		if(mk_pool_pop(self, tid, &task) == 0)
+		{
+			if(mk_pool_steal(self, tid) == 0)
+			{
+				// all queues are empty
+				break;
+			}
+			continue;
+		}
+
+		if((*self->task_fn)(self->priv, tid, task) == 0)
+		{
+			__atomic_store_n(&self->abort, 1, __ATOMIC_RELAXED);
+		}
+	}
+
+	return NULL;
+}
+
+/***********************************************************
+* public                                                   *
+***********************************************************/
+
+mk_pool_t* mk_pool_new(int nth, void* priv,
+                       mk_pool_taskFn task_fn)
+{
+	ASSERT(nth > 0);
+	ASSERT(task_fn);
+
+	mk_pool_t* self;
+	self = (mk_pool_t*) CALLOC(1, sizeof(mk_pool_t));
+	if(self == NULL)
+	{
+		LOGE("CALLOC failed");
+		return NULL;
+	}
+
+	self->nth     = nth;
+	self->priv    = priv;
+	self->task_fn = task_fn;
+
+	self->deques = (mk_deque_t*)
+	               CALLOC(nth, sizeof(mk_deque_t));
+	if(self->deques == NULL)
+	{
+		LOGE("CALLOC failed");
+		goto fail_deques;
+	}
+
+	self->threads = (pthread_t*)
+	                CALLOC(nth, sizeof(pthread_t));
+	if(self->threads == NULL)
+	{
+		LOGE("CALLOC failed");
+		goto fail_threads;
+	}
+
+	int i;
+	for(i = 0; i < nth; ++i)
+	{
+		if(pthread_mutex_init(&self->deques[i].mutex,
+		                      NULL) != 0)
+		{
+			LOGE("pthread_mutex_init failed");
+			goto fail_mutex;
+		}
+	}
+
+	// success
+	return self;
+
+	// failure
+	fail_mutex:
+	{
+		int j;
+		for(j = 0; j < i; ++j)
+		{
+			pthread_mutex_destroy(&self->deques[j].mutex);
+		}
+		FREE(self->threads);
+	}
+	fail_threads:
+		FREE(self->deques);
+	fail_deques:
+		FREE(self);
+	return NULL;
+}
+
+void mk_pool_delete(mk_pool_t** _self)
+{
+	ASSERT(_self);
+
+	mk_pool_t* self = *_self;
+	if(self)
+	{
+		int i;
+		for(i = 0; i < self->nth; ++i)
+		{
+			pthread_mutex_destroy(&self->deques[i].mutex);
+		}
+		FREE(self->threads);
+		FREE(self->deques);
+		FREE(self);
+		*_self = NULL;
+	}
+}
+
+int mk_pool_run(mk_pool_t* self, int count)
+{
+	ASSERT(self);
+	ASSERT(count >= 0);
+
+	mk_poolArg_t* args;
+	args = (mk_poolArg_t*)
+	       CALLOC(self->nth, sizeof(mk_poolArg_t));
+	if(args == NULL)
+	{
+		LOGE("CALLOC failed");
+		return 0;
+	}
+
+	// partition tasks into contiguous ranges so that
+	// neighboring tasks are processed by the same thread
+	int i;
+	int nth = self->nth;
+	for(i = 0; i < nth; ++i)
+	{
+		mk_deque_t* deque = &self->deques[i];
+		deque->head = (int) (((long long) count)*i/nth);
+		deque->tail = (int) (((long long) count)*(i + 1)/nth);
+		args[i].pool = self;
+		args[i].tid  = i;
+	}
+	self->abort = 0;
+
+	int started = 0;
+	for(i = 0; i < nth; ++i)
+	{
+		if(pthread_create(&self->threads[i], NULL,
+		                  mk_pool_thread,
+		                  (void*) &args[i]) != 0)
+		{
+			LOGE("pthread_create failed");
+			__atomic_store_n(&self->abort, 1, __ATOMIC_RELAXED);
+			break;
+		}
+		++started;
+	}
+
+	for(i = 0; i < started; ++i)
+	{
+		pthread_join(self->threads[i], NULL);
+	}
+
+	FREE(args);
+
+	return self->abort ? 0 : 1;
+}
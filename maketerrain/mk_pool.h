@@ -0,0 +1,62 @@
+/*
+ * Copyright (c) 2020 Jeff Boody
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#ifndef mk_pool_H
+#define mk_pool_H
+
+#include <pthread.h>
+
+// task callback returns 0 to abort the pool
+typedef int (*mk_pool_taskFn)(void* priv, int tid,
+                              int task);
+
+// work queue for a single thread
+// the owner pops tasks from the head while other threads
+// steal tasks from the tail
+typedef struct
+{
+	int head;
+	int tail;
+	pthread_mutex_t mutex;
+} mk_deque_t;
+
+typedef struct
+{
+	int            nth;
+	void*          priv;
+	mk_pool_taskFn task_fn;
+
+	// abort flag
+	int abort;
+
+	// per-thread queues
+	mk_deque_t* deques;
+	pthread_t*  threads;
+} mk_pool_t;
+
+mk_pool_t* mk_pool_new(int nth, void* priv,
+                       mk_pool_taskFn task_fn);
+void       mk_pool_delete(mk_pool_t** _self);
+int        mk_pool_run(mk_pool_t* self, int count);
+
+#endif
@@ -0,0 +1,133 @@
+/*
+ * Copyright (c) 2020 Jeff Boody
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#include <stdlib.h>
+
+#define LOG_TAG "maketerrain"
+#include "libcc/cc_log.h"
+#include "mk_resample.h"
+
+/***********************************************************
+* private                                                  *
+***********************************************************/
+
+static void
+mk_resample_coords(terrain_tile_t* tile,
+                   double* lat, double* lon)
+{
+	ASSERT(tile);
+	ASSERT(lat);
+	ASSERT(lon);
+
+	// compute the sample coordinates exactly as the
+	// per-sample path in mk_state_make
+	int    i;
+	double latT;
+	double lonL;
+	double latB;
+	double lonR;
+	int    min = -TERRAIN_SAMPLES_BORDER;
+	int    max = TERRAIN_SAMPLES_TILE + TERRAIN_SAMPLES_BORDER;
+	double d   = (double) (max - min - 1);
+	terrain_tile_coord(tile, min, min, &latT, &lonL);
+	terrain_tile_coord(tile, max - 1, max - 1, &latB, &lonR);
+	for(i = 0; i < TERRAIN_SAMPLES_TOTAL; ++i)
+	{
+		double t = ((double) i)/d;
+		lat[i] = latT + t*(latB - latT);
+		lon[i] = lonL + t*(lonR - lonL);
+	}
+}
+
+/***********************************************************
+* public                                                   *
+***********************************************************/
+
+int mk_resample_init(mk_resample_t* self,
+                     terrain_tile_t* tile,
+                     flt_tile_t* flt)
+{
+	ASSERT(self);
+	ASSERT(tile);
+	ASSERT(flt);
+
+	self->flt = flt;
+
+	double lat[TERRAIN_SAMPLES_TOTAL];
+	double lon[TERRAIN_SAMPLES_TOTAL];
+	mk_resample_coords(tile, lat, lon);
+
+	// the source covers the samples in the valid rows and
+	// valid columns
+	int i;
+	int rows = 0;
+	int cols = 0;
+	for(i = 0; i < TERRAIN_SAMPLES_TOTAL; ++i)
+	{
+		double latv = 1.0 - ((lat[i] - flt->latB)/
+		                     (flt->latT - flt->latB));
+		self->row_valid[i] = flt_tile_sampleIndex(latv,
+		                                          flt->nrows,
+		                                          &self->row0[i],
+		                                          &self->row1[i],
+		                                          &self->v[i]);
+		if(self->row_valid[i])
+		{
+			rows = 1;
+		}
+
+		double lonu = (lon[i] - flt->lonL)/
+		              (flt->lonR - flt->lonL);
+		self->col_valid[i] = flt_tile_sampleIndex(lonu,
+		                                          flt->ncols,
+		                                          &self->col0[i],
+		                                          &self->col1[i],
+		                                          &self->u[i]);
+		if(self->col_valid[i])
+		{
+			cols = 1;
+		}
+	}
+
+	return (rows && cols) ? 1 : 0;
+}
+
+void mk_resample_paintRow(mk_resample_t* self,
+                          terrain_tile_t* tile,
+                          int m, int n0, int n1)
+{
+	ASSERT(self);
+	ASSERT(tile);
+	ASSERT(self->row_valid[m]);
+
+	const int   S   = TERRAIN_SAMPLES_TOTAL;
+	flt_tile_t* flt = self->flt;
+
+	const short* src0 = flt_tile_row(flt, self->row0[m]);
+	const short* src1 = flt_tile_row(flt, self->row1[m]);
+	short*       dst  = &tile->data[m*S];
+
+	flt_tile_sampleBlock(flt, src0, src1, self->v[m],
+	                     &self->col0[n0], &self->col1[n0],
+	                     &self->u[n0], n1 - n0, &dst[n0]);
+}
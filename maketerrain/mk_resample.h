@@ -0,0 +1,66 @@
+/*
+ * Copyright (c) 2020 Jeff Boody
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#ifndef mk_resample_H
+#define mk_resample_H
+
+#include "terrain/terrain_tile.h"
+#include "flt/flt_tile.h"
+
+// The terrain samples are linear in lat/lon such that the
+// latitude depends only on the row and the longitude
+// depends only on the column. The resampler precomputes
+// the flt row/column indices and interpolation weights
+// for a tile and source which are then shared by every
+// sample in the corresponding row/column.
+//
+// valid rows/cols are those covered by the source and
+// the interpolated heights are identical to
+// flt_tile_sample. mk_resample_paintRow interpolates the
+// columns [n0, n1) of row m which must be valid with the
+// flt_tile_sampleBlock kernel.
+typedef struct
+{
+	flt_tile_t* flt;
+
+	// row tables indexed by m + TERRAIN_SAMPLES_BORDER
+	int   row_valid[TERRAIN_SAMPLES_TOTAL];
+	int   row0[TERRAIN_SAMPLES_TOTAL];
+	int   row1[TERRAIN_SAMPLES_TOTAL];
+	float v[TERRAIN_SAMPLES_TOTAL];
+
+	// column tables indexed by n + TERRAIN_SAMPLES_BORDER
+	int   col_valid[TERRAIN_SAMPLES_TOTAL];
+	int   col0[TERRAIN_SAMPLES_TOTAL];
+	int   col1[TERRAIN_SAMPLES_TOTAL];
+	float u[TERRAIN_SAMPLES_TOTAL];
+} mk_resample_t;
+
+int  mk_resample_init(mk_resample_t* self,
+                      terrain_tile_t* tile,
+                      flt_tile_t* flt);
+void mk_resample_paintRow(mk_resample_t* self,
+                          terrain_tile_t* tile,
+                          int m, int n0, int n1);
+
+#endif
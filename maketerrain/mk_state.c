@@ -21,6 +21,7 @@
  *
  */
 
+#include <inttypes.h>
 #include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -31,50 +32,51 @@
 #include "libcc/cc_memory.h"
 #include "libcc/cc_timestamp.h"
 #include "terrain/terrain_util.h"
+#include "flt/flt_extent.h"
+#include "mk_pool.h"
 #include "mk_state.h"
 
 #define MB (1024*1024)
 
-/***********************************************************
-* protected                                                *
-***********************************************************/
-
-extern void terrain_tile_set(terrain_tile_t* self,
-                             int m, int n,
-                             short h);
-
 /***********************************************************
 * private                                                  *
 ***********************************************************/
 
+static mk_object_t*
+mk_state_fetchTerrain(mk_state_t* self,
+                      mk_worker_t* worker,
+                      int x, int y, int zoom);
+
 static int
 mk_state_existsFlt(mk_state_t* self, int type,
                    int lat, int lon)
 {
 	ASSERT(self);
 
-	// USGS is top-left origin
-	// ASTERv3 is bottom-left origin
-	char fname[256];
-	if(type == FLT_TILE_TYPE_USGS)
-	{
-		int ulat = lat + 1;
-		char flt_fbase[256];
-		snprintf(flt_fbase, 256, "%s%i%s%03i",
-		         (ulat >= 0) ? "n" : "s", abs(ulat),
-		         (lon >= 0) ? "e" : "w", abs(lon));
-		snprintf(fname, 256, "usgs-ned/data/%s/float%s_13.hdr",
-		         flt_fbase, flt_fbase);
-	}
-	else
+	return mk_coverage_exists(self->coverage, type, lat, lon);
+}
+
+static int
+mk_state_clip(mk_state_t* self, int x, int y, int zoom)
+{
+	ASSERT(self);
+
+	// check range
+	int range = (int) pow(2.0, (double) zoom);
+	if((x < 0)      || (y < 0) ||
+	   (x >= range) || (y >= range))
 	{
-		snprintf(fname, 256,
-		         "ASTERv3/data/ASTGTMV003_%s%02i%s%03i_dem.tif",
-		         (lat >= 0) ? "N" : "S", abs(lat),
-		         (lon >= 0) ? "E" : "W", abs(lon));
+		return 1;
 	}
 
-	if(access(fname, F_OK) == 0)
+	// clip tile
+	double latT;
+	double lonL;
+	double latB;
+	double lonR;
+	terrain_bounds(x, y, zoom, &latT, &lonL, &latB, &lonR);
+	if((self->latT < latB) || (self->lonL > lonR) ||
+	   (self->latB > latT) || (self->lonR < lonL))
 	{
 		return 1;
 	}
@@ -82,9 +84,109 @@ mk_state_existsFlt(mk_state_t* self, int type,
 	return 0;
 }
 
+static void
+mk_state_range13(mk_state_t* self,
+                 int* _x0, int* _y0, int* _x1, int* _y1)
+{
+	ASSERT(self);
+	ASSERT(_x0);
+	ASSERT(_y0);
+	ASSERT(_x1);
+	ASSERT(_y1);
+
+	// z13 tiles which touch the bounds are also included
+	// by the clip test in mk_state_fetchTerrain
+	float xtl;
+	float ytl;
+	float xbr;
+	float ybr;
+	int   range = 8192;
+	terrain_coord2tile(self->latT, self->lonL, 13, &xtl, &ytl);
+	terrain_coord2tile(self->latB, self->lonR, 13, &xbr, &ybr);
+	int x0 = (int) xtl - 1;
+	int y0 = (int) ytl - 1;
+	int x1 = (int) xbr + 1;
+	int y1 = (int) ybr + 1;
+	if(x0 < 0)
+	{
+		x0 = 0;
+	}
+	if(y0 < 0)
+	{
+		y0 = 0;
+	}
+	if(x1 >= range)
+	{
+		x1 = range - 1;
+	}
+	if(y1 >= range)
+	{
+		y1 = range - 1;
+	}
+
+	*_x0 = x0;
+	*_y0 = y0;
+	*_x1 = x1;
+	*_y1 = y1;
+}
+
+static int
+mk_state_cell(mk_state_t* self, int x, int y,
+              int* _cx, int* _cy)
+{
+	ASSERT(self);
+
+	// z13 tiles select flt objects from the 1-degree cell
+	// which contains their bottom-left corner (see
+	// mk_state_prefetch13) and cells may extend one degree
+	// beyond the bounds
+	double latT;
+	double lonL;
+	double latB;
+	double lonR;
+	terrain_bounds(x, y, 13, &latT, &lonL, &latB, &lonR);
+
+	int lat0 = self->latT + 1;
+	int lon0 = self->lonL - 1;
+	int cw   = self->lonR - self->lonL + 3;
+	int ch   = self->latT - self->latB + 3;
+	int cx   = (int) lonL - lon0;
+	int cy   = lat0 - (int) latB;
+	if(cx < 0)
+	{
+		cx = 0;
+	}
+	else if(cx >= cw)
+	{
+		cx = cw - 1;
+	}
+	if(cy < 0)
+	{
+		cy = 0;
+	}
+	else if(cy >= ch)
+	{
+		cy = ch - 1;
+	}
+
+	if(_cx)
+	{
+		*_cx = cx;
+	}
+	if(_cy)
+	{
+		*_cy = cy;
+	}
+
+	return cy*cw + cx;
+}
+
+// the cache functions below must be called with the
+// mutex locked
+
 static void
 mk_state_evictObject(mk_state_t* self,
-                     cc_listIter_t** _iter)
+                     cc_listIter_t** _iter, int trim)
 {
 	ASSERT(self);
 	ASSERT(_iter);
@@ -93,53 +195,139 @@ mk_state_evictObject(mk_state_t* self,
 	if(iter)
 	{
 		mk_object_t* obj;
-		obj = (mk_object_t*)
-		      cc_list_remove(self->obj_list, _iter);
+		obj = (mk_object_t*) cc_list_peekIter(iter);
 		ASSERT(mk_object_refcount(obj) == 0);
 
-		// find/remove object from map
-		char key[256];
-		mk_object_key(obj, key);
+		int type = obj->type;
+		cc_list_remove(self->obj_list[type], _iter);
+		self->size[type] -= mk_object_size(obj);
 
-		cc_mapIter_t* miter = cc_map_find(self->obj_map, key);
-		if(miter)
+		// remove object from index
+		uint64_t key = mk_object_key(obj);
+		if(mk_index_remove(self->obj_index, key) != iter)
 		{
-			ASSERT(obj == cc_map_val(miter));
-			cc_map_remove(self->obj_map, &miter);
+			LOGE("invalid key=0x%" PRIx64, key);
 		}
-		else
+
+		// objects evicted by the budget may be needed again
+		// and are tracked to detect reimports while objects
+		// discarded by the stream are not needed again
+		// note: only flt keys are tracked since the number
+		// of flt objects is bounded by the flt cells while
+		// terrain reimports are counted as reloads from the
+		// terrainv2 files
+		if(trim)
 		{
-			LOGE("invalid key=%s", key);
+			++self->stats[type].evictions;
+			if(type == MK_OBJECT_TYPE_FLT)
+			{
+				mk_index_add(self->evict_index, key,
+				             (void*) &self->null_val);
+			}
 		}
 
 		mk_object_delete(&obj);
 	}
 }
 
-static void mk_state_trim13(mk_state_t* self)
+static void mk_state_trim(mk_state_t* self)
 {
 	ASSERT(self);
 
-	cc_listIter_t* iter = cc_list_head(self->obj_list);
-	size_t max = (size_t) 4000*MB;
-	while(iter)
+	// evict terrain before flt objects since terrain is
+	// small and cheap to import from the terrainv2 files
+	int type;
+	for(type = 0; type < MK_OBJECT_TYPE_COUNT; ++type)
 	{
-		if(MEMSIZE() < max)
+		cc_listIter_t* iter;
+		iter = cc_list_head(self->obj_list[type]);
+		while(iter)
 		{
-			return;
-		}
+			size_t size = self->size[MK_OBJECT_TYPE_TERRAIN] +
+			              self->size[MK_OBJECT_TYPE_FLT];
+			if(size < self->budget)
+			{
+				return;
+			}
 
-		// try to evict object
-		mk_object_t* obj;
-		obj = (mk_object_t*) cc_list_peekIter(iter);
-		if(mk_object_refcount(obj))
-		{
-			iter = cc_list_next(iter);
-			continue;
+			// try to evict object
+			mk_object_t* obj;
+			obj = (mk_object_t*) cc_list_peekIter(iter);
+			if(mk_object_refcount(obj))
+			{
+				iter = cc_list_next(iter);
+				continue;
+			}
+
+			mk_state_evictObject(self, &iter, 1);
 		}
+	}
+}
+
+static int
+mk_state_insertObject(mk_state_t* self, mk_object_t* obj)
+{
+	ASSERT(self);
+	ASSERT(obj);
+
+	uint64_t key  = mk_object_key(obj);
+	int      type = obj->type;
+	cc_listIter_t* iter;
+	iter = cc_list_append(self->obj_list[type], NULL,
+	                      (const void*) obj);
+	if(iter == NULL)
+	{
+		return 0;
+	}
+
+	if(mk_index_add(self->obj_index, key,
+	                (void*) iter) == 0)
+	{
+		goto fail_index;
+	}
+
+	size_t size = mk_object_size(obj);
+	self->size[type] += size;
+	if((type == MK_OBJECT_TYPE_FLT) && (size > self->flt_max))
+	{
+		self->flt_max = size;
+	}
 
-		mk_state_evictObject(self, &iter);
+	// update statistics
+	++self->stats[type].misses;
+	if((type == MK_OBJECT_TYPE_FLT) &&
+	   mk_index_remove(self->evict_index, key))
+	{
+		++self->stats[type].reimports;
 	}
+
+	// success
+	return 1;
+
+	// failure
+	fail_index:
+		cc_list_remove(self->obj_list[type], &iter);
+	return 0;
+}
+
+static int
+mk_state_reserve(mk_state_t* self, uint64_t key)
+{
+	ASSERT(self);
+
+	return mk_index_add(self->pending_index, key,
+	                    (void*) &self->null_val);
+}
+
+static void
+mk_state_resolve(mk_state_t* self, uint64_t key)
+{
+	ASSERT(self);
+
+	mk_index_remove(self->pending_index, key);
+
+	// wake threads waiting on pending objects
+	pthread_cond_broadcast(&self->cond);
 }
 
 static mk_object_t*
@@ -148,59 +336,49 @@ mk_state_findTerrain(mk_state_t* self,
 {
 	ASSERT(self);
 
-	cc_mapIter_t* miter;
-	miter = cc_map_findf(self->obj_map, "T/%i/%i/%i",
-	                     zoom, x, y);
-	if(miter == NULL)
+	cc_listIter_t* iter;
+	iter = (cc_listIter_t*)
+	       mk_index_find(self->obj_index,
+	                     mk_index_keyTerrain(zoom, x, y));
+	if(iter == NULL)
 	{
 		return NULL;
 	}
 
 	// update LRU
-	cc_listIter_t* iter;
-	iter = (cc_listIter_t*) cc_map_val(miter);
-	cc_list_moven(self->obj_list, iter, NULL);
+	cc_list_moven(self->obj_list[MK_OBJECT_TYPE_TERRAIN],
+	              iter, NULL);
+	++self->stats[MK_OBJECT_TYPE_TERRAIN].hits;
 
 	return (mk_object_t*) cc_list_peekIter(iter);
 }
 
-static cc_listIter_t*
-mk_state_newTerrain(mk_state_t* self,
-                    int x, int y, int zoom)
+static mk_object_t*
+mk_state_findFlt(mk_state_t* self,
+                 int type, int lat, int lon)
 {
 	ASSERT(self);
 
-	mk_object_t* obj = mk_object_newTerrain(x, y, zoom);
-	if(obj == NULL)
-	{
-		return NULL;
-	}
-
 	cc_listIter_t* iter;
-	iter = cc_list_append(self->obj_list, NULL,
-	                      (const void*) obj);
+	iter = (cc_listIter_t*)
+	       mk_index_find(self->obj_index,
+	                     mk_index_keyFlt(type, lat, lon));
 	if(iter == NULL)
 	{
-		goto fail_list;
-	}
-
-	if(cc_map_addf(self->obj_map, (const void*) iter,
-	               "T/%i/%i/%i", zoom, x, y) == NULL)
-	{
-		goto fail_map;
+		return NULL;
 	}
 
-	// success
-	return iter;
+	// update LRU
+	cc_list_moven(self->obj_list[MK_OBJECT_TYPE_FLT],
+	              iter, NULL);
+	++self->stats[MK_OBJECT_TYPE_FLT].hits;
 
-	// failure
-	fail_map:
-		cc_list_remove(self->obj_list, &iter);
-	fail_list:
-		mk_object_delete(&obj);
-	return NULL;
+	return (mk_object_t*) cc_list_peekIter(iter);
 }
 
+// the functions below must be called with the
+// mutex unlocked
+
 static mk_object_t*
 mk_state_importTerrain(mk_state_t* self,
                        int x, int y, int zoom)
@@ -212,63 +390,41 @@ mk_state_importTerrain(mk_state_t* self,
 	char fname[256];
 	snprintf(fname, 256, "%s/terrainv2/%i/%i/%i.terrain",
 	         self->path, zoom, x, y);
-	if(access(fname, F_OK) != 0)
+
+	// wait for the tile if it is being exported
+	if(self->exporter &&
+	   (terrain_exporter_sync(self->exporter, x, y, zoom) == 0))
 	{
 		return NULL;
 	}
 
 	mk_object_t* obj;
-	obj = mk_object_importTerrain(self->path, x, y, zoom);
-	if(obj == NULL)
+	if(self->pack)
 	{
-		return NULL;
+		obj = mk_object_importPack(self->tile_pool,
+		                           self->exporter,
+		                           x, y, zoom);
 	}
-
-	cc_listIter_t* iter;
-	iter = cc_list_append(self->obj_list, NULL,
-	                      (const void*) obj);
-	if(iter == NULL)
+	else if(access(fname, F_OK) == 0)
 	{
-		goto fail_list;
+		obj = mk_object_importTerrain(self->tile_pool,
+		                              self->path,
+		                              x, y, zoom);
 	}
-
-	if(cc_map_addf(self->obj_map, (const void*) iter,
-	               "T/%i/%i/%i", zoom, x, y) == NULL)
+	else
 	{
-		goto fail_map;
+		return NULL;
 	}
 
-	// success
-	return obj;
-
-	// failure
-	fail_map:
-		cc_list_remove(self->obj_list, &iter);
-	fail_list:
-		mk_object_delete(&obj);
-	return NULL;
-}
-
-static mk_object_t*
-mk_state_findFlt(mk_state_t* self,
-                 int type, int lat, int lon)
-{
-	ASSERT(self);
-
-	cc_mapIter_t* miter;
-	miter = cc_map_findf(self->obj_map, "F/%i/%i/%i",
-	                     type, lat, lon);
-	if(miter == NULL)
+	// count reloads from the terrainv2 files
+	if(obj)
 	{
-		return NULL;
+		pthread_mutex_lock(&self->mutex);
+		++self->stats[MK_OBJECT_TYPE_TERRAIN].reimports;
+		pthread_mutex_unlock(&self->mutex);
 	}
 
-	// update LRU
-	cc_listIter_t* iter;
-	iter = (cc_listIter_t*) cc_map_val(miter);
-	cc_list_moven(self->obj_list, iter, NULL);
-
-	return (mk_object_t*) cc_list_peekIter(iter);
+	return obj;
 }
 
 static mk_object_t*
@@ -277,97 +433,303 @@ mk_state_getFlt(mk_state_t* self, int type,
 {
 	ASSERT(self);
 
-	// check if the object is cached
+	uint64_t key = mk_index_keyFlt(type, lat, lon);
+
+	// check if the object is cached or is being
+	// imported by another thread
 	mk_object_t* obj;
-	obj = mk_state_findFlt(self, type, lat, lon);
-	if(obj)
+	pthread_mutex_lock(&self->mutex);
+	while(1)
 	{
-		return obj;
-	}
+		obj = mk_state_findFlt(self, type, lat, lon);
+		if(obj)
+		{
+			mk_object_incref(obj);
+			pthread_mutex_unlock(&self->mutex);
+			return obj;
+		}
 
-	// USGS is top-left origin
-	// ASTERv3 is bottom-left origin
-	char fname[256];
-	if(type == FLT_TILE_TYPE_USGS)
-	{
-		int ulat = lat + 1;
-		char flt_fbase[256];
-		snprintf(flt_fbase, 256, "%s%i%s%03i",
-		         (ulat >= 0) ? "n" : "s", abs(ulat),
-		         (lon >= 0) ? "e" : "w", abs(lon));
-		snprintf(fname, 256, "usgs-ned/data/%s/float%s_13.hdr",
-		         flt_fbase, flt_fbase);
+		void* val = mk_index_find(self->pending_index, key);
+		if(val == NULL)
+		{
+			break;
+		}
+
+		double t0 = cc_timestamp();
+		pthread_cond_wait(&self->cond, &self->mutex);
+		if(val == (void*) &self->prefetch_val)
+		{
+			self->prefetch.wait += cc_timestamp() - t0;
+		}
 	}
-	else
+
+	if(mk_state_reserve(self, key) == 0)
 	{
-		snprintf(fname, 256,
-		         "ASTERv3/data/ASTGTMV003_%s%02i%s%03i_dem.tif",
-		         (lat >= 0) ? "N" : "S", abs(lat),
-		         (lon >= 0) ? "E" : "W", abs(lon));
+		pthread_mutex_unlock(&self->mutex);
+		return NULL;
 	}
+	pthread_mutex_unlock(&self->mutex);
 
 	// avoid error message if file doesn't exist
 	// since flt files are sparse
-	if(mk_state_existsFlt(self, type, lat, lon) == 0)
+	if(mk_state_existsFlt(self, type, lat, lon))
 	{
-		return NULL;
+		// import the object
+		obj = mk_object_importFlt(type, lat, lon,
+		                          self->flt_lazy);
 	}
 
-	// import the object
-	obj = mk_object_importFlt(type, lat, lon);
-	if(obj == NULL)
+	pthread_mutex_lock(&self->mutex);
+	if(obj)
 	{
-		return NULL;
+		if(mk_state_insertObject(self, obj))
+		{
+			mk_object_incref(obj);
+		}
+		else
+		{
+			mk_object_delete(&obj);
+		}
 	}
+	mk_state_resolve(self, key);
+	mk_state_trim(self);
+	pthread_mutex_unlock(&self->mutex);
 
-	cc_listIter_t* iter;
-	iter = cc_list_append(self->obj_list, NULL,
-	                      (const void*) obj);
-	if(iter == NULL)
+	return obj;
+}
+
+static void
+mk_state_prefetchFlt(mk_state_t* self, int type,
+                     int lat, int lon)
+{
+	ASSERT(self);
+
+	mk_prefetch_t* pf  = &self->prefetch;
+	uint64_t       key = mk_index_keyFlt(type, lat, lon);
+
+	// check if the object is cached or is being
+	// imported by another thread
+	pthread_mutex_lock(&self->mutex);
+	if(mk_index_find(self->obj_index, key) ||
+	   mk_index_find(self->pending_index, key))
 	{
-		goto fail_list;
+		pthread_mutex_unlock(&self->mutex);
+		return;
 	}
 
-	if(cc_map_addf(self->obj_map, (const void*) iter,
-	               "F/%i/%i/%i", type, lat, lon) == NULL)
+	// only prefetch objects which fit in the budget
+	size_t size = self->size[MK_OBJECT_TYPE_TERRAIN] +
+	              self->size[MK_OBJECT_TYPE_FLT];
+	if(size + self->flt_max > self->budget)
 	{
-		goto fail_map;
+		++pf->skipped;
+		pthread_mutex_unlock(&self->mutex);
+		return;
 	}
 
-	// success
-	return obj;
+	if(mk_index_add(self->pending_index, key,
+	                (void*) &self->prefetch_val) == 0)
+	{
+		pthread_mutex_unlock(&self->mutex);
+		return;
+	}
+	pthread_mutex_unlock(&self->mutex);
 
-	// failure
-	fail_map:
-		cc_list_remove(self->obj_list, &iter);
-	fail_list:
-		mk_object_delete(&obj);
-	return NULL;
+	double       t0 = cc_timestamp();
+	mk_object_t* obj;
+	obj = mk_object_importFlt(type, lat, lon,
+	                          self->flt_lazy);
+	double       dt = cc_timestamp() - t0;
+
+	// the object is cached without a reference
+	pthread_mutex_lock(&self->mutex);
+	if(obj)
+	{
+		if(mk_state_insertObject(self, obj))
+		{
+			++pf->imports;
+			pf->import += dt;
+		}
+		else
+		{
+			mk_object_delete(&obj);
+		}
+	}
+	mk_state_resolve(self, key);
+	mk_state_trim(self);
+	pthread_mutex_unlock(&self->mutex);
 }
 
-static int
-mk_state_prefetch13(mk_state_t* self, int x, int y)
+static void
+mk_state_prefetchCell(mk_state_t* self, int cell)
 {
 	ASSERT(self);
 
-	self->count += 1.0;
-
-	self->cnt_usgs  = 0;
-	self->cnt_aster = 0;
-
-	// get bounds and select origin of the terrain tile
-	double latT;
-	double lonL;
-	double latB;
-	double lonR;
-	terrain_bounds(x, y, 13, &latT, &lonL, &latB, &lonR);
-	int lat = (int) latB;
-	int lon = (int) lonL;
+	mk_prefetch_t* pf = &self->prefetch;
 
-	// check if flt exists for surrounding USGS tiles
+	// match the flt objects selected by mk_state_prefetch13
 	int row;
 	int col;
-	int idx  = 0;
+	int cnt_usgs = 0;
+	int lat      = self->latT + 1 - cell/pf->cw;
+	int lon      = self->lonL - 1 + cell%pf->cw;
+	for(row = lat - 1; row <= lat + 1; ++row)
+	{
+		for(col = lon - 1; col <= lon + 1; ++col)
+		{
+			if(mk_state_existsFlt(self, FLT_TILE_TYPE_USGS,
+			                      row, col))
+			{
+				mk_state_prefetchFlt(self, FLT_TILE_TYPE_USGS,
+				                     row, col);
+				++cnt_usgs;
+			}
+		}
+	}
+
+	if(cnt_usgs == 9)
+	{
+		return;
+	}
+
+	for(row = lat - 1; row <= lat + 1; ++row)
+	{
+		for(col = lon - 1; col <= lon + 1; ++col)
+		{
+			if(mk_state_existsFlt(self, FLT_TILE_TYPE_ASTERV3,
+			                      row, col))
+			{
+				mk_state_prefetchFlt(self, FLT_TILE_TYPE_ASTERV3,
+				                     row, col);
+			}
+		}
+	}
+}
+
+static void* mk_state_prefetchThread(void* arg)
+{
+	ASSERT(arg);
+
+	mk_state_t*    self = (mk_state_t*) arg;
+	mk_prefetch_t* pf   = &self->prefetch;
+
+	pthread_mutex_lock(&self->mutex);
+	while(1)
+	{
+		while((pf->state == MK_STATE_PREFETCH_RUNNING) &&
+		      (pf->head == pf->tail))
+		{
+			pthread_cond_wait(&pf->cond, &self->mutex);
+		}
+
+		if(pf->state != MK_STATE_PREFETCH_RUNNING)
+		{
+			break;
+		}
+
+		int cell = pf->queue[pf->head];
+		++pf->head;
+		++pf->cells;
+		pthread_mutex_unlock(&self->mutex);
+
+		mk_state_prefetchCell(self, cell);
+
+		pthread_mutex_lock(&self->mutex);
+	}
+	pthread_mutex_unlock(&self->mutex);
+
+	return NULL;
+}
+
+static void
+mk_state_advance(mk_state_t* self, int x, int y)
+{
+	ASSERT(self);
+
+	// the prefetcher is started and stopped by the thread
+	// which schedules the build
+	mk_prefetch_t* pf = &self->prefetch;
+	if(pf->state != MK_STATE_PREFETCH_RUNNING)
+	{
+		return;
+	}
+
+	int cell = mk_state_cell(self, x, y, NULL, NULL);
+
+	// queue the cells which follow the current cell
+	pthread_mutex_lock(&self->mutex);
+	pf->queued[cell] = 1;
+
+	int i;
+	int p = pf->pos[cell];
+	for(i = p + 1; (p >= 0) && (i <= p + pf->lookahead) &&
+	               (i < pf->count); ++i)
+	{
+		int next = pf->plan[i];
+		if(pf->queued[next] == 0)
+		{
+			pf->queued[next] = 1;
+			pf->queue[pf->tail] = next;
+			++pf->tail;
+		}
+	}
+	pthread_cond_signal(&pf->cond);
+	pthread_mutex_unlock(&self->mutex);
+}
+
+static void
+mk_state_release13(mk_state_t* self,
+                   mk_worker_t* worker)
+{
+	ASSERT(self);
+	ASSERT(worker);
+
+	int idx;
+	for(idx = 0; idx < worker->cnt_usgs; ++idx)
+	{
+		mk_state_put(self, &worker->obj_usgs[idx]);
+	}
+
+	for(idx = 0; idx < worker->cnt_aster; ++idx)
+	{
+		mk_state_put(self, &worker->obj_aster[idx]);
+	}
+
+	worker->cnt_usgs  = 0;
+	worker->cnt_aster = 0;
+}
+
+static int
+mk_state_prefetch13(mk_state_t* self,
+                    mk_worker_t* worker,
+                    int x, int y)
+{
+	ASSERT(self);
+	ASSERT(worker);
+
+	pthread_mutex_lock(&self->mutex);
+	self->count += 1.0;
+	double count = self->count;
+	pthread_mutex_unlock(&self->mutex);
+
+	worker->cnt_usgs  = 0;
+	worker->cnt_aster = 0;
+
+	// get bounds and select origin of the terrain tile
+	double latT;
+	double lonL;
+	double latB;
+	double lonR;
+	terrain_bounds(x, y, 13, &latT, &lonL, &latB, &lonR);
+	int lat = (int) latB;
+	int lon = (int) lonL;
+
+	mk_state_advance(self, x, y);
+
+	// check if flt exists for surrounding USGS tiles
+	int row;
+	int col;
+	int idx  = 0;
 	int lat0 = lat - 1;
 	int lon0 = lon - 1;
 	int lat1 = lat + 1;
@@ -375,24 +737,24 @@ mk_state_prefetch13(mk_state_t* self, int x, int y)
 	double dt = cc_timestamp() - self->t0;
 	LOGI("13/%i/%i: lat=%i, lon=%i, dt=%0.3lf, mem=%0.lf MB, %0.1lf%%",
 	     x, y, lat, lon, dt, (double) (MEMSIZE()/MB),
-	     100.0*self->count/self->total);
+	     100.0*count/self->total);
 	for(row = lat0; row <= lat1; ++row)
 	{
 		for(col = lon0; col <= lon1; ++col)
 		{
-			self->obj_usgs[idx] = mk_state_getFlt(self,
-			                                      FLT_TILE_TYPE_USGS,
-			                                      row, col);
-			if(self->obj_usgs[idx])
+			worker->obj_usgs[idx] = mk_state_getFlt(self,
+			                                        FLT_TILE_TYPE_USGS,
+			                                        row, col);
+			if(worker->obj_usgs[idx])
 			{
 				++idx;
 			}
 		}
 	}
-	self->cnt_usgs = idx;
+	worker->cnt_usgs = idx;
 
 	// proceed to z15 if z13 completly covered USGS
-	if(self->cnt_usgs == 9)
+	if(worker->cnt_usgs == 9)
 	{
 		return 15;
 	}
@@ -402,108 +764,812 @@ mk_state_prefetch13(mk_state_t* self, int x, int y)
 	{
 		for(col = lon0; col <= lon1; ++col)
 		{
-			self->obj_aster[idx] = mk_state_getFlt(self,
-			                                       FLT_TILE_TYPE_ASTERV3,
-			                                       row, col);
-			if(self->obj_aster[idx])
-			{
-				++idx;
-			}
+			worker->obj_aster[idx] = mk_state_getFlt(self,
+			                                         FLT_TILE_TYPE_ASTERV3,
+			                                         row, col);
+			if(worker->obj_aster[idx])
+			{
+				++idx;
+			}
+		}
+	}
+	worker->cnt_aster = idx;
+
+	// proceed to z15 if z13 partially covered by USGS
+	// or fall back to z13 if covered by ASTERv3
+	if(worker->cnt_usgs)
+	{
+		return 15;
+	}
+	else if(worker->cnt_aster)
+	{
+		return 13;
+	}
+
+	return 0;
+}
+
+static int
+mk_state_exportTerrain(mk_state_t* self, mk_object_t* obj)
+{
+	ASSERT(self);
+	ASSERT(obj);
+
+	if(self->exporter)
+	{
+		return terrain_exporter_export(self->exporter,
+		                               obj->terrain);
+	}
+
+	if(mk_object_exportTerrain(obj, self->path) == 0)
+	{
+		return 0;
+	}
+
+	terrain_tile_t* tile = obj->terrain;
+	return terrain_index_put(self->index,
+	                         tile->x, tile->y, tile->zoom,
+	                         tile->min, tile->max,
+	                         tile->flags);
+}
+
+static mk_object_t*
+mk_state_make(mk_state_t* self, mk_worker_t* worker,
+              int x, int y, int zoom)
+{
+	ASSERT(self);
+	ASSERT(worker);
+
+	// create a new object
+	mk_object_t* obj;
+	obj = mk_object_newTerrain(self->tile_pool, x, y, zoom);
+	if(obj == NULL)
+	{
+		return NULL;
+	}
+
+	// the first USGS source which covers a sample wins
+	// followed by the first ASTERv3 source
+	int idx;
+	int count = 0;
+	flt_tile_t* flt[MK_MOSAIC_SOURCES];
+	for(idx = 0; idx < worker->cnt_usgs; ++idx)
+	{
+		flt[count++] = worker->obj_usgs[idx]->flt;
+	}
+	for(idx = 0; idx < worker->cnt_aster; ++idx)
+	{
+		flt[count++] = worker->obj_aster[idx]->flt;
+	}
+
+	mk_mosaic_t* mosaic = &worker->mosaic;
+	if(mk_mosaic_init(mosaic, obj->terrain, count, flt))
+	{
+		mk_mosaic_paint(mosaic, obj->terrain);
+	}
+
+	if(mk_state_exportTerrain(self, obj) == 0)
+	{
+		goto fail_export;
+	}
+
+	// success
+	return obj;
+
+	// failure
+	fail_export:
+		mk_object_delete(&obj);
+	return NULL;
+}
+
+static mk_object_t*
+mk_state_buildTerrain(mk_state_t* self,
+                      mk_worker_t* worker,
+                      int x, int y, int zoom,
+                      int* null)
+{
+	ASSERT(self);
+	ASSERT(worker);
+	ASSERT(null);
+
+	*null = 0;
+
+	// check if the object was created
+	// note: this z13 check isn't normally necessary however
+	// due to an unknown error while processing the terrainv2
+	// data these files cannot be trusted and must be
+	// recreated if the z13 level is not found
+	mk_object_t* obj;
+	if(zoom <= 13)
+	{
+		obj = mk_state_importTerrain(self, x, y, zoom);
+		if(obj)
+		{
+			return obj;
+		}
+	}
+
+	// end recursion
+	if(zoom == 15)
+	{
+		return mk_state_make(self, worker, x, y, zoom);
+	}
+	else if(zoom == 13)
+	{
+		int prefetch = mk_state_prefetch13(self, worker, x, y);
+		if(prefetch == 13)
+		{
+			obj = mk_state_make(self, worker, x, y, zoom);
+			mk_state_release13(self, worker);
+			return obj;
+		}
+		else if(prefetch == 0)
+		{
+			mk_state_release13(self, worker);
+			*null = 1;
+			return NULL;
+		}
+		else
+		{
+			// otherwise get next LOD
+		}
+	}
+
+	// get surrounding tiles in the next zoom level
+	int r;
+	int c;
+	int idx;
+	int done = 1;
+	int xx = 2*x;
+	int yy = 2*y;
+	int zz = zoom + 1;
+	mk_object_t* next[16] =
+	{
+		NULL, NULL, NULL, NULL,
+		NULL, NULL, NULL, NULL,
+		NULL, NULL, NULL, NULL,
+		NULL, NULL, NULL, NULL,
+	};
+	for(r = 0; r < 4; ++r)
+	{
+		for(c = 0; c < 4; ++c)
+		{
+			idx = 4*r + c;
+			next[idx] = mk_state_fetchTerrain(self, worker,
+			                                  xx + c - 1,
+			                                  yy + r - 1, zz);
+			if(next[idx])
+			{
+				done = 0;
+			}
+		}
+	}
+
+	// flt objects are not needed once the next LOD
+	// has been created
+	if(zoom == 13)
+	{
+		mk_state_release13(self, worker);
+	}
+
+	// check if sampling can be performed
+	if(done)
+	{
+		*null = 1;
+		return NULL;
+	}
+
+	// create a new object
+	obj = mk_object_newTerrain(self->tile_pool, x, y, zoom);
+	if(obj == NULL)
+	{
+		goto fail_obj;
+	}
+
+	// sample the next LOD
+	mk_object_sample(obj, next);
+
+	// export the object
+	if(mk_state_exportTerrain(self, obj) == 0)
+	{
+		goto fail_export;
+	}
+
+	// update refcounts
+	for(r = 0; r < 4; ++r)
+	{
+		for(c = 0; c < 4; ++c)
+		{
+			idx = 4*r + c;
+			mk_state_put(self, &next[idx]);
+		}
+	}
+
+	// success
+	return obj;
+
+	// failure
+	fail_export:
+		mk_object_delete(&obj);
+	fail_obj:
+	{
+		// put objects
+		for(r = 0; r < 4; ++r)
+		{
+			for(c = 0; c < 4; ++c)
+			{
+				idx = 4*r + c;
+				mk_state_put(self, &next[idx]);
+			}
+		}
+	}
+	return NULL;
+}
+
+static mk_object_t*
+mk_state_fetchTerrain(mk_state_t* self,
+                      mk_worker_t* worker,
+                      int x, int y, int zoom)
+{
+	ASSERT(self);
+	ASSERT(worker);
+
+	if(mk_state_clip(self, x, y, zoom))
+	{
+		return NULL;
+	}
+
+	uint64_t key = mk_index_keyTerrain(zoom, x, y);
+
+	// check if the object is cached, null or is being
+	// created by another thread
+	mk_object_t* obj;
+	pthread_mutex_lock(&self->mutex);
+	while(1)
+	{
+		obj = mk_state_findTerrain(self, x, y, zoom);
+		if(obj)
+		{
+			mk_object_incref(obj);
+			pthread_mutex_unlock(&self->mutex);
+			return obj;
+		}
+
+		if((zoom <= 13) &&
+		   mk_index_find(self->null_index, key))
+		{
+			pthread_mutex_unlock(&self->mutex);
+			return NULL;
+		}
+
+		if(mk_index_find(self->pending_index, key) == NULL)
+		{
+			break;
+		}
+
+		// the next LOD is always created before the
+		// current LOD so waiting cannot deadlock
+		pthread_cond_wait(&self->cond, &self->mutex);
+	}
+
+	if(mk_state_reserve(self, key) == 0)
+	{
+		pthread_mutex_unlock(&self->mutex);
+		return NULL;
+	}
+	pthread_mutex_unlock(&self->mutex);
+
+	int null;
+	obj = mk_state_buildTerrain(self, worker,
+	                            x, y, zoom, &null);
+
+	pthread_mutex_lock(&self->mutex);
+	if(obj)
+	{
+		if(mk_state_insertObject(self, obj))
+		{
+			mk_object_incref(obj);
+
+			// schedule the object to be discarded
+			if(self->stream && (zoom > 0))
+			{
+				mk_stream_release(self->stream, zoom, x, y);
+			}
+		}
+		else
+		{
+			mk_object_delete(&obj);
+		}
+	}
+	else if(null && (zoom <= 13))
+	{
+		mk_index_add(self->null_index, key,
+		             (void*) &self->null_val);
+	}
+	mk_state_resolve(self, key);
+	mk_state_trim(self);
+	pthread_mutex_unlock(&self->mutex);
+
+	return obj;
+}
+
+static int mk_state_task13(void* priv, int tid, int task)
+{
+	ASSERT(priv);
+
+	mk_state_t*  self   = (mk_state_t*) priv;
+	mk_worker_t* worker = &self->workers[tid];
+
+	if(self->order13)
+	{
+		task = self->order13[task];
+	}
+
+	int x = self->x13 + task%self->w13;
+	int y = self->y13 + task/self->w13;
+
+	mk_object_t* obj;
+	obj = mk_state_fetchTerrain(self, worker, x, y, 13);
+	mk_state_put(self, &obj);
+
+	return 1;
+}
+
+static uint64_t mk_state_hilbert(int n, int x, int y)
+{
+	ASSERT(n > 0);
+
+	uint64_t d = 0;
+	int      s;
+	for(s = n/2; s > 0; s /= 2)
+	{
+		int rx = (x & s) ? 1 : 0;
+		int ry = (y & s) ? 1 : 0;
+		d += ((uint64_t) s)*((uint64_t) s)*((3*rx) ^ ry);
+
+		// rotate the quadrant
+		if(ry == 0)
+		{
+			if(rx == 1)
+			{
+				x = n - 1 - x;
+				y = n - 1 - y;
+			}
+
+			int t = x;
+			x = y;
+			y = t;
+		}
+	}
+
+	return d;
+}
+
+static int mk_state_compareKey(const void* a, const void* b)
+{
+	ASSERT(a);
+	ASSERT(b);
+
+	const uint64_t* ka = (const uint64_t*) a;
+	const uint64_t* kb = (const uint64_t*) b;
+	if(*ka < *kb)
+	{
+		return -1;
+	}
+	else if(*ka > *kb)
+	{
+		return 1;
+	}
+	return 0;
+}
+
+static int mk_state_orderHilbert(mk_state_t* self)
+{
+	ASSERT(self);
+
+	// z13 tiles select flt objects from the 1-degree cell
+	// which contains their bottom-left corner (see
+	// mk_state_cell) so tiles are sorted by the Hilbert
+	// index of their cell to maximize flt reuse and by
+	// row-major index within a cell
+	int count = self->w13*self->h13;
+	uint64_t* keys;
+	keys = (uint64_t*) CALLOC(count, sizeof(uint64_t));
+	if(keys == NULL)
+	{
+		LOGE("CALLOC failed");
+		return 0;
+	}
+
+	self->order13 = (int*) CALLOC(count, sizeof(int));
+	if(self->order13 == NULL)
+	{
+		LOGE("CALLOC failed");
+		goto fail_order;
+	}
+
+	int cw = self->lonR - self->lonL + 3;
+	int ch = self->latT - self->latB + 3;
+	int n  = 1;
+	while((n < cw) || (n < ch))
+	{
+		n *= 2;
+	}
+
+	int i;
+	for(i = 0; i < count; ++i)
+	{
+		int cx;
+		int cy;
+		int x = self->x13 + i%self->w13;
+		int y = self->y13 + i/self->w13;
+		mk_state_cell(self, x, y, &cx, &cy);
+
+		keys[i] = (mk_state_hilbert(n, cx, cy) << 32) |
+		          ((uint64_t) i);
+	}
+
+	qsort(keys, count, sizeof(uint64_t),
+	      mk_state_compareKey);
+
+	for(i = 0; i < count; ++i)
+	{
+		self->order13[i] = (int) (keys[i] & 0xFFFFFFFF);
+	}
+
+	FREE(keys);
+
+	// success
+	return 1;
+
+	// failure
+	fail_order:
+		FREE(keys);
+	return 0;
+}
+
+static uint64_t mk_state_morton(int x, int y)
+{
+	uint64_t d = 0;
+	int      b;
+	for(b = 0; b < 16; ++b)
+	{
+		d |= ((uint64_t) ((x >> b) & 1)) << (2*b);
+		d |= ((uint64_t) ((y >> b) & 1)) << (2*b + 1);
+	}
+
+	return d;
+}
+
+static int mk_state_planPrefetch(mk_state_t* self, int morton)
+{
+	ASSERT(self);
+
+	mk_prefetch_t* pf = &self->prefetch;
+
+	int x0;
+	int y0;
+	int x1;
+	int y1;
+	mk_state_range13(self, &x0, &y0, &x1, &y1);
+
+	pf->cw = self->lonR - self->lonL + 3;
+	pf->ch = self->latT - self->latB + 3;
+
+	// allocate the plan, pos, queue and queued arrays
+	int cells = pf->cw*pf->ch;
+	pf->plan = (int*) CALLOC(4*cells, sizeof(int));
+	if(pf->plan == NULL)
+	{
+		LOGE("CALLOC failed");
+		return 0;
+	}
+	pf->pos    = &pf->plan[cells];
+	pf->queue  = &pf->plan[2*cells];
+	pf->queued = &pf->plan[3*cells];
+	pf->count  = 0;
+	pf->head   = 0;
+	pf->tail   = 0;
+
+	int i;
+	for(i = 0; i < cells; ++i)
+	{
+		pf->pos[i] = -1;
+	}
+
+	// follow the Hilbert order of mk_state_build13
+	if(self->order13)
+	{
+		int count = self->w13*self->h13;
+		for(i = 0; i < count; ++i)
+		{
+			int task = self->order13[i];
+			int x    = self->x13 + task%self->w13;
+			int y    = self->y13 + task/self->w13;
+			int cell = mk_state_cell(self, x, y, NULL, NULL);
+			if(pf->pos[cell] < 0)
+			{
+				pf->pos[cell] = pf->count;
+				pf->plan[pf->count] = cell;
+				++pf->count;
+			}
+		}
+
+		return 1;
+	}
+
+	// the cell depends only on x for the column and only on
+	// y for the row and the row-major and Morton orders
+	// increase with x and y so the first tile visited in a
+	// cell is its top-left tile
+	int* first;
+	first = (int*) CALLOC(pf->cw + pf->ch, sizeof(int));
+	if(first == NULL)
+	{
+		LOGE("CALLOC failed");
+		goto fail_first;
+	}
+
+	int* firstx = first;
+	int* firsty = &first[pf->cw];
+	for(i = 0; i < pf->cw + pf->ch; ++i)
+	{
+		first[i] = -1;
+	}
+
+	int cx;
+	int cy;
+	for(i = x1; i >= x0; --i)
+	{
+		mk_state_cell(self, i, y0, &cx, NULL);
+		firstx[cx] = i;
+	}
+	for(i = y1; i >= y0; --i)
+	{
+		mk_state_cell(self, x0, i, NULL, &cy);
+		firsty[cy] = i;
+	}
+
+	uint64_t* keys;
+	keys = (uint64_t*) CALLOC(cells, sizeof(uint64_t));
+	if(keys == NULL)
+	{
+		LOGE("CALLOC failed");
+		goto fail_keys;
+	}
+
+	int count = 0;
+	for(cy = 0; cy < pf->ch; ++cy)
+	{
+		for(cx = 0; cx < pf->cw; ++cx)
+		{
+			int x = firstx[cx];
+			int y = firsty[cy];
+			if((x < 0) || (y < 0))
+			{
+				continue;
+			}
+
+			uint64_t key;
+			if(morton)
+			{
+				key = mk_state_morton(x, y);
+			}
+			else
+			{
+				key = ((uint64_t) y)*8192 + x;
+			}
+
+			keys[count] = (key << 32) |
+			              ((uint64_t) (cy*pf->cw + cx));
+			++count;
+		}
+	}
+
+	qsort(keys, count, sizeof(uint64_t),
+	      mk_state_compareKey);
+
+	for(i = 0; i < count; ++i)
+	{
+		int cell = (int) (keys[i] & 0xFFFFFFFF);
+		pf->pos[cell] = i;
+		pf->plan[i]   = cell;
+	}
+	pf->count = count;
+
+	FREE(keys);
+	FREE(first);
+
+	// success
+	return 1;
+
+	// failure
+	fail_keys:
+		FREE(first);
+	fail_first:
+		FREE(pf->plan);
+		pf->plan = NULL;
+	return 0;
+}
+
+static int mk_state_startPrefetch(mk_state_t* self, int morton)
+{
+	ASSERT(self);
+
+	mk_prefetch_t* pf = &self->prefetch;
+	if(pf->state != MK_STATE_PREFETCH_READY)
+	{
+		return 1;
+	}
+
+	if(mk_state_planPrefetch(self, morton) == 0)
+	{
+		return 0;
+	}
+
+	if(pthread_cond_init(&pf->cond, NULL) != 0)
+	{
+		LOGE("pthread_cond_init failed");
+		goto fail_cond;
+	}
+
+	pf->state = MK_STATE_PREFETCH_RUNNING;
+	if(pthread_create(&pf->thread, NULL,
+	                  mk_state_prefetchThread,
+	                  (void*) self) != 0)
+	{
+		LOGE("pthread_create failed");
+		goto fail_thread;
+	}
+
+	// success
+	return 1;
+
+	// failure
+	fail_thread:
+		pf->state = MK_STATE_PREFETCH_READY;
+		pthread_cond_destroy(&pf->cond);
+	fail_cond:
+		FREE(pf->plan);
+		pf->plan = NULL;
+	return 0;
+}
+
+static void mk_state_stopPrefetch(mk_state_t* self)
+{
+	ASSERT(self);
+
+	mk_prefetch_t* pf = &self->prefetch;
+	if(pf->state != MK_STATE_PREFETCH_RUNNING)
+	{
+		return;
+	}
+
+	// queued cells are discarded
+	pthread_mutex_lock(&self->mutex);
+	pf->state = MK_STATE_PREFETCH_DONE;
+	pthread_cond_signal(&pf->cond);
+	pthread_mutex_unlock(&self->mutex);
+
+	pthread_join(pf->thread, NULL);
+	pthread_cond_destroy(&pf->cond);
+	FREE(pf->plan);
+	pf->plan = NULL;
+}
+
+static void
+mk_state_discard(mk_state_t* self,
+                 int x, int y, int zoom)
+{
+	ASSERT(self);
+
+	pthread_mutex_lock(&self->mutex);
+	cc_listIter_t* iter;
+	iter = (cc_listIter_t*)
+	       mk_index_find(self->obj_index,
+	                     mk_index_keyTerrain(zoom, x, y));
+	if(iter)
+	{
+		mk_object_t* obj;
+		obj = (mk_object_t*) cc_list_peekIter(iter);
+		if(mk_object_refcount(obj) == 0)
+		{
+			mk_state_evictObject(self, &iter, 0);
+		}
+	}
+	pthread_mutex_unlock(&self->mutex);
+}
+
+static void mk_state_drain(mk_state_t* self, uint64_t key)
+{
+	ASSERT(self);
+
+	mk_streamEvent_t e;
+	while(mk_stream_pop(self->stream, key, &e))
+	{
+		if(e.type == MK_STREAM_EVENT_EMIT)
+		{
+			// the children are cached or null so this
+			// only samples the next LOD
+			mk_object_t* obj;
+			obj = mk_state_fetchTerrain(self, &self->worker,
+			                            e.x, e.y, e.zoom);
+			mk_state_put(self, &obj);
+		}
+		else
+		{
+			mk_state_discard(self, e.x, e.y, e.zoom);
 		}
 	}
-	self->cnt_aster = idx;
+}
 
-	// proceed to z15 if z13 partially covered by USGS
-	// or fall back to z13 if covered by ASTERv3
-	if(self->cnt_usgs)
+static void
+mk_state_walk(mk_state_t* self, int x, int y, int zoom)
+{
+	ASSERT(self);
+
+	mk_stream_t* stream = self->stream;
+
+	// skip subtrees outside of the z13 range
+	int s  = 13 - zoom;
+	int x0 = x << s;
+	int y0 = y << s;
+	int x1 = ((x + 1) << s) - 1;
+	int y1 = ((y + 1) << s) - 1;
+	if((x1 < stream->x0) || (x0 > stream->x1) ||
+	   (y1 < stream->y0) || (y0 > stream->y1))
 	{
-		return 15;
+		return;
 	}
-	else if(self->cnt_aster)
+
+	if(zoom == 13)
 	{
-		return 13;
+		mk_object_t* obj;
+		obj = mk_state_fetchTerrain(self, &self->worker,
+		                            x, y, zoom);
+		mk_state_put(self, &obj);
+		mk_state_drain(self, mk_stream_key(stream, zoom, x, y));
+		return;
 	}
 
-	return 0;
+	// visit children in Morton order
+	mk_state_walk(self, 2*x,     2*y,     zoom + 1);
+	mk_state_walk(self, 2*x + 1, 2*y,     zoom + 1);
+	mk_state_walk(self, 2*x,     2*y + 1, zoom + 1);
+	mk_state_walk(self, 2*x + 1, 2*y + 1, zoom + 1);
 }
 
-static mk_object_t*
-mk_state_make(mk_state_t* self, int x, int y, int zoom)
+static void mk_state_report(mk_state_t* self)
 {
 	ASSERT(self);
 
-	// create a new object
-	cc_listIter_t* iter = NULL;
-	iter = mk_state_newTerrain(self, x, y, zoom);
-	if(iter == NULL)
+	const char* name[MK_OBJECT_TYPE_COUNT] =
 	{
-		return NULL;
-	}
-
-	mk_object_t* obj;
-	obj = (mk_object_t*) cc_list_peekIter(iter);
-
-	int m;
-	int n;
-	double latT;
-	double lonL;
-	double latB;
-	double lonR;
-	int    min = -TERRAIN_SAMPLES_BORDER;
-	int    max = TERRAIN_SAMPLES_TILE + TERRAIN_SAMPLES_BORDER;
-	double d   = (double) (max - min - 1);
-	terrain_tile_coord(obj->terrain, min, min, &latT, &lonL);
-	terrain_tile_coord(obj->terrain, max - 1, max - 1, &latB, &lonR);
-	for(m = min; m < max; ++m)
-	{
-		for(n = min; n < max; ++n)
-		{
-			double u   = ((double) (n - min))/d;
-			double v   = ((double) (m - min))/d;
-			double lat = latT + v*(latB - latT);
-			double lon = lonL + u*(lonR - lonL);
-
-			// try to sample ASTERv3
-			flt_tile_t* flt;
-			short h;
-			int   idx;
-			for(idx = 0; idx < self->cnt_aster; ++idx)
-			{
-				flt = self->obj_aster[idx]->flt;
-				if(flt_tile_sample(flt, lat, lon, &h))
-				{
-					terrain_tile_set(obj->terrain, m, n, h);
-					break;
-				}
-			}
+		"terrain",
+		"flt",
+	};
 
-			// try to sample USGS
-			for(idx = 0; idx < self->cnt_usgs; ++idx)
-			{
-				flt = self->obj_usgs[idx]->flt;
-				if(flt_tile_sample(flt, lat, lon, &h))
-				{
-					terrain_tile_set(obj->terrain, m, n, h);
-					break;
-				}
-			}
-		}
+	int type;
+	for(type = 0; type < MK_OBJECT_TYPE_COUNT; ++type)
+	{
+		mk_stats_t* stats = &self->stats[type];
+		LOGI("%s: hits=%" PRIu64 ", misses=%" PRIu64
+		     ", evictions=%" PRIu64 ", reimports=%" PRIu64
+		     ", size=%0.1lf MB",
+		     name[type], stats->hits, stats->misses,
+		     stats->evictions, stats->reimports,
+		     ((double) self->size[type])/MB);
 	}
 
-	if(mk_object_exportTerrain(obj, self->path) == 0)
+	// the prefetcher removed the import time of prefetched
+	// objects except while the builder waited for them
+	mk_prefetch_t* pf = &self->prefetch;
+	if(pf->state != MK_STATE_PREFETCH_OFF)
 	{
-		goto fail_export;
+		LOGI("prefetch: cells=%i, imports=%i, skipped=%i, import=%0.3lf s, wait=%0.3lf s, removed=%0.3lf s",
+		     pf->cells, pf->imports, pf->skipped, pf->import,
+		     pf->wait, pf->import - pf->wait);
 	}
-
-	mk_object_incref(obj);
-
-	// success
-	return obj;
-
-	// failure
-	fail_export:
-		mk_state_evictObject(self, &iter);
-	return NULL;
 }
 
 /***********************************************************
@@ -512,7 +1578,8 @@ mk_state_make(mk_state_t* self, int x, int y, int zoom)
 
 mk_state_t*
 mk_state_new(int latT, int lonL, int latB, int lonR,
-             const char* path)
+             const char* path, size_t budget, int writers,
+             int pack)
 {
 	ASSERT(path);
 
@@ -539,38 +1606,141 @@ mk_state_new(int latT, int lonL, int latB, int lonR,
 	self->lonR  = lonR;
 	self->t0    = cc_timestamp();
 	self->total = w*h;
-	self->path  = path;
+	self->path   = path;
+	self->budget = budget;
+
+	LOGI("latT=%i, lonL=%i, latB=%i, lonR=%i, path=%s, total=%lf, budget=%0.lf MB",
+	     latT, lonL, latB, lonR, path, self->total,
+	     (double) (budget/MB));
+
+	if(pthread_mutex_init(&self->mutex, NULL) != 0)
+	{
+		LOGE("pthread_mutex_init failed");
+		goto fail_mutex;
+	}
+
+	if(pthread_cond_init(&self->cond, NULL) != 0)
+	{
+		LOGE("pthread_cond_init failed");
+		goto fail_cond;
+	}
+
+	self->tile_pool = terrain_pool_new(MK_STATE_SLAB);
+	if(self->tile_pool == NULL)
+	{
+		goto fail_tile_pool;
+	}
+
+	// packs are only written by the exporter
+	self->pack = pack;
+	if(pack)
+	{
+		if(writers < 1)
+		{
+			writers = 1;
+		}
+
+		self->exporter = terrain_exporter_newPack(path, writers,
+		                                          writers*MK_STATE_EXPORT_DEPTH);
+		if(self->exporter == NULL)
+		{
+			goto fail_exporter;
+		}
+	}
+	else if(writers > 0)
+	{
+		self->exporter = terrain_exporter_new(path, writers,
+		                                      writers*MK_STATE_EXPORT_DEPTH);
+		if(self->exporter == NULL)
+		{
+			goto fail_exporter;
+		}
+	}
+	else
+	{
+		self->index = terrain_index_append(path);
+		if(self->index == NULL)
+		{
+			goto fail_exporter;
+		}
+	}
+
+	self->obj_index = mk_index_new();
+	if(self->obj_index == NULL)
+	{
+		goto fail_obj_index;
+	}
+
+	self->obj_list[MK_OBJECT_TYPE_TERRAIN] = cc_list_new();
+	if(self->obj_list[MK_OBJECT_TYPE_TERRAIN] == NULL)
+	{
+		goto fail_terrain_list;
+	}
+
+	self->obj_list[MK_OBJECT_TYPE_FLT] = cc_list_new();
+	if(self->obj_list[MK_OBJECT_TYPE_FLT] == NULL)
+	{
+		goto fail_flt_list;
+	}
 
-	LOGI("latT=%i, lonL=%i, latB=%i, lonR=%i, path=%s, total=%lf",
-	     latT, lonL, latB, lonR, path, self->total);
+	self->evict_index = mk_index_new();
+	if(self->evict_index == NULL)
+	{
+		goto fail_evict_index;
+	}
+
+	self->pending_index = mk_index_new();
+	if(self->pending_index == NULL)
+	{
+		goto fail_pending_index;
+	}
 
-	self->obj_map = cc_map_new();
-	if(self->obj_map == NULL)
+	self->null_index = mk_index_new();
+	if(self->null_index == NULL)
 	{
-		goto fail_obj_map;
+		goto fail_null_index;
 	}
 
-	self->obj_list = cc_list_new();
-	if(self->obj_list == NULL)
+	self->coverage = mk_coverage_new(path);
+	if(self->coverage == NULL)
 	{
-		goto fail_obj_list;
+		goto fail_coverage;
 	}
 
-	self->null_map = cc_map_new();
-	if(self->null_map == NULL)
+	// map the ASTERv3 extents up front rather than on the
+	// first import by a worker
+	if(mk_coverage_count(self->coverage,
+	                     FLT_TILE_TYPE_ASTERV3))
 	{
-		goto fail_null_map;
+		flt_extent_load();
 	}
 
 	// success
 	return self;
 
 	// failure
-	fail_null_map:
-		cc_list_delete(&self->obj_list);
-	fail_obj_list:
-		cc_map_delete(&self->obj_map);
-	fail_obj_map:
+	fail_coverage:
+		mk_index_delete(&self->null_index);
+	fail_null_index:
+		mk_index_delete(&self->pending_index);
+	fail_pending_index:
+		mk_index_delete(&self->evict_index);
+	fail_evict_index:
+		cc_list_delete(&self->obj_list[MK_OBJECT_TYPE_FLT]);
+	fail_flt_list:
+		cc_list_delete(&self->obj_list[MK_OBJECT_TYPE_TERRAIN]);
+	fail_terrain_list:
+		mk_index_delete(&self->obj_index);
+	fail_obj_index:
+		terrain_index_close(&self->index);
+		terrain_exporter_delete(&self->exporter);
+	fail_exporter:
+		terrain_pool_delete(&self->tile_pool);
+	fail_tile_pool:
+		pthread_cond_destroy(&self->cond);
+	fail_cond:
+		pthread_mutex_destroy(&self->mutex);
+	fail_mutex:
 		FREE(self);
 	return NULL;
 }
@@ -582,24 +1752,35 @@ void mk_state_delete(mk_state_t** _self)
 	mk_state_t* self = *_self;
 	if(self)
 	{
-		cc_mapIter_t* miter = cc_map_head(self->obj_map);
-		while(miter)
+		mk_state_stopPrefetch(self);
+		mk_state_release13(self, &self->worker);
+		mk_state_report(self);
+
+		int   idx = 0;
+		void* val;
+		while(mk_index_next(self->obj_index, &idx, NULL, &val))
 		{
-			cc_listIter_t* iter;
-			iter = (cc_listIter_t*)
-			       cc_map_val(miter);
+			cc_listIter_t* iter = (cc_listIter_t*) val;
 
 			mk_object_t* obj;
 			obj = (mk_object_t*) cc_list_peekIter(iter);
-			cc_list_remove(self->obj_list, &iter);
-			cc_map_remove(self->obj_map, &miter);
+			cc_list_remove(self->obj_list[obj->type], &iter);
 			mk_object_delete(&obj);
 		}
 
-		cc_map_discard(self->null_map);
-		cc_map_delete(&self->null_map);
-		cc_list_delete(&self->obj_list);
-		cc_map_delete(&self->obj_map);
+		flt_extent_unload();
+		mk_coverage_delete(&self->coverage);
+		mk_index_delete(&self->null_index);
+		mk_index_delete(&self->pending_index);
+		mk_index_delete(&self->evict_index);
+		cc_list_delete(&self->obj_list[MK_OBJECT_TYPE_FLT]);
+		cc_list_delete(&self->obj_list[MK_OBJECT_TYPE_TERRAIN]);
+		mk_index_delete(&self->obj_index);
+		terrain_index_close(&self->index);
+		terrain_exporter_delete(&self->exporter);
+		terrain_pool_delete(&self->tile_pool);
+		pthread_cond_destroy(&self->cond);
+		pthread_mutex_destroy(&self->mutex);
 		FREE(self);
 		*_self = NULL;
 	}
@@ -613,7 +1794,6 @@ void mk_state_put(mk_state_t* self, mk_object_t** _obj)
 	mk_object_t* obj = *_obj;
 	if(obj)
 	{
-		ASSERT(obj->type == MK_OBJECT_TYPE_TERRAIN);
 		mk_object_decref(obj);
 		*_obj = NULL;
 	}
@@ -625,214 +1805,208 @@ mk_state_getTerrain(mk_state_t* self,
 {
 	ASSERT(self);
 
-	// check range
-	int range = (int) pow(2.0, (double) zoom);
-	if((x < 0)      || (y < 0) ||
-	   (x >= range) || (y >= range))
-	{
-		return NULL;
-	}
-
-	// clip tile
-	double latT;
-	double lonL;
-	double latB;
-	double lonR;
-	terrain_bounds(x, y, zoom, &latT, &lonL, &latB, &lonR);
-	if((self->latT < latB) || (self->lonL > lonR) ||
-	   (self->latB > latT) || (self->lonR < lonL))
+	// the recursive build visits z13 tiles in an order
+	// which is close to the Morton order
+	if((zoom == 0) && (mk_state_startPrefetch(self, 1) == 0))
 	{
 		return NULL;
 	}
 
-	// check if the object is cached
 	mk_object_t* obj;
-	obj = mk_state_findTerrain(self, x, y, zoom);
-	if(obj)
+	obj = mk_state_fetchTerrain(self, &self->worker,
+	                            x, y, zoom);
+	mk_state_stopPrefetch(self);
+
+	return obj;
+}
+
+int mk_state_build13(mk_state_t* self, int nth,
+                     int order)
+{
+	ASSERT(self);
+	ASSERT(nth > 0);
+
+	int x0;
+	int y0;
+	int x1;
+	int y1;
+	mk_state_range13(self, &x0, &y0, &x1, &y1);
+
+	self->x13 = x0;
+	self->y13 = y0;
+	self->w13 = x1 - x0 + 1;
+	self->h13 = y1 - y0 + 1;
+
+	LOGI("nth=%i, order=%i, x13=%i, y13=%i, w13=%i, h13=%i",
+	     nth, order, self->x13, self->y13, self->w13, self->h13);
+
+	if(order == MK_STATE_ORDER_HILBERT)
 	{
-		mk_object_incref(obj);
-		if(zoom == 13)
+		if(mk_state_orderHilbert(self) == 0)
 		{
-			mk_state_trim13(self);
+			return 0;
 		}
-		return obj;
 	}
 
-	// check if the object is null
-	if(zoom <= 13)
+	self->workers = (mk_worker_t*)
+	                CALLOC(nth, sizeof(mk_worker_t));
+	if(self->workers == NULL)
 	{
-		if(cc_map_findf(self->null_map, "%i/%i/%i",
-		                zoom, x, y))
-		{
-			return NULL;
-		}
+		LOGE("CALLOC failed");
+		goto fail_workers;
 	}
 
-	// check if the object was created
-	// note: this z13 check isn't normally necessary however
-	// due to an unknown error while processing the terrainv2
-	// data these files cannot be trusted and must be
-	// recreated if the z13 level is not found
-	if(zoom <= 13)
+	mk_pool_t* pool;
+	pool = mk_pool_new(nth, (void*) self, mk_state_task13);
+	if(pool == NULL)
 	{
-		obj = mk_state_importTerrain(self, x, y, zoom);
-		if(obj)
-		{
-			mk_object_incref(obj);
-			if(zoom == 13)
-			{
-				mk_state_trim13(self);
-			}
-			return obj;
-		}
+		goto fail_pool;
 	}
 
-	// end recursion
-	if(zoom == 15)
+	if(mk_state_startPrefetch(self, 0) == 0)
 	{
-		return mk_state_make(self, x, y, zoom);
+		goto fail_prefetch;
 	}
-	else if(zoom == 13)
+
+	if(mk_pool_run(pool, self->w13*self->h13) == 0)
 	{
-		int prefetch = mk_state_prefetch13(self, x, y);
-		if(prefetch == 13)
-		{
-			obj = mk_state_make(self, x, y, zoom);
-			mk_state_trim13(self);
-			return obj;
-		}
-		else if(prefetch == 0)
-		{
-			cc_map_addf(self->null_map,
-			            (const void*) &self->null_val,
-			            "%i/%i/%i", zoom, x, y);
-			mk_state_trim13(self);
-			return NULL;
-		}
-		else
-		{
-			// otherwise get next LOD
-		}
+		goto fail_run;
 	}
 
-	// get surrounding tiles in the next zoom level
-	int r;
-	int c;
-	int idx;
-	int done = 1;
-	int xx = 2*x;
-	int yy = 2*y;
-	int zz = zoom + 1;
-	mk_object_t* next[16] =
-	{
-		NULL, NULL, NULL, NULL,
-		NULL, NULL, NULL, NULL,
-		NULL, NULL, NULL, NULL,
-		NULL, NULL, NULL, NULL,
-	};
-	for(r = 0; r < 4; ++r)
+	mk_state_stopPrefetch(self);
+	mk_pool_delete(&pool);
+	FREE(self->workers);
+	self->workers = NULL;
+	FREE(self->order13);
+	self->order13 = NULL;
+
+	// success
+	return 1;
+
+	// failure
+	fail_run:
+		mk_state_stopPrefetch(self);
+	fail_prefetch:
+		mk_pool_delete(&pool);
+	fail_pool:
+		FREE(self->workers);
+		self->workers = NULL;
+	fail_workers:
+		FREE(self->order13);
+		self->order13 = NULL;
+	return 0;
+}
+
+mk_object_t* mk_state_stream(mk_state_t* self)
+{
+	ASSERT(self);
+
+	int x0;
+	int y0;
+	int x1;
+	int y1;
+	mk_state_range13(self, &x0, &y0, &x1, &y1);
+
+	LOGI("x0=%i, y0=%i, x1=%i, y1=%i", x0, y0, x1, y1);
+
+	self->stream = mk_stream_new(x0, y0, x1, y1);
+	if(self->stream == NULL)
 	{
-		for(c = 0; c < 4; ++c)
-		{
-			idx = 4*r + c;
-			next[idx] = mk_state_getTerrain(self,
-			                                xx + c - 1,
-			                                yy + r - 1, zz);
-			if(next[idx])
-			{
-				done = 0;
-			}
-		}
+		return NULL;
 	}
 
-	// check if sampling can be performed
-	if(done)
+	// schedule the z0-z12 tiles
+	int x;
+	int y;
+	int zoom;
+	for(zoom = 12; zoom >= 0; --zoom)
 	{
-		if(zoom <= 13)
+		int s = 13 - zoom;
+		for(y = y0 >> s; y <= (y1 >> s); ++y)
 		{
-			cc_map_addf(self->null_map,
-			            (const void*) &self->null_val,
-			            "%i/%i/%i", zoom, x, y);
-			if(zoom == 13)
+			for(x = x0 >> s; x <= (x1 >> s); ++x)
 			{
-				mk_state_trim13(self);
+				if(mk_state_clip(self, x, y, zoom))
+				{
+					continue;
+				}
+
+				if(mk_stream_emit(self->stream,
+				                  zoom, x, y) == 0)
+				{
+					goto fail_emit;
+				}
 			}
 		}
-		return NULL;
 	}
 
-	// create a new object
-	cc_listIter_t* iter = NULL;
-	iter = mk_state_newTerrain(self, x, y, zoom);
-	if(iter == NULL)
+	if(mk_state_startPrefetch(self, 1) == 0)
 	{
-		return NULL;
+		goto fail_prefetch;
 	}
-	obj = (mk_object_t*) cc_list_peekIter(iter);
 
-	// sample the next LOD
-	mk_object_sample00(obj, next[0]);
-	mk_object_sample01(obj, next[1]);
-	mk_object_sample02(obj, next[2]);
-	mk_object_sample03(obj, next[3]);
-	mk_object_sample10(obj, next[4]);
-	mk_object_sample11(obj, next[5]);
-	mk_object_sample12(obj, next[6]);
-	mk_object_sample13(obj, next[7]);
-	mk_object_sample20(obj, next[8]);
-	mk_object_sample21(obj, next[9]);
-	mk_object_sample22(obj, next[10]);
-	mk_object_sample23(obj, next[11]);
-	mk_object_sample30(obj, next[12]);
-	mk_object_sample31(obj, next[13]);
-	mk_object_sample32(obj, next[14]);
-	mk_object_sample33(obj, next[15]);
+	// walk the z13 tiles and flush the remaining events
+	mk_state_walk(self, 0, 0, 0);
+	mk_state_stopPrefetch(self);
+	mk_state_drain(self, UINT64_MAX);
+	mk_stream_delete(&self->stream);
 
-	// export the object
-	if(mk_object_exportTerrain(obj, self->path) == 0)
-	{
-		goto fail_export;
-	}
+	return mk_state_fetchTerrain(self, &self->worker,
+	                             0, 0, 0);
 
-	// update refcounts
-	for(r = 0; r < 4; ++r)
+	// failure
+	fail_prefetch:
+	fail_emit:
+		mk_stream_delete(&self->stream);
+	return NULL;
+}
+
+int mk_state_finish(mk_state_t* self)
+{
+	ASSERT(self);
+
+	// wait for the background writes
+	if(self->exporter)
 	{
-		for(c = 0; c < 4; ++c)
-		{
-			idx = 4*r + c;
-			mk_state_put(self, &next[idx]);
-		}
+		return terrain_exporter_finish(self->exporter);
 	}
-	mk_object_incref(obj);
 
-	// trim cache
-	if(zoom == 13)
+	return terrain_index_flush(self->index);
+}
+
+void mk_state_enablePrefetch(mk_state_t* self,
+                             int lookahead)
+{
+	ASSERT(self);
+	ASSERT(lookahead > 0);
+
+	mk_prefetch_t* pf = &self->prefetch;
+	if(pf->state == MK_STATE_PREFETCH_OFF)
 	{
-		mk_state_trim13(self);
+		pf->state = MK_STATE_PREFETCH_READY;
 	}
+	pf->lookahead = lookahead;
+}
 
-	// success
-	return obj;
+void mk_state_enableLazyFlt(mk_state_t* self)
+{
+	ASSERT(self);
 
-	// failure
-	fail_export:
-	{
-		// put objects
-		for(r = 0; r < 4; ++r)
-		{
-			for(c = 0; c < 4; ++c)
-			{
-				idx = 4*r + c;
-				mk_state_put(self, &next[idx]);
-			}
-		}
-		mk_state_evictObject(self, &iter);
+	self->flt_lazy = 1;
+}
 
-		// trim cache
-		if(zoom == 13)
-		{
-			mk_state_trim13(self);
-		}
+int mk_state_setCodec(mk_state_t* self,
+                      int codec, int level, int filter)
+{
+	ASSERT(self);
+
+	// codecs and filters are only written by the exporter
+	if(self->exporter == NULL)
+	{
+		LOGE("codec requires writers");
+		return 0;
 	}
-	return NULL;
+
+	return terrain_exporter_setCodec(self->exporter,
+	                                 codec, level, filter);
 }
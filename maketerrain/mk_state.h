@@ -24,9 +24,97 @@
 #ifndef mk_state_H
 #define mk_state_H
 
+#include <pthread.h>
+#include <stdint.h>
+
 #include "libcc/cc_list.h"
-#include "libcc/cc_map.h"
+#include "terrain/terrain_exporter.h"
+#include "mk_coverage.h"
+#include "mk_index.h"
+#include "mk_mosaic.h"
 #include "mk_object.h"
+#include "mk_stream.h"
+
+// default cache budget in MB
+#define MK_STATE_BUDGET 4000
+
+// number of terrain tiles per slab in the tile pool
+#define MK_STATE_SLAB 16
+
+// number of tiles in flight per export thread
+#define MK_STATE_EXPORT_DEPTH 8
+
+// z13 scheduling order for mk_state_build13
+#define MK_STATE_ORDER_ROWMAJOR 0
+#define MK_STATE_ORDER_HILBERT  1
+
+// flt prefetcher state
+#define MK_STATE_PREFETCH_OFF     0
+#define MK_STATE_PREFETCH_READY   1
+#define MK_STATE_PREFETCH_RUNNING 2
+#define MK_STATE_PREFETCH_DONE    3
+
+// The prefetcher imports the flt neighborhoods of the
+// 1-degree cells ahead of the builder. The plan lists the
+// cells in the order they are first visited by the build
+// and when a z13 tile is built in a cell the next
+// lookahead cells in the plan are queued. Flt objects are
+// only prefetched while they fit in the cache budget.
+typedef struct
+{
+	int state;
+	int lookahead;
+
+	// cell grid (see mk_state_cell)
+	int cw;
+	int ch;
+
+	// plan of cells and the position of each cell
+	int  count;
+	int* plan;
+	int* pos;
+
+	// FIFO of cells to prefetch
+	// each cell is queued at most once
+	int  head;
+	int  tail;
+	int* queue;
+	int* queued;
+
+	pthread_t      thread;
+	pthread_cond_t cond;
+
+	// statistics
+	// wait is the time the builder waited for the
+	// prefetcher to finish an import
+	int    cells;
+	int    imports;
+	int    skipped;
+	double import;
+	double wait;
+} mk_prefetch_t;
+
+// per-thread build state
+typedef struct
+{
+	// flt object references for the current z13 tile
+	int cnt_usgs;
+	int cnt_aster;
+	mk_object_t* obj_usgs[9];
+	mk_object_t* obj_aster[9];
+
+	// mosaic of the flt objects
+	mk_mosaic_t mosaic;
+} mk_worker_t;
+
+// cache statistics per object type
+typedef struct
+{
+	uint64_t hits;
+	uint64_t misses;
+	uint64_t evictions;
+	uint64_t reimports;
+} mk_stats_t;
 
 typedef struct
 {
@@ -41,30 +129,98 @@ typedef struct
 
 	const char* path;
 
+	// cache lock
+	// cond is signaled when a pending object is resolved
+	pthread_mutex_t mutex;
+	pthread_cond_t  cond;
+
+	// recycled terrain tiles
+	terrain_pool_t* tile_pool;
+
+	// background tile writer (optional)
+	// tiles are appended to packs rather than terrainv2
+	// files when pack is set
+	int                 pack;
+	terrain_exporter_t* exporter;
+
+	// header index for tiles which are exported without
+	// the exporter
+	terrain_index_t* index;
+
 	// obj cache
-	cc_map_t*  obj_map;
-	cc_list_t* obj_list;
+	// LRU list per object type which allows terrain
+	// to be evicted before flt objects
+	mk_index_t* obj_index;
+	cc_list_t*  obj_list[MK_OBJECT_TYPE_COUNT];
 
-	// flt object references
-	// refcount is not needed because they
-	// are only created/evicted by z13
-	int cnt_usgs;
-	int cnt_aster;
-	mk_object_t* obj_usgs[9];
-	mk_object_t* obj_aster[9];
+	// cache budget and size in bytes
+	size_t budget;
+	size_t size[MK_OBJECT_TYPE_COUNT];
+
+	// cache statistics
+	// evict_index tracks evicted flt keys to detect
+	// reimports
+	mk_stats_t  stats[MK_OBJECT_TYPE_COUNT];
+	mk_index_t* evict_index;
+
+	// largest flt object in bytes
+	size_t flt_max;
+
+	// import flt objects with flt_tile_importLazy
+	int flt_lazy;
+
+	// objects which are being created by a thread
+	// objects being created by the prefetcher are marked
+	// with prefetch_val
+	mk_index_t* pending_index;
+	int         prefetch_val;
+
+	// flt prefetcher
+	mk_prefetch_t prefetch;
+
+	// worker for the calling thread
+	mk_worker_t worker;
+
+	// z13 range scheduled by mk_state_build13
+	// order13 maps tasks to the row-major index of the
+	// z13 tile in the range (optional)
+	int          x13;
+	int          y13;
+	int          w13;
+	int          h13;
+	int*         order13;
+	mk_worker_t* workers;
+
+	// event queue for mk_state_stream
+	mk_stream_t* stream;
 
 	// track null objects
-	int null_val;
-	cc_map_t* null_map;
+	int         null_val;
+	mk_index_t* null_index;
+
+	// flt source coverage
+	mk_coverage_t* coverage;
 } mk_state_t;
 
 mk_state_t*  mk_state_new(int latT, int lonL,
                           int latB, int lonR,
-                          const char* path);
+                          const char* path,
+                          size_t budget, int writers,
+                          int pack);
 void         mk_state_delete(mk_state_t** _self);
 void         mk_state_put(mk_state_t* self,
                           mk_object_t** _obj);
 mk_object_t* mk_state_getTerrain(mk_state_t* self,
                                  int x, int y, int zoom);
+int          mk_state_build13(mk_state_t* self, int nth,
+                              int order);
+mk_object_t* mk_state_stream(mk_state_t* self);
+int          mk_state_finish(mk_state_t* self);
+void         mk_state_enablePrefetch(mk_state_t* self,
+                                     int lookahead);
+void         mk_state_enableLazyFlt(mk_state_t* self);
+int          mk_state_setCodec(mk_state_t* self,
+                               int codec, int level,
+                               int filter);
 
 #endif
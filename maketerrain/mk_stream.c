@@ -0,0 +1,272 @@
+/*
+ * Copyright (c) 2020 Jeff Boody
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#include <stdlib.h>
+
+#define LOG_TAG "maketerrain"
+#include "libcc/cc_log.h"
+#include "libcc/cc_memory.h"
+#include "mk_stream.h"
+
+/***********************************************************
+* private                                                  *
+***********************************************************/
+
+static uint64_t mk_stream_morton(int x, int y)
+{
+	ASSERT(x >= 0);
+	ASSERT(y >= 0);
+
+	// interleave bits with x in the low bit
+	uint64_t m = 0;
+	int      i;
+	for(i = 0; i < 32; ++i)
+	{
+		m |= ((uint64_t) ((x >> i) & 1)) << (2*i);
+		m |= ((uint64_t) ((y >> i) & 1)) << (2*i + 1);
+	}
+	return m;
+}
+
+static int
+mk_stream_before(mk_streamEvent_t* a, mk_streamEvent_t* b)
+{
+	ASSERT(a);
+	ASSERT(b);
+
+	if(a->key != b->key)
+	{
+		return a->key < b->key;
+	}
+
+	// emit before release and emit children before parents
+	if(a->type != b->type)
+	{
+		return a->type < b->type;
+	}
+
+	return a->zoom > b->zoom;
+}
+
+static int
+mk_stream_push(mk_stream_t* self, int type,
+               int zoom, int x, int y)
+{
+	ASSERT(self);
+
+	if(self->count == self->size)
+	{
+		int size = self->size ? 2*self->size : 256;
+
+		mk_streamEvent_t* events;
+		events = (mk_streamEvent_t*)
+		         REALLOC(self->events,
+		                 size*sizeof(mk_streamEvent_t));
+		if(events == NULL)
+		{
+			LOGE("REALLOC failed");
+			return 0;
+		}
+
+		self->size   = size;
+		self->events = events;
+	}
+
+	mk_streamEvent_t e =
+	{
+		.key  = mk_stream_key(self, zoom, x, y),
+		.type = type,
+		.zoom = zoom,
+		.x    = x,
+		.y    = y,
+	};
+
+	// release events use the key of the last parent
+	if(type == MK_STREAM_EVENT_RELEASE)
+	{
+		e.key = mk_stream_key(self, zoom - 1,
+		                      (x + 1) >> 1, (y + 1) >> 1);
+	}
+
+	// sift up
+	int i = self->count;
+	while(i > 0)
+	{
+		int p = (i - 1)/2;
+		if(mk_stream_before(&self->events[p], &e))
+		{
+			break;
+		}
+		self->events[i] = self->events[p];
+		i = p;
+	}
+	self->events[i] = e;
+	++self->count;
+
+	return 1;
+}
+
+/***********************************************************
+* public                                                   *
+***********************************************************/
+
+mk_stream_t* mk_stream_new(int x0, int y0,
+                           int x1, int y1)
+{
+	ASSERT((x0 >= 0) && (x0 <= x1));
+	ASSERT((y0 >= 0) && (y0 <= y1));
+
+	mk_stream_t* self;
+	self = (mk_stream_t*) CALLOC(1, sizeof(mk_stream_t));
+	if(self == NULL)
+	{
+		LOGE("CALLOC failed");
+		return NULL;
+	}
+
+	self->x0 = x0;
+	self->y0 = y0;
+	self->x1 = x1;
+	self->y1 = y1;
+
+	return self;
+}
+
+void mk_stream_delete(mk_stream_t** _self)
+{
+	ASSERT(_self);
+
+	mk_stream_t* self = *_self;
+	if(self)
+	{
+		FREE(self->events);
+		FREE(self);
+		*_self = NULL;
+	}
+}
+
+uint64_t mk_stream_key(mk_stream_t* self,
+                       int zoom, int x, int y)
+{
+	ASSERT(self);
+
+	// z0-z12 tiles are complete after the last child
+	while(zoom < 13)
+	{
+		x = 2*x + 2;
+		y = 2*y + 2;
+		++zoom;
+	}
+
+	// z14-z15 tiles are needed until the last parent
+	while(zoom > 13)
+	{
+		x = (x + 1) >> 1;
+		y = (y + 1) >> 1;
+		--zoom;
+	}
+
+	// tiles outside the z13 range are never visited
+	if(x > self->x1)
+	{
+		x = self->x1;
+	}
+	if(y > self->y1)
+	{
+		y = self->y1;
+	}
+	if(x < 0)
+	{
+		x = 0;
+	}
+	if(y < 0)
+	{
+		y = 0;
+	}
+
+	return mk_stream_morton(x, y);
+}
+
+int mk_stream_emit(mk_stream_t* self,
+                   int zoom, int x, int y)
+{
+	ASSERT(self);
+	ASSERT(zoom < 13);
+
+	return mk_stream_push(self, MK_STREAM_EVENT_EMIT,
+	                      zoom, x, y);
+}
+
+int mk_stream_release(mk_stream_t* self,
+                      int zoom, int x, int y)
+{
+	ASSERT(self);
+	ASSERT(zoom > 0);
+
+	return mk_stream_push(self, MK_STREAM_EVENT_RELEASE,
+	                      zoom, x, y);
+}
+
+int mk_stream_pop(mk_stream_t* self, uint64_t key,
+                  mk_streamEvent_t* event)
+{
+	ASSERT(self);
+	ASSERT(event);
+
+	if((self->count == 0) || (self->events[0].key > key))
+	{
+		return 0;
+	}
+
+	*event = self->events[0];
+	--self->count;
+
+	// sift down
+	mk_streamEvent_t* e = &self->events[self->count];
+	int i = 0;
+	while(1)
+	{
+		int c = 2*i + 1;
+		if(c >= self->count)
+		{
+			break;
+		}
+
+		if((c + 1 < self->count) &&
+		   mk_stream_before(&self->events[c + 1],
+		                    &self->events[c]))
+		{
+			++c;
+		}
+
+		if(mk_stream_before(e, &self->events[c]))
+		{
+			break;
+		}
+		self->events[i] = self->events[c];
+		i = c;
+	}
+	self->events[i] = *e;
+
+	return 1;
+}
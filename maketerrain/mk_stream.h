@@ -0,0 +1,77 @@
+/*
+ * Copyright (c) 2020 Jeff Boody
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#ifndef mk_stream_H
+#define mk_stream_H
+
+#include <stdint.h>
+
+#define MK_STREAM_EVENT_EMIT    0
+#define MK_STREAM_EVENT_RELEASE 1
+
+typedef struct
+{
+	uint64_t key;
+	int      type;
+	int      zoom;
+	int      x;
+	int      y;
+} mk_streamEvent_t;
+
+// The stream visits z13 tiles in Morton order and uses
+// keys to schedule events relative to the walk. The key
+// of a z13 tile is its Morton index (clamped to the z13
+// range) and an event is processed once the walk reaches
+// its key.
+//
+// EMIT: a z0-z12 tile may be created once its last child
+// (2x+2,2y+2) has been created.
+// RELEASE: a tile may be discarded once its last parent
+// ((x+1)/2,(y+1)/2) has been created.
+typedef struct
+{
+	// z13 range
+	int x0;
+	int y0;
+	int x1;
+	int y1;
+
+	// event heap
+	int count;
+	int size;
+	mk_streamEvent_t* events;
+} mk_stream_t;
+
+mk_stream_t* mk_stream_new(int x0, int y0,
+                           int x1, int y1);
+void         mk_stream_delete(mk_stream_t** _self);
+uint64_t     mk_stream_key(mk_stream_t* self,
+                           int zoom, int x, int y);
+int          mk_stream_emit(mk_stream_t* self,
+                            int zoom, int x, int y);
+int          mk_stream_release(mk_stream_t* self,
+                               int zoom, int x, int y);
+int          mk_stream_pop(mk_stream_t* self, uint64_t key,
+                           mk_streamEvent_t* event);
+
+#endif
@@ -0,0 +1,321 @@
+/*
+ * Copyright (c) 2020 Jeff Boody
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LOG_TAG "terrain2pack"
+#include "libcc/cc_log.h"
+#include "libcc/cc_memory.h"
+#include "terrain/terrain_pack.h"
+#include "terrain/terrain_tile.h"
+
+// terrain2pack appends the terrainv2 files under base to
+// the terrainpack files under base (see terrain_pack)
+// the terrainv2 files are copied as-is and may be removed
+// once the packs are verified
+
+// maximum open packs
+#define TERRAIN2PACK_PACKS 128
+
+typedef struct
+{
+	char            fname[256];
+	terrain_pack_t* pack;
+	unsigned int    stamp;
+} terrain2pack_slot_t;
+
+static terrain2pack_slot_t slots[TERRAIN2PACK_PACKS];
+static unsigned int        slots_clock = 0;
+
+static terrain_pack_t* terrain2pack_pack(const char* fname)
+{
+	ASSERT(fname);
+
+	// find the open pack or the least recently used slot
+	int i;
+	int slot = 0;
+	for(i = 0; i < TERRAIN2PACK_PACKS; ++i)
+	{
+		if(slots[i].pack &&
+		   (strcmp(slots[i].fname, fname) == 0))
+		{
+			slots[i].stamp = ++slots_clock;
+			return slots[i].pack;
+		}
+
+		if(slots[i].stamp < slots[slot].stamp)
+		{
+			slot = i;
+		}
+	}
+
+	if(slots[slot].pack &&
+	   (terrain_pack_close(&slots[slot].pack) == 0))
+	{
+		LOGE("close %s failed", slots[slot].fname);
+		return NULL;
+	}
+
+	slots[slot].pack = terrain_pack_append(fname);
+	if(slots[slot].pack == NULL)
+	{
+		return NULL;
+	}
+
+	snprintf(slots[slot].fname, 256, "%s", fname);
+	slots[slot].stamp = ++slots_clock;
+	return slots[slot].pack;
+}
+
+static int terrain2pack_closeAll(void)
+{
+	int ret = 1;
+	int i;
+	for(i = 0; i < TERRAIN2PACK_PACKS; ++i)
+	{
+		if(slots[i].pack &&
+		   (terrain_pack_close(&slots[i].pack) == 0))
+		{
+			LOGE("close %s failed", slots[i].fname);
+			ret = 0;
+		}
+	}
+
+	return ret;
+}
+
+static int
+terrain2pack_tile(const char* base, const char* fname,
+                  int x, int y, int zoom,
+                  unsigned char** _buffer, size_t* _size)
+{
+	ASSERT(base);
+	ASSERT(fname);
+	ASSERT(_buffer);
+	ASSERT(_size);
+
+	FILE* f = fopen(fname, "r");
+	if(f == NULL)
+	{
+		LOGE("fopen %s failed", fname);
+		return 0;
+	}
+
+	// get file size including header
+	fseek(f, (long) 0, SEEK_END);
+	size_t size = (size_t) ftell(f);
+	rewind(f);
+
+	// the buffer is reused by every tile
+	if(size > *_size)
+	{
+		void* tmp = REALLOC(*_buffer, size);
+		if(tmp == NULL)
+		{
+			LOGE("REALLOC failed");
+			goto fail_buffer;
+		}
+		*_buffer = (unsigned char*) tmp;
+		*_size   = size;
+	}
+
+	if(fread(*_buffer, size, 1, f) != 1)
+	{
+		LOGE("fread %s failed", fname);
+		goto fail_read;
+	}
+
+	short min;
+	short max;
+	int   flags;
+	if(terrain_tile_headerb(*_buffer, (int) size,
+	                        &min, &max, &flags) == 0)
+	{
+		LOGE("invalid %s", fname);
+		goto fail_header;
+	}
+
+	char pname[256];
+	terrain_pack_name(base, x, y, zoom, pname);
+
+	terrain_pack_t* pack = terrain2pack_pack(pname);
+	if(pack == NULL)
+	{
+		goto fail_pack;
+	}
+
+	if(terrain_pack_put(pack, x, y, zoom, size,
+	                    *_buffer) == 0)
+	{
+		goto fail_put;
+	}
+
+	fclose(f);
+
+	// success
+	return 1;
+
+	// failure
+	fail_put:
+	fail_pack:
+	fail_header:
+	fail_read:
+	fail_buffer:
+		fclose(f);
+	return 0;
+}
+
+static int
+terrain2pack_dir(const char* dname, int* _value)
+{
+	ASSERT(dname);
+	ASSERT(_value);
+
+	// directories are named by a zoom or x coordinate
+	char* end = NULL;
+	*_value = (int) strtol(dname, &end, 10);
+	if((end == dname) || (*end != '\0'))
+	{
+		return 0;
+	}
+
+	return 1;
+}
+
+int main(int argc, char** argv)
+{
+	if(argc != 2)
+	{
+		LOGE("usage: %s [base]", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	const char* base = argv[1];
+
+	char rname[256];
+	snprintf(rname, 256, "%s/terrainv2", base);
+
+	// walk the terrainv2/zoom/x/y.terrain files
+	DIR* zdir = opendir(rname);
+	if(zdir == NULL)
+	{
+		LOGE("opendir %s failed", rname);
+		return EXIT_FAILURE;
+	}
+
+	int            zoom;
+	int            x;
+	int            y;
+	int            count  = 0;
+	size_t         size   = 0;
+	unsigned char* buffer = NULL;
+	struct dirent* zde;
+	while((zde = readdir(zdir)))
+	{
+		if(terrain2pack_dir(zde->d_name, &zoom) == 0)
+		{
+			continue;
+		}
+
+		char zname[256];
+		snprintf(zname, 256, "%s/%s", rname, zde->d_name);
+
+		DIR* xdir = opendir(zname);
+		if(xdir == NULL)
+		{
+			continue;
+		}
+
+		struct dirent* xde;
+		while((xde = readdir(xdir)))
+		{
+			if(terrain2pack_dir(xde->d_name, &x) == 0)
+			{
+				continue;
+			}
+
+			char xname[256];
+			snprintf(xname, 256, "%s/%s", zname, xde->d_name);
+
+			DIR* ydir = opendir(xname);
+			if(ydir == NULL)
+			{
+				continue;
+			}
+
+			struct dirent* yde;
+			while((yde = readdir(ydir)))
+			{
+				// tiles are named y.terrain
+				char tname[256];
+				if(sscanf(yde->d_name, "%d", &y) != 1)
+				{
+					continue;
+				}
+				snprintf(tname, 256, "%i.terrain", y);
+				if(strcmp(tname, yde->d_name) != 0)
+				{
+					continue;
+				}
+
+				char fname[256];
+				snprintf(fname, 256, "%s/%s", xname,
+				         yde->d_name);
+				if(terrain2pack_tile(base, fname, x, y, zoom,
+				                     &buffer, &size) == 0)
+				{
+					closedir(ydir);
+					closedir(xdir);
+					goto fail_tile;
+				}
+				++count;
+			}
+			closedir(ydir);
+		}
+		closedir(xdir);
+	}
+	closedir(zdir);
+
+	FREE(buffer);
+
+	if(terrain2pack_closeAll() == 0)
+	{
+		return EXIT_FAILURE;
+	}
+
+	LOGI("packed %i tiles", count);
+
+	// success
+	return EXIT_SUCCESS;
+
+	// failure
+	fail_tile:
+		closedir(zdir);
+		FREE(buffer);
+		terrain2pack_closeAll();
+	return EXIT_FAILURE;
+}
@@ -0,0 +1,693 @@
+/*
+ * Copyright (c) 2020 Jeff Boody
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+
+#ifdef TERRAIN_ZSTD
+	#include <zstd.h>
+#endif
+
+#ifdef TERRAIN_LZ4
+	#include <lz4.h>
+	#include <lz4hc.h>
+#endif
+
+#define LOG_TAG "terrain"
+#include "../libcc/cc_log.h"
+#include "terrain_codec.h"
+#include "terrain_tile.h"
+
+#define TERRAIN_CODEC_BYTES (TERRAIN_SAMPLES_TOTAL* \
+                             TERRAIN_SAMPLES_TOTAL* \
+                             sizeof(short))
+
+static const char* TERRAIN_CODEC_NAME[] =
+{
+	"deflate",
+	"raw",
+	"zstd",
+	"lz4",
+};
+
+// maximum level of each codec where 0 means the level is
+// ignored
+static const int TERRAIN_CODEC_LEVEL_MAX[] =
+{
+	9,
+	0,
+	19,
+	12,
+};
+
+static const char* TERRAIN_FILTER_NAME[] =
+{
+	"none",
+	"sub",
+	"up",
+	"paeth",
+	"med",
+};
+
+/***********************************************************
+* private                                                  *
+***********************************************************/
+
+static size_t
+terrain_codec_encodeDeflate(int level, const void* data,
+                            size_t size,
+                            unsigned char* buffer)
+{
+	ASSERT(data);
+	ASSERT(buffer);
+
+	// TERRAIN_CODEC_LEVEL_DEFAULT is Z_DEFAULT_COMPRESSION
+	// which matches the stream written by
+	// terrain_tile_export
+	z_stream strm;
+	memset(&strm, 0, sizeof(z_stream));
+	if(deflateInit(&strm, level) != Z_OK)
+	{
+		LOGE("deflateInit failed");
+		return 0;
+	}
+
+	strm.next_in   = (Bytef*) data;
+	strm.avail_in  = (uInt) TERRAIN_CODEC_BYTES;
+	strm.next_out  = (Bytef*) buffer;
+	strm.avail_out = (uInt) size;
+	if(deflate(&strm, Z_FINISH) != Z_STREAM_END)
+	{
+		LOGE("deflate failed");
+		deflateEnd(&strm);
+		return 0;
+	}
+
+	size_t bytes = (size_t) strm.total_out;
+	deflateEnd(&strm);
+
+	return bytes;
+}
+
+static size_t
+terrain_codec_encodeZstd(int level, const void* data,
+                         size_t size,
+                         unsigned char* buffer)
+{
+	ASSERT(data);
+	ASSERT(buffer);
+
+	#ifdef TERRAIN_ZSTD
+	if(level == TERRAIN_CODEC_LEVEL_DEFAULT)
+	{
+		level = ZSTD_CLEVEL_DEFAULT;
+	}
+
+	size_t bytes = ZSTD_compress(buffer, size, data,
+	                             TERRAIN_CODEC_BYTES,
+	                             level);
+	if(ZSTD_isError(bytes))
+	{
+		LOGE("ZSTD_compress failed: %s",
+		     ZSTD_getErrorName(bytes));
+		return 0;
+	}
+	return bytes;
+	#else
+	LOGE("zstd unsupported");
+	return 0;
+	#endif
+}
+
+static size_t
+terrain_codec_encodeLz4(int level, const void* data,
+                        size_t size,
+                        unsigned char* buffer)
+{
+	ASSERT(data);
+	ASSERT(buffer);
+
+	#ifdef TERRAIN_LZ4
+	int bytes;
+	if(level <= 1)
+	{
+		bytes = LZ4_compress_default((const char*) data,
+		                             (char*) buffer,
+		                             (int) TERRAIN_CODEC_BYTES,
+		                             (int) size);
+	}
+	else
+	{
+		bytes = LZ4_compress_HC((const char*) data,
+		                        (char*) buffer,
+		                        (int) TERRAIN_CODEC_BYTES,
+		                        (int) size, level);
+	}
+
+	if(bytes <= 0)
+	{
+		LOGE("LZ4_compress failed");
+		return 0;
+	}
+	return (size_t) bytes;
+	#else
+	LOGE("lz4 unsupported");
+	return 0;
+	#endif
+}
+
+static inline int
+terrain_codec_predict(int predictor, int a, int b, int c)
+{
+	if(predictor == TERRAIN_FILTER_SUB)
+	{
+		return a;
+	}
+	else if(predictor == TERRAIN_FILTER_UP)
+	{
+		return b;
+	}
+	else if(predictor == TERRAIN_FILTER_PAETH)
+	{
+		int pa = abs(b - c);
+		int pb = abs(a - c);
+		int pc = abs(a + b - 2*c);
+		if((pa <= pb) && (pa <= pc))
+		{
+			return a;
+		}
+		else if(pb <= pc)
+		{
+			return b;
+		}
+		return c;
+	}
+
+	// med selects min(a, b) or max(a, b) across an edge
+	// and the gradient a + b - c on smooth slopes which is
+	// the gradient clamped to the range of a and b
+	int lo = (a < b) ? a : b;
+	int hi = (a < b) ? b : a;
+	int p  = a + b - c;
+	p = (p < lo) ? lo : p;
+	p = (p > hi) ? hi : p;
+	return p;
+}
+
+static void
+terrain_codec_filterRow(int predictor, const short* up,
+                        const short* data,
+                        unsigned short* r)
+{
+	ASSERT(data);
+	ASSERT(r);
+
+	// residuals wrap modulo 2^16 so the filter is lossless
+	// for any input
+	int j;
+	int n = TERRAIN_SAMPLES_TOTAL;
+	if(predictor == TERRAIN_FILTER_NONE)
+	{
+		for(j = 0; j < n; ++j)
+		{
+			r[j] = (unsigned short) data[j];
+		}
+		return;
+	}
+	else if(up == NULL)
+	{
+		// the first row predicts a
+		r[0] = (unsigned short) data[0];
+		for(j = 1; j < n; ++j)
+		{
+			r[j] = (unsigned short) (data[j] - data[j - 1]);
+		}
+		return;
+	}
+
+	// the first column predicts b
+	r[0] = (unsigned short) (data[0] - up[0]);
+	for(j = 1; j < n; ++j)
+	{
+		r[j] = (unsigned short)
+		       (data[j] - terrain_codec_predict(predictor,
+		                                        data[j - 1],
+		                                        up[j],
+		                                        up[j - 1]));
+	}
+}
+
+static void
+terrain_codec_unfilterRow(int predictor, const short* up,
+                          const unsigned short* r,
+                          short* data)
+{
+	ASSERT(r);
+	ASSERT(data);
+
+	// samples are reconstructed in the order they were
+	// filtered so the neighbors are known when predicted
+	int j;
+	int n = TERRAIN_SAMPLES_TOTAL;
+	if(predictor == TERRAIN_FILTER_NONE)
+	{
+		for(j = 0; j < n; ++j)
+		{
+			data[j] = (short) r[j];
+		}
+		return;
+	}
+	else if(up == NULL)
+	{
+		data[0] = (short) r[0];
+		for(j = 1; j < n; ++j)
+		{
+			data[j] = (short) (unsigned short)
+			          (r[j] + data[j - 1]);
+		}
+		return;
+	}
+
+	data[0] = (short) (unsigned short) (r[0] + up[0]);
+	if(predictor == TERRAIN_FILTER_UP)
+	{
+		for(j = 1; j < n; ++j)
+		{
+			data[j] = (short) (unsigned short)
+			          (r[j] + up[j]);
+		}
+		return;
+	}
+
+	// a is carried in a register since the stores to data
+	// may alias up
+	int a = data[0];
+	for(j = 1; j < n; ++j)
+	{
+		a = (short) (unsigned short)
+		    (r[j] + terrain_codec_predict(predictor, a,
+		                                  up[j],
+		                                  up[j - 1]));
+		data[j] = (short) a;
+	}
+}
+
+/***********************************************************
+* public                                                   *
+***********************************************************/
+
+int terrain_codec_supported(int codec)
+{
+	if(codec == TERRAIN_CODEC_ZSTD)
+	{
+		#ifdef TERRAIN_ZSTD
+		return 1;
+		#else
+		return 0;
+		#endif
+	}
+	else if(codec == TERRAIN_CODEC_LZ4)
+	{
+		#ifdef TERRAIN_LZ4
+		return 1;
+		#else
+		return 0;
+		#endif
+	}
+
+	return (codec == TERRAIN_CODEC_DEFLATE) ||
+	       (codec == TERRAIN_CODEC_RAW);
+}
+
+const char* terrain_codec_name(int codec)
+{
+	if((codec < 0) || (codec >= TERRAIN_CODEC_COUNT))
+	{
+		return "invalid";
+	}
+
+	return TERRAIN_CODEC_NAME[codec];
+}
+
+int terrain_codec_validLevel(int codec, int level)
+{
+	if((codec < 0) || (codec >= TERRAIN_CODEC_COUNT))
+	{
+		return 0;
+	}
+
+	int max = TERRAIN_CODEC_LEVEL_MAX[codec];
+	if((level == TERRAIN_CODEC_LEVEL_DEFAULT) || (max == 0))
+	{
+		return 1;
+	}
+
+	return (level >= 1) && (level <= max);
+}
+
+int terrain_codec_parse(const char* str,
+                        int* codec, int* level)
+{
+	ASSERT(str);
+	ASSERT(codec);
+	ASSERT(level);
+
+	// NAME or NAME:LEVEL
+	const char* sep = strchr(str, ':');
+	size_t      len = sep ? (size_t) (sep - str) : strlen(str);
+
+	int i;
+	for(i = 0; i < TERRAIN_CODEC_COUNT; ++i)
+	{
+		if((strlen(TERRAIN_CODEC_NAME[i]) == len) &&
+		   (strncmp(TERRAIN_CODEC_NAME[i], str, len) == 0))
+		{
+			break;
+		}
+	}
+
+	if(i == TERRAIN_CODEC_COUNT)
+	{
+		LOGE("invalid codec=%s", str);
+		return 0;
+	}
+
+	if(terrain_codec_supported(i) == 0)
+	{
+		LOGE("unsupported codec=%s", str);
+		return 0;
+	}
+
+	int l = TERRAIN_CODEC_LEVEL_DEFAULT;
+	if(sep)
+	{
+		l = (int) strtol(&sep[1], NULL, 0);
+		if((l < 1) || (terrain_codec_validLevel(i, l) == 0))
+		{
+			LOGE("invalid codec=%s", str);
+			return 0;
+		}
+	}
+
+	*codec = i;
+	*level = l;
+	return 1;
+}
+
+size_t terrain_codec_bound(int codec)
+{
+	size_t bytes = TERRAIN_CODEC_BYTES;
+	if(codec == TERRAIN_CODEC_DEFLATE)
+	{
+		return (size_t) compressBound((uLong) bytes);
+	}
+	else if(codec == TERRAIN_CODEC_ZSTD)
+	{
+		#ifdef TERRAIN_ZSTD
+		return ZSTD_compressBound(bytes);
+		#endif
+	}
+	else if(codec == TERRAIN_CODEC_LZ4)
+	{
+		#ifdef TERRAIN_LZ4
+		return (size_t) LZ4_compressBound((int) bytes);
+		#endif
+	}
+
+	return bytes;
+}
+
+size_t terrain_codec_encode(int codec, int level,
+                            const void* data,
+                            size_t size,
+                            unsigned char* buffer)
+{
+	ASSERT(data);
+	ASSERT(buffer);
+
+	if(codec == TERRAIN_CODEC_DEFLATE)
+	{
+		return terrain_codec_encodeDeflate(level, data,
+		                                   size, buffer);
+	}
+	else if(codec == TERRAIN_CODEC_ZSTD)
+	{
+		return terrain_codec_encodeZstd(level, data,
+		                                size, buffer);
+	}
+	else if(codec == TERRAIN_CODEC_LZ4)
+	{
+		return terrain_codec_encodeLz4(level, data,
+		                               size, buffer);
+	}
+	else if(codec == TERRAIN_CODEC_RAW)
+	{
+		if(size < TERRAIN_CODEC_BYTES)
+		{
+			LOGE("invalid size=%i", (int) size);
+			return 0;
+		}
+
+		memcpy(buffer, data, TERRAIN_CODEC_BYTES);
+		return TERRAIN_CODEC_BYTES;
+	}
+
+	LOGE("invalid codec=%i", codec);
+	return 0;
+}
+
+int terrain_codec_decode(int codec,
+                         size_t size,
+                         const unsigned char* buffer,
+                         void* data)
+{
+	ASSERT(buffer);
+	ASSERT(data);
+
+	if(codec == TERRAIN_CODEC_DEFLATE)
+	{
+		uLong dst_size = (uLong) TERRAIN_CODEC_BYTES;
+		if(uncompress((Bytef*) data, &dst_size,
+		              (const Bytef*) buffer,
+		              (uLong) size) != Z_OK)
+		{
+			LOGE("fail uncompress");
+			return 0;
+		}
+
+		if(dst_size != (uLong) TERRAIN_CODEC_BYTES)
+		{
+			LOGE("invalid size=%i", (int) dst_size);
+			return 0;
+		}
+		return 1;
+	}
+	else if(codec == TERRAIN_CODEC_ZSTD)
+	{
+		#ifdef TERRAIN_ZSTD
+		size_t bytes = ZSTD_decompress(data,
+		                               TERRAIN_CODEC_BYTES,
+		                               buffer, size);
+		if(ZSTD_isError(bytes) ||
+		   (bytes != TERRAIN_CODEC_BYTES))
+		{
+			LOGE("fail ZSTD_decompress");
+			return 0;
+		}
+		return 1;
+		#endif
+	}
+	else if(codec == TERRAIN_CODEC_LZ4)
+	{
+		#ifdef TERRAIN_LZ4
+		int bytes = LZ4_decompress_safe((const char*) buffer,
+		                                (char*) data,
+		                                (int) size,
+		                                (int) TERRAIN_CODEC_BYTES);
+		if(bytes != (int) TERRAIN_CODEC_BYTES)
+		{
+			LOGE("fail LZ4_decompress_safe");
+			return 0;
+		}
+		return 1;
+		#endif
+	}
+	else if(codec == TERRAIN_CODEC_RAW)
+	{
+		if(size != TERRAIN_CODEC_BYTES)
+		{
+			LOGE("invalid size=%i", (int) size);
+			return 0;
+		}
+
+		memcpy(data, buffer, TERRAIN_CODEC_BYTES);
+		return 1;
+	}
+
+	LOGE("unsupported codec=%i", codec);
+	return 0;
+}
+
+int terrain_codec_validFilter(int filter)
+{
+	int predictor = filter & TERRAIN_FILTER_MASK;
+	if((filter & ~(TERRAIN_FILTER_MASK |
+	               TERRAIN_FILTER_PLANES)) ||
+	   (predictor >= TERRAIN_FILTER_COUNT))
+	{
+		return 0;
+	}
+
+	return 1;
+}
+
+int terrain_codec_parseFilter(const char* str, int* filter)
+{
+	ASSERT(str);
+	ASSERT(filter);
+
+	// NAME, NAME+planes or planes
+	if(strcmp(str, "planes") == 0)
+	{
+		*filter = TERRAIN_FILTER_PLANES;
+		return 1;
+	}
+
+	const char* sep = strchr(str, '+');
+	size_t      len = sep ? (size_t) (sep - str) : strlen(str);
+
+	int i;
+	for(i = 0; i < TERRAIN_FILTER_COUNT; ++i)
+	{
+		if((strlen(TERRAIN_FILTER_NAME[i]) == len) &&
+		   (strncmp(TERRAIN_FILTER_NAME[i], str, len) == 0))
+		{
+			break;
+		}
+	}
+
+	if(i == TERRAIN_FILTER_COUNT)
+	{
+		LOGE("invalid filter=%s", str);
+		return 0;
+	}
+
+	int f = i;
+	if(sep)
+	{
+		if(strcmp(&sep[1], "planes") != 0)
+		{
+			LOGE("invalid filter=%s", str);
+			return 0;
+		}
+		f |= TERRAIN_FILTER_PLANES;
+	}
+
+	*filter = f;
+	return 1;
+}
+
+void terrain_codec_filter(int filter,
+                          const short* data,
+                          unsigned char* residuals)
+{
+	ASSERT(data);
+	ASSERT(residuals);
+
+	int predictor = filter & TERRAIN_FILTER_MASK;
+	int n         = TERRAIN_SAMPLES_TOTAL;
+
+	unsigned short  row[TERRAIN_SAMPLES_TOTAL];
+	unsigned short* r16 = (unsigned short*) residuals;
+	unsigned char*  lo  = residuals;
+	unsigned char*  hi  = &residuals[n*n];
+
+	int i;
+	int j;
+	const short* up = NULL;
+	for(i = 0; i < n; ++i)
+	{
+		if(filter & TERRAIN_FILTER_PLANES)
+		{
+			terrain_codec_filterRow(predictor, up, data, row);
+			for(j = 0; j < n; ++j)
+			{
+				lo[j] = (unsigned char) (row[j] & 0xFF);
+				hi[j] = (unsigned char) (row[j] >> 8);
+			}
+			lo += n;
+			hi += n;
+		}
+		else
+		{
+			terrain_codec_filterRow(predictor, up, data, r16);
+			r16 += n;
+		}
+
+		up    = data;
+		data += n;
+	}
+}
+
+void terrain_codec_unfilter(int filter,
+                            const unsigned char* residuals,
+                            short* data)
+{
+	ASSERT(residuals);
+	ASSERT(data);
+
+	int predictor = filter & TERRAIN_FILTER_MASK;
+	int n         = TERRAIN_SAMPLES_TOTAL;
+
+	unsigned short        row[TERRAIN_SAMPLES_TOTAL];
+	const unsigned short* r16 = (const unsigned short*) residuals;
+	const unsigned char*  lo  = residuals;
+	const unsigned char*  hi  = &residuals[n*n];
+
+	int i;
+	int j;
+	const short* up = NULL;
+	for(i = 0; i < n; ++i)
+	{
+		if(filter & TERRAIN_FILTER_PLANES)
+		{
+			for(j = 0; j < n; ++j)
+			{
+				row[j] = (unsigned short) (lo[j] | (hi[j] << 8));
+			}
+			terrain_codec_unfilterRow(predictor, up, row, data);
+			lo += n;
+			hi += n;
+		}
+		else
+		{
+			terrain_codec_unfilterRow(predictor, up, r16, data);
+			r16 += n;
+		}
+
+		up    = data;
+		data += n;
+	}
+}
@@ -0,0 +1,97 @@
+/*
+ * Copyright (c) 2020 Jeff Boody
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+
+#ifndef terrain_codec_H
+#define terrain_codec_H
+
+#include <stddef.h>
+
+/*
+ * Codecs compress the samples of a tile. Deflate tiles
+ * are written with the v2 header for compatibility with
+ * existing readers while the other codecs are written with
+ * the v3 header which stores the codec (see terrain_tile).
+ *
+ * The zstd and lz4 codecs are optional and are enabled by
+ * building with TERRAIN_ZSTD and TERRAIN_LZ4 defined.
+ *
+ * The level selects the deflate level (1-9), the zstd
+ * level (1-19) or the lz4 mode (1 fast, 2-12 hc) and is
+ * ignored for raw samples. TERRAIN_CODEC_LEVEL_DEFAULT
+ * selects the default level of the codec.
+ */
+#define TERRAIN_CODEC_DEFLATE 0
+#define TERRAIN_CODEC_RAW     1
+#define TERRAIN_CODEC_ZSTD    2
+#define TERRAIN_CODEC_LZ4     3
+#define TERRAIN_CODEC_COUNT   4
+
+#define TERRAIN_CODEC_LEVEL_DEFAULT -1
+
+/*
+ * Filters are applied to the samples before compression
+ * and are reversed after decompression. The predictors
+ * store the difference between each sample and a
+ * prediction from the left (a), up (b) and up-left (c)
+ * samples. sub predicts a, up predicts b, paeth predicts
+ * the neighbor nearest to a + b - c and med predicts the
+ * median of a, b and a + b - c. The first row predicts a
+ * and the first column predicts b. The planes flag stores
+ * the low bytes of the residuals followed by the high
+ * bytes which are mostly 0x00 or 0xFF.
+ */
+#define TERRAIN_FILTER_NONE   0
+#define TERRAIN_FILTER_SUB    1
+#define TERRAIN_FILTER_UP     2
+#define TERRAIN_FILTER_PAETH  3
+#define TERRAIN_FILTER_MED    4
+#define TERRAIN_FILTER_COUNT  5
+#define TERRAIN_FILTER_MASK   0xFF
+#define TERRAIN_FILTER_PLANES 0x100
+
+int         terrain_codec_supported(int codec);
+const char* terrain_codec_name(int codec);
+int         terrain_codec_validLevel(int codec, int level);
+int         terrain_codec_parse(const char* str,
+                                int* codec, int* level);
+size_t      terrain_codec_bound(int codec);
+size_t      terrain_codec_encode(int codec, int level,
+                                 const void* data,
+                                 size_t size,
+                                 unsigned char* buffer);
+int         terrain_codec_decode(int codec,
+                                 size_t size,
+                                 const unsigned char* buffer,
+                                 void* data);
+int         terrain_codec_validFilter(int filter);
+int         terrain_codec_parseFilter(const char* str,
+                                      int* filter);
+void        terrain_codec_filter(int filter,
+                                 const short* data,
+                                 unsigned char* residuals);
+void        terrain_codec_unfilter(int filter,
+                                   const unsigned char* residuals,
+                                   short* data);
+
+#endif
@@ -0,0 +1,432 @@
+/*
+ * Copyright (c) 2020 Jeff Boody
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifdef TERRAIN_ZSTD
+	#include <zstd.h>
+#endif
+
+#define LOG_TAG "terrain"
+#include "../libcc/cc_log.h"
+#include "../libcc/cc_memory.h"
+#include "terrain_codec.h"
+#include "terrain_decoder.h"
+
+/***********************************************************
+* protected                                                *
+***********************************************************/
+
+extern int terrain_tile_headerc(const unsigned char* buffer,
+                                size_t size,
+                                short* min, short* max,
+                                int* flags, int* codec,
+                                int* filter, size_t* hsize);
+
+unsigned char*
+terrain_decoder_scratch(terrain_decoder_t* self,
+                        size_t size)
+{
+	ASSERT(self);
+
+	// the scratch buffer only grows so it is reused once
+	// it holds the largest tile
+	if(size > self->size)
+	{
+		unsigned char* buffer;
+		buffer = (unsigned char*)
+		         REALLOC(self->buffer, size);
+		if(buffer == NULL)
+		{
+			LOGE("REALLOC failed");
+			return NULL;
+		}
+
+		self->buffer = buffer;
+		self->size   = size;
+	}
+
+	return self->buffer;
+}
+
+/***********************************************************
+* private                                                  *
+***********************************************************/
+
+static int
+terrain_decoder_inflate(terrain_decoder_t* self,
+                        size_t size,
+                        const unsigned char* src,
+                        void* data)
+{
+	ASSERT(self);
+	ASSERT(src);
+	ASSERT(data);
+
+	// inflateReset reuses the window and state allocated
+	// by inflateInit rather than reallocating them for
+	// every tile like uncompress
+	if(inflateReset(&self->strm) != Z_OK)
+	{
+		LOGE("inflateReset failed");
+		return 0;
+	}
+
+	int bytes = TERRAIN_SAMPLES_TOTAL*
+	            TERRAIN_SAMPLES_TOTAL*
+	            sizeof(short);
+	self->strm.next_in   = (Bytef*) src;
+	self->strm.avail_in  = (uInt) size;
+	self->strm.next_out  = (Bytef*) data;
+	self->strm.avail_out = (uInt) bytes;
+	if(inflate(&self->strm, Z_FINISH) != Z_STREAM_END)
+	{
+		LOGE("fail inflate");
+		return 0;
+	}
+
+	// a short stream would leave the samples of the
+	// previous tile in the caller owned buffer
+	if(self->strm.avail_out != 0)
+	{
+		LOGE("invalid size=%i", (int) self->strm.total_out);
+		return 0;
+	}
+
+	return 1;
+}
+
+static int
+terrain_decoder_decompress(terrain_decoder_t* self,
+                           int codec, size_t size,
+                           const unsigned char* buffer,
+                           void* data)
+{
+	ASSERT(self);
+	ASSERT(buffer);
+	ASSERT(data);
+
+	if(codec == TERRAIN_CODEC_DEFLATE)
+	{
+		return terrain_decoder_inflate(self, size, buffer,
+		                               data);
+	}
+
+	#ifdef TERRAIN_ZSTD
+	if(codec == TERRAIN_CODEC_ZSTD)
+	{
+		size_t bytes = TERRAIN_SAMPLES_TOTAL*
+		               TERRAIN_SAMPLES_TOTAL*
+		               sizeof(short);
+		size_t ret   = ZSTD_decompressDCtx((ZSTD_DCtx*) self->zstd,
+		                                   data,
+		                                   bytes, buffer,
+		                                   size);
+		if(ZSTD_isError(ret) || (ret != bytes))
+		{
+			LOGE("fail ZSTD_decompressDCtx");
+			return 0;
+		}
+		return 1;
+	}
+	#endif
+
+	// the remaining codecs do not have a context
+	return terrain_codec_decode(codec, size, buffer, data);
+}
+
+/***********************************************************
+* public                                                   *
+***********************************************************/
+
+terrain_decoder_t* terrain_decoder_new(void)
+{
+	terrain_decoder_t* self;
+	self = (terrain_decoder_t*)
+	       CALLOC(1, sizeof(terrain_decoder_t));
+	if(self == NULL)
+	{
+		LOGE("CALLOC failed");
+		return NULL;
+	}
+
+	if(inflateInit(&self->strm) != Z_OK)
+	{
+		LOGE("inflateInit failed");
+		goto fail_init;
+	}
+
+	#ifdef TERRAIN_ZSTD
+	self->zstd = ZSTD_createDCtx();
+	if(self->zstd == NULL)
+	{
+		LOGE("ZSTD_createDCtx failed");
+		goto fail_zstd;
+	}
+	#endif
+
+	// success
+	return self;
+
+	// failure
+	#ifdef TERRAIN_ZSTD
+	fail_zstd:
+		inflateEnd(&self->strm);
+	#endif
+	fail_init:
+		FREE(self);
+	return NULL;
+}
+
+void terrain_decoder_delete(terrain_decoder_t** _self)
+{
+	ASSERT(_self);
+
+	terrain_decoder_t* self = *_self;
+	if(self)
+	{
+		#ifdef TERRAIN_ZSTD
+		ZSTD_freeDCtx((ZSTD_DCtx*) self->zstd);
+		#endif
+		inflateEnd(&self->strm);
+		FREE(self->residuals);
+		FREE(self->buffer);
+		FREE(self);
+		*_self = NULL;
+	}
+}
+
+int terrain_decoder_decode(terrain_decoder_t* self,
+                           size_t size,
+                           const unsigned char* buffer,
+                           short* data,
+                           short* min, short* max,
+                           int* flags)
+{
+	ASSERT(self);
+	ASSERT(buffer);
+	ASSERT(data);
+	ASSERT(min);
+	ASSERT(max);
+	ASSERT(flags);
+
+	int    codec;
+	int    filter;
+	size_t hsize;
+	if(terrain_tile_headerc(buffer, size, min, max, flags,
+	                        &codec, &filter, &hsize) == 0)
+	{
+		return 0;
+	}
+
+	size   -= hsize;
+	buffer += hsize;
+	if(filter == TERRAIN_FILTER_NONE)
+	{
+		return terrain_decoder_decompress(self, codec, size,
+		                                  buffer, data);
+	}
+
+	if(self->residuals == NULL)
+	{
+		self->residuals = (unsigned char*)
+		                  MALLOC(TERRAIN_SAMPLES_TOTAL*
+		                         TERRAIN_SAMPLES_TOTAL*
+		                         sizeof(short));
+		if(self->residuals == NULL)
+		{
+			LOGE("MALLOC failed");
+			return 0;
+		}
+	}
+
+	if(terrain_decoder_decompress(self, codec, size, buffer,
+	                              self->residuals) == 0)
+	{
+		return 0;
+	}
+
+	terrain_codec_unfilter(filter, self->residuals, data);
+	return 1;
+}
+
+int terrain_decoder_decodef(terrain_decoder_t* self,
+                            FILE* f, int size,
+                            short* data,
+                            short* min, short* max,
+                            int* flags)
+{
+	ASSERT(self);
+	ASSERT(f);
+	ASSERT(data);
+	ASSERT(min);
+	ASSERT(max);
+	ASSERT(flags);
+
+	if(size <= 0)
+	{
+		LOGE("invalid size=%i", size);
+		return 0;
+	}
+
+	unsigned char* src;
+	src = terrain_decoder_scratch(self, (size_t) size);
+	if(src == NULL)
+	{
+		return 0;
+	}
+
+	// read the header and samples
+	if(fread((void*) src, sizeof(char), size, f) != size)
+	{
+		LOGE("fread failed");
+		return 0;
+	}
+
+	return terrain_decoder_decode(self, (size_t) size, src,
+	                              data, min, max, flags);
+}
+
+int terrain_decoder_importd(terrain_decoder_t* self,
+                            size_t size,
+                            const unsigned char* buffer,
+                            int x, int y, int zoom,
+                            terrain_tile_t* tile)
+{
+	ASSERT(self);
+	ASSERT(buffer);
+	ASSERT(tile);
+
+	if(terrain_decoder_decode(self, size, buffer,
+	                          tile->data, &tile->min,
+	                          &tile->max, &tile->flags) == 0)
+	{
+		return 0;
+	}
+
+	tile->x    = x;
+	tile->y    = y;
+	tile->zoom = zoom;
+
+	return 1;
+}
+
+int terrain_decoder_importf(terrain_decoder_t* self,
+                            FILE* f, int size,
+                            int x, int y, int zoom,
+                            terrain_tile_t* tile)
+{
+	ASSERT(self);
+	ASSERT(f);
+	ASSERT(tile);
+
+	if(terrain_decoder_decodef(self, f, size,
+	                           tile->data, &tile->min,
+	                           &tile->max, &tile->flags) == 0)
+	{
+		return 0;
+	}
+
+	tile->x    = x;
+	tile->y    = y;
+	tile->zoom = zoom;
+
+	return 1;
+}
+
+int terrain_decoder_import(terrain_decoder_t* self,
+                           const char* base,
+                           int x, int y, int zoom,
+                           terrain_tile_t* tile)
+{
+	ASSERT(self);
+	ASSERT(base);
+	ASSERT(tile);
+
+	char fname[256];
+	snprintf(fname, 256, "%s/terrainv2/%i/%i/%i.terrain",
+	         base, zoom, x, y);
+
+	// read the file with a descriptor rather than a FILE
+	// to avoid allocating the stdio buffer
+	int fd = open(fname, O_RDONLY);
+	if(fd < 0)
+	{
+		LOGE("invalid %s", fname);
+		return 0;
+	}
+
+	struct stat st;
+	if(fstat(fd, &st) != 0)
+	{
+		LOGE("fstat failed");
+		goto fail_stat;
+	}
+
+	size_t size = (size_t) st.st_size;
+	unsigned char* buffer;
+	buffer = terrain_decoder_scratch(self, size);
+	if(buffer == NULL)
+	{
+		goto fail_scratch;
+	}
+
+	size_t offset = 0;
+	while(offset < size)
+	{
+		ssize_t bytes = read(fd, buffer + offset,
+		                     size - offset);
+		if(bytes <= 0)
+		{
+			LOGE("read failed");
+			goto fail_read;
+		}
+		offset += (size_t) bytes;
+	}
+
+	if(terrain_decoder_importd(self, size, buffer,
+	                           x, y, zoom, tile) == 0)
+	{
+		goto fail_import;
+	}
+
+	close(fd);
+
+	// success
+	return 1;
+
+	// failure
+	fail_import:
+	fail_read:
+	fail_scratch:
+	fail_stat:
+		close(fd);
+	return 0;
+}
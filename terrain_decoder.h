@@ -0,0 +1,87 @@
+/*
+ * Copyright (c) 2020 Jeff Boody
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+
+#ifndef terrain_decoder_H
+#define terrain_decoder_H
+
+#include <stdio.h>
+#include <zlib.h>
+
+#include "terrain_tile.h"
+
+/*
+ * The decoder inflates terrainv2 tiles directly into a
+ * caller owned terrain_tile_t or short[259*259] sample
+ * buffer. The z_stream, the zstd context and the scratch
+ * buffer used to read compressed samples from files are
+ * reused between tiles so the steady state decode path
+ * does not allocate. Tiles compressed with any codec and
+ * filter (see terrain_codec) are decoded. Filtered tiles
+ * are decompressed into the residuals buffer which is
+ * allocated by the first filtered tile. A decoder is not
+ * thread safe and should be created once per thread.
+ */
+typedef struct
+{
+	z_stream strm;
+
+	// ZSTD_DCtx when built with TERRAIN_ZSTD
+	void* zstd;
+
+	// scratch buffer for compressed samples
+	size_t         size;
+	unsigned char* buffer;
+
+	// residuals of filtered tiles
+	unsigned char* residuals;
+} terrain_decoder_t;
+
+terrain_decoder_t* terrain_decoder_new(void);
+void               terrain_decoder_delete(terrain_decoder_t** _self);
+int                terrain_decoder_decode(terrain_decoder_t* self,
+                                          size_t size,
+                                          const unsigned char* buffer,
+                                          short* data,
+                                          short* min, short* max,
+                                          int* flags);
+int                terrain_decoder_decodef(terrain_decoder_t* self,
+                                           FILE* f, int size,
+                                           short* data,
+                                           short* min, short* max,
+                                           int* flags);
+int                terrain_decoder_importd(terrain_decoder_t* self,
+                                           size_t size,
+                                           const unsigned char* buffer,
+                                           int x, int y, int zoom,
+                                           terrain_tile_t* tile);
+int                terrain_decoder_importf(terrain_decoder_t* self,
+                                           FILE* f, int size,
+                                           int x, int y, int zoom,
+                                           terrain_tile_t* tile);
+int                terrain_decoder_import(terrain_decoder_t* self,
+                                          const char* base,
+                                          int x, int y, int zoom,
+                                          terrain_tile_t* tile);
+
+#endif
@@ -0,0 +1,726 @@
+/*
+ * Copyright (c) 2020 Jeff Boody
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define LOG_TAG "terrain"
+#include "../libcc/cc_log.h"
+#include "../libcc/cc_memory.h"
+#include "terrain_exporter.h"
+
+/***********************************************************
+* protected                                                *
+***********************************************************/
+
+extern int    terrain_tile_export(terrain_tile_t* self,
+                                  const char* base);
+extern size_t terrain_tile_exportd(terrain_tile_t* self,
+                                   int codec, int level,
+                                   int filter, size_t size,
+                                   unsigned char* buffer);
+extern int    terrain_tile_exportb(terrain_tile_t* self,
+                                   const char* base,
+                                   size_t size,
+                                   const unsigned char* buffer);
+extern size_t terrain_tile_bound(void);
+extern void   terrain_tile_updateMinMax(terrain_tile_t* self);
+extern int    terrain_tile_readf(terrain_tile_t* self,
+                                 FILE* f, int size,
+                                 int x, int y, int zoom);
+
+/***********************************************************
+* private                                                  *
+***********************************************************/
+
+static int
+terrain_exporter_pending(terrain_exporter_t* self,
+                         int x, int y, int zoom)
+{
+	ASSERT(self);
+
+	// the mutex must be locked
+	int i;
+	for(i = 0; i < self->depth; ++i)
+	{
+		terrain_tile_t* tile = &self->tiles[i];
+		if((self->state[i] != TERRAIN_EXPORTER_SLOT_FREE) &&
+		   (tile->x == x) && (tile->y == y) &&
+		   (tile->zoom == zoom))
+		{
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+static int
+terrain_exporter_acquire(terrain_exporter_t* self,
+                         const char* fname, int create)
+{
+	ASSERT(self);
+	ASSERT(fname);
+
+	// the mutex must be locked
+	int i;
+	while(1)
+	{
+		// find the open pack or the free/idle slot
+		int slot = -1;
+		for(i = 0; i < TERRAIN_EXPORTER_PACKS; ++i)
+		{
+			if(self->packs[i] == NULL)
+			{
+				if(slot < 0)
+				{
+					slot = i;
+				}
+				continue;
+			}
+
+			if(strcmp(self->pack_fname[i], fname) == 0)
+			{
+				++self->pack_refcount[i];
+				self->pack_stamp[i] = ++self->pack_clock;
+				return i;
+			}
+
+			if(self->pack_refcount[i])
+			{
+				continue;
+			}
+
+			if((slot < 0) ||
+			   (self->packs[slot] &&
+			    (self->pack_stamp[i] < self->pack_stamp[slot])))
+			{
+				slot = i;
+			}
+		}
+
+		// readers do not create packs
+		if((create == 0) && (access(fname, F_OK) != 0))
+		{
+			return -1;
+		}
+
+		if(slot < 0)
+		{
+			pthread_cond_wait(&self->cond_free, &self->mutex);
+			continue;
+		}
+
+		// close the least recently used idle pack
+		if(self->packs[slot] &&
+		   (terrain_pack_close(&self->packs[slot]) == 0))
+		{
+			LOGE("close %s failed", self->pack_fname[slot]);
+			self->error = 1;
+		}
+
+		self->packs[slot] = terrain_pack_append(fname);
+		if(self->packs[slot] == NULL)
+		{
+			return -1;
+		}
+
+		snprintf(self->pack_fname[slot], 256, "%s", fname);
+		self->pack_refcount[slot] = 1;
+		self->pack_stamp[slot]    = ++self->pack_clock;
+		return slot;
+	}
+}
+
+static void
+terrain_exporter_release(terrain_exporter_t* self, int slot)
+{
+	ASSERT(self);
+
+	// the mutex must be locked
+	--self->pack_refcount[slot];
+	pthread_cond_broadcast(&self->cond_free);
+}
+
+static int terrain_exporter_closePacks(terrain_exporter_t* self)
+{
+	ASSERT(self);
+
+	// the mutex must be locked
+	int ret = 1;
+	int i;
+	for(i = 0; i < TERRAIN_EXPORTER_PACKS; ++i)
+	{
+		if(self->packs[i] && (self->pack_refcount[i] == 0) &&
+		   (terrain_pack_close(&self->packs[i]) == 0))
+		{
+			LOGE("close %s failed", self->pack_fname[i]);
+			ret = 0;
+		}
+	}
+
+	return ret;
+}
+
+static int
+terrain_exporter_exportPack(terrain_exporter_t* self,
+                            terrain_tile_t* tile,
+                            size_t size,
+                            unsigned char* buffer)
+{
+	ASSERT(self);
+	ASSERT(tile);
+
+	if(buffer == NULL)
+	{
+		return 0;
+	}
+
+	// compress outside of the pack
+	size = terrain_tile_exportd(tile, self->codec, self->level,
+	                            self->filter, size, buffer);
+	if(size == 0)
+	{
+		return 0;
+	}
+
+	char fname[256];
+	terrain_pack_name(self->base, tile->x, tile->y,
+	                  tile->zoom, fname);
+
+	pthread_mutex_lock(&self->mutex);
+	int slot = terrain_exporter_acquire(self, fname, 1);
+	pthread_mutex_unlock(&self->mutex);
+	if(slot < 0)
+	{
+		return 0;
+	}
+
+	int ret = terrain_pack_put(self->packs[slot],
+	                           tile->x, tile->y, tile->zoom,
+	                           size, buffer);
+
+	pthread_mutex_lock(&self->mutex);
+	terrain_exporter_release(self, slot);
+	pthread_mutex_unlock(&self->mutex);
+
+	return ret;
+}
+
+static int
+terrain_exporter_exportFile(terrain_exporter_t* self,
+                            terrain_tile_t* tile,
+                            size_t size,
+                            unsigned char* buffer)
+{
+	ASSERT(self);
+	ASSERT(tile);
+
+	// the default codec is streamed to the file
+	if((self->codec  == TERRAIN_CODEC_DEFLATE)       &&
+	   (self->level  == TERRAIN_CODEC_LEVEL_DEFAULT) &&
+	   (self->filter == TERRAIN_FILTER_NONE))
+	{
+		return terrain_tile_export(tile, self->base);
+	}
+
+	if(buffer == NULL)
+	{
+		return 0;
+	}
+
+	size = terrain_tile_exportd(tile, self->codec, self->level,
+	                            self->filter, size, buffer);
+	if(size == 0)
+	{
+		return 0;
+	}
+
+	return terrain_tile_exportb(tile, self->base, size, buffer);
+}
+
+static void* terrain_exporter_thread(void* arg)
+{
+	ASSERT(arg);
+
+	terrain_exporter_t* self = (terrain_exporter_t*) arg;
+
+	// compressed tiles are staged in a per-thread buffer
+	// which is allocated by the first export since the
+	// codec may be set after the threads are started
+	size_t         size   = terrain_tile_bound();
+	unsigned char* buffer = NULL;
+
+	pthread_mutex_lock(&self->mutex);
+	while(1)
+	{
+		while(self->running && (self->queue_count == 0))
+		{
+			pthread_cond_wait(&self->cond_queue, &self->mutex);
+		}
+
+		if(self->queue_count == 0)
+		{
+			// not running
+			break;
+		}
+
+		int slot = self->queue[self->queue_head];
+		self->queue_head = (self->queue_head + 1)%self->depth;
+		--self->queue_count;
+		self->state[slot] = TERRAIN_EXPORTER_SLOT_WRITING;
+		pthread_mutex_unlock(&self->mutex);
+
+		if((buffer == NULL) &&
+		   (self->pack ||
+		    (self->codec  != TERRAIN_CODEC_DEFLATE)       ||
+		    (self->level  != TERRAIN_CODEC_LEVEL_DEFAULT) ||
+		    (self->filter != TERRAIN_FILTER_NONE)))
+		{
+			buffer = (unsigned char*) MALLOC(size);
+			if(buffer == NULL)
+			{
+				LOGE("MALLOC failed");
+			}
+		}
+
+		int ret;
+		if(self->pack)
+		{
+			ret = terrain_exporter_exportPack(self,
+			                                  &self->tiles[slot],
+			                                  size, buffer);
+		}
+		else
+		{
+			ret = terrain_exporter_exportFile(self,
+			                                  &self->tiles[slot],
+			                                  size, buffer);
+		}
+
+		pthread_mutex_lock(&self->mutex);
+		if(ret == 0)
+		{
+			self->error = 1;
+		}
+		self->state[slot] = TERRAIN_EXPORTER_SLOT_FREE;
+		self->free_list[self->free_count] = slot;
+		++self->free_count;
+		pthread_cond_broadcast(&self->cond_free);
+	}
+	pthread_mutex_unlock(&self->mutex);
+
+	FREE(buffer);
+
+	return NULL;
+}
+
+static void terrain_exporter_stop(terrain_exporter_t* self,
+                                  int started)
+{
+	ASSERT(self);
+
+	pthread_mutex_lock(&self->mutex);
+	self->running = 0;
+	pthread_cond_broadcast(&self->cond_queue);
+	pthread_mutex_unlock(&self->mutex);
+
+	int i;
+	for(i = 0; i < started; ++i)
+	{
+		pthread_join(self->threads[i], NULL);
+	}
+}
+
+static terrain_exporter_t*
+terrain_exporter_init(const char* base, int nth, int depth,
+                      int pack)
+{
+	ASSERT(base);
+	ASSERT(nth > 0);
+	ASSERT(depth > 0);
+
+	terrain_exporter_t* self;
+	self = (terrain_exporter_t*)
+	       CALLOC(1, sizeof(terrain_exporter_t));
+	if(self == NULL)
+	{
+		LOGE("CALLOC failed");
+		return NULL;
+	}
+
+	snprintf(self->base, 256, "%s", base);
+	self->depth   = depth;
+	self->nth     = nth;
+	self->running = 1;
+	self->pack    = pack;
+	self->codec   = TERRAIN_CODEC_DEFLATE;
+	self->level   = TERRAIN_CODEC_LEVEL_DEFAULT;
+	self->filter  = TERRAIN_FILTER_NONE;
+
+	self->state = (int*) CALLOC(depth, sizeof(int));
+	if(self->state == NULL)
+	{
+		LOGE("CALLOC failed");
+		goto fail_state;
+	}
+
+	self->tiles = (terrain_tile_t*)
+	              MALLOC(depth*sizeof(terrain_tile_t));
+	if(self->tiles == NULL)
+	{
+		LOGE("MALLOC failed");
+		goto fail_tiles;
+	}
+
+	self->free_list = (int*) CALLOC(depth, sizeof(int));
+	if(self->free_list == NULL)
+	{
+		LOGE("CALLOC failed");
+		goto fail_free_list;
+	}
+
+	self->queue = (int*) CALLOC(depth, sizeof(int));
+	if(self->queue == NULL)
+	{
+		LOGE("CALLOC failed");
+		goto fail_queue;
+	}
+
+	self->threads = (pthread_t*)
+	                CALLOC(nth, sizeof(pthread_t));
+	if(self->threads == NULL)
+	{
+		LOGE("CALLOC failed");
+		goto fail_threads;
+	}
+
+	self->index = terrain_index_append(base);
+	if(self->index == NULL)
+	{
+		goto fail_index;
+	}
+
+	int i;
+	for(i = 0; i < depth; ++i)
+	{
+		self->free_list[i] = depth - i - 1;
+	}
+	self->free_count = depth;
+
+	if(pthread_mutex_init(&self->mutex, NULL) != 0)
+	{
+		LOGE("pthread_mutex_init failed");
+		goto fail_mutex;
+	}
+
+	if(pthread_cond_init(&self->cond_free, NULL) != 0)
+	{
+		LOGE("pthread_cond_init failed");
+		goto fail_cond_free;
+	}
+
+	if(pthread_cond_init(&self->cond_queue, NULL) != 0)
+	{
+		LOGE("pthread_cond_init failed");
+		goto fail_cond_queue;
+	}
+
+	int started;
+	for(started = 0; started < nth; ++started)
+	{
+		if(pthread_create(&self->threads[started], NULL,
+		                  terrain_exporter_thread,
+		                  (void*) self) != 0)
+		{
+			LOGE("pthread_create failed");
+			goto fail_thread;
+		}
+	}
+
+	// success
+	return self;
+
+	// failure
+	fail_thread:
+		terrain_exporter_stop(self, started);
+		pthread_cond_destroy(&self->cond_queue);
+	fail_cond_queue:
+		pthread_cond_destroy(&self->cond_free);
+	fail_cond_free:
+		pthread_mutex_destroy(&self->mutex);
+	fail_mutex:
+		terrain_index_close(&self->index);
+	fail_index:
+		FREE(self->threads);
+	fail_threads:
+		FREE(self->queue);
+	fail_queue:
+		FREE(self->free_list);
+	fail_free_list:
+		FREE(self->tiles);
+	fail_tiles:
+		FREE(self->state);
+	fail_state:
+		FREE(self);
+	return NULL;
+}
+
+/***********************************************************
+* public                                                   *
+***********************************************************/
+
+terrain_exporter_t*
+terrain_exporter_new(const char* base, int nth, int depth)
+{
+	return terrain_exporter_init(base, nth, depth, 0);
+}
+
+terrain_exporter_t*
+terrain_exporter_newPack(const char* base, int nth, int depth)
+{
+	return terrain_exporter_init(base, nth, depth, 1);
+}
+
+void terrain_exporter_delete(terrain_exporter_t** _self)
+{
+	ASSERT(_self);
+
+	terrain_exporter_t* self = *_self;
+	if(self)
+	{
+		// queued tiles are written before the threads exit
+		terrain_exporter_stop(self, self->nth);
+		if(terrain_exporter_closePacks(self) == 0)
+		{
+			self->error = 1;
+		}
+		if(terrain_index_close(&self->index) == 0)
+		{
+			self->error = 1;
+		}
+		if(self->error)
+		{
+			LOGW("export failed");
+		}
+
+		pthread_cond_destroy(&self->cond_queue);
+		pthread_cond_destroy(&self->cond_free);
+		pthread_mutex_destroy(&self->mutex);
+		FREE(self->threads);
+		FREE(self->queue);
+		FREE(self->free_list);
+		FREE(self->tiles);
+		FREE(self->state);
+		FREE(self);
+		*_self = NULL;
+	}
+}
+
+int terrain_exporter_setCodec(terrain_exporter_t* self,
+                              int codec, int level,
+                              int filter)
+{
+	ASSERT(self);
+
+	if(terrain_codec_supported(codec) == 0)
+	{
+		LOGE("unsupported codec=%i", codec);
+		return 0;
+	}
+
+	if(terrain_codec_validLevel(codec, level) == 0)
+	{
+		LOGE("invalid codec=%s, level=%i",
+		     terrain_codec_name(codec), level);
+		return 0;
+	}
+
+	if(terrain_codec_validFilter(filter) == 0)
+	{
+		LOGE("invalid filter=0x%X", filter);
+		return 0;
+	}
+
+	pthread_mutex_lock(&self->mutex);
+	self->codec  = codec;
+	self->level  = level;
+	self->filter = filter;
+	pthread_mutex_unlock(&self->mutex);
+
+	return 1;
+}
+
+int terrain_exporter_export(terrain_exporter_t* self,
+                            terrain_tile_t* tile)
+{
+	ASSERT(self);
+	ASSERT(tile);
+
+	// update min/max sample heights since the caller may
+	// depend on the min/max after export
+	terrain_tile_updateMinMax(tile);
+
+	// wait for a free slot and for a previous export of
+	// the same tile which would share the part file
+	pthread_mutex_lock(&self->mutex);
+	while((self->error == 0) &&
+	      ((self->free_count == 0) ||
+	       terrain_exporter_pending(self, tile->x, tile->y,
+	                                tile->zoom)))
+	{
+		pthread_cond_wait(&self->cond_free, &self->mutex);
+	}
+
+	if(self->error)
+	{
+		pthread_mutex_unlock(&self->mutex);
+		return 0;
+	}
+
+	--self->free_count;
+	int slot = self->free_list[self->free_count];
+	pthread_mutex_unlock(&self->mutex);
+
+	if(terrain_index_put(self->index, tile->x, tile->y,
+	                     tile->zoom, tile->min, tile->max,
+	                     tile->flags) == 0)
+	{
+		goto fail_index;
+	}
+
+	// the slot is owned by the caller until queued
+	memcpy(&self->tiles[slot], tile, sizeof(terrain_tile_t));
+
+	pthread_mutex_lock(&self->mutex);
+	int tail = (self->queue_head + self->queue_count)%
+	           self->depth;
+	self->queue[tail] = slot;
+	++self->queue_count;
+	self->state[slot] = TERRAIN_EXPORTER_SLOT_QUEUED;
+	pthread_cond_signal(&self->cond_queue);
+	pthread_mutex_unlock(&self->mutex);
+
+	// success
+	return 1;
+
+	// failure
+	fail_index:
+		pthread_mutex_lock(&self->mutex);
+		self->free_list[self->free_count] = slot;
+		++self->free_count;
+		pthread_cond_broadcast(&self->cond_free);
+		pthread_mutex_unlock(&self->mutex);
+	return 0;
+}
+
+int terrain_exporter_sync(terrain_exporter_t* self,
+                          int x, int y, int zoom)
+{
+	ASSERT(self);
+
+	pthread_mutex_lock(&self->mutex);
+	while(terrain_exporter_pending(self, x, y, zoom))
+	{
+		pthread_cond_wait(&self->cond_free, &self->mutex);
+	}
+	int error = self->error;
+	pthread_mutex_unlock(&self->mutex);
+
+	return error ? 0 : 1;
+}
+
+int terrain_exporter_read(terrain_exporter_t* self,
+                          int x, int y, int zoom,
+                          terrain_tile_t* tile)
+{
+	ASSERT(self);
+	ASSERT(tile);
+
+	char fname[256];
+	if(self->pack)
+	{
+		terrain_pack_name(self->base, x, y, zoom, fname);
+
+		pthread_mutex_lock(&self->mutex);
+		int slot = terrain_exporter_acquire(self, fname, 0);
+		pthread_mutex_unlock(&self->mutex);
+		if(slot < 0)
+		{
+			return 0;
+		}
+
+		int ret = terrain_pack_read(self->packs[slot],
+		                            x, y, zoom, tile);
+
+		pthread_mutex_lock(&self->mutex);
+		terrain_exporter_release(self, slot);
+		pthread_mutex_unlock(&self->mutex);
+
+		return ret;
+	}
+
+	snprintf(fname, 256, "%s/terrainv2/%i/%i/%i.terrain",
+	         self->base, zoom, x, y);
+
+	FILE* f = fopen(fname, "r");
+	if(f == NULL)
+	{
+		return 0;
+	}
+
+	// get file size including header
+	fseek(f, (long) 0, SEEK_END);
+	int size = (int) ftell(f);
+	rewind(f);
+
+	int ret = terrain_tile_readf(tile, f, size, x, y, zoom);
+	fclose(f);
+
+	return ret;
+}
+
+int terrain_exporter_finish(terrain_exporter_t* self)
+{
+	ASSERT(self);
+
+	pthread_mutex_lock(&self->mutex);
+	while(self->free_count < self->depth)
+	{
+		pthread_cond_wait(&self->cond_free, &self->mutex);
+	}
+	if(terrain_exporter_closePacks(self) == 0)
+	{
+		self->error = 1;
+	}
+	if(terrain_index_flush(self->index) == 0)
+	{
+		self->error = 1;
+	}
+	int error = self->error;
+	pthread_mutex_unlock(&self->mutex);
+
+	return error ? 0 : 1;
+}
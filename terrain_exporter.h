@@ -0,0 +1,133 @@
+/*
+ * Copyright (c) 2020 Jeff Boody
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#ifndef terrain_exporter_H
+#define terrain_exporter_H
+
+#include <pthread.h>
+
+#include "terrain_codec.h"
+#include "terrain_index.h"
+#include "terrain_pack.h"
+#include "terrain_tile.h"
+
+#define TERRAIN_EXPORTER_SLOT_FREE    0
+#define TERRAIN_EXPORTER_SLOT_QUEUED  1
+#define TERRAIN_EXPORTER_SLOT_WRITING 2
+
+// maximum open packs
+#define TERRAIN_EXPORTER_PACKS 64
+
+/*
+ * The exporter writes tiles on background threads so that
+ * compression and file I/O overlap with the caller. Export
+ * updates the tile min/max, copies the tile into one of
+ * depth slots and blocks while every slot is in flight.
+ * Once a write fails the exporter rejects further tiles
+ * and the error is returned by the next export, sync or
+ * finish call. A tile which has been queued must be
+ * synced before it is imported from base. The exporter is
+ * thread safe.
+ *
+ * terrain_exporter_newPack appends tiles to packs (see
+ * terrain_pack) rather than to terrainv2 files. The
+ * least recently used idle pack is closed when
+ * TERRAIN_EXPORTER_PACKS packs are open and is reopened
+ * for append on demand. terrain_exporter_read reads a
+ * synced tile from the packs or terrainv2 files and
+ * finish closes the packs.
+ *
+ * Tiles are compressed with deflate unless another codec
+ * or a filter is selected by terrain_exporter_setCodec
+ * which must be called before the first export.
+ *
+ * The header of every exported tile is also put to the
+ * index of base (see terrain_index) which is written by
+ * finish and delete. Tiles exported by previous runs are
+ * kept in the index.
+ */
+typedef struct
+{
+	char base[256];
+
+	// slots of tiles in flight
+	int             depth;
+	int*            state;
+	terrain_tile_t* tiles;
+
+	// free slots
+	int  free_count;
+	int* free_list;
+
+	// FIFO of queued slots
+	int  queue_head;
+	int  queue_count;
+	int* queue;
+
+	int error;
+	int running;
+
+	// cond_free is signaled when a slot or pack is freed
+	// cond_queue is signaled when a slot is queued
+	pthread_mutex_t mutex;
+	pthread_cond_t  cond_free;
+	pthread_cond_t  cond_queue;
+
+	int        nth;
+	pthread_t* threads;
+
+	// header index
+	terrain_index_t* index;
+
+	// codec and filter (see terrain_codec)
+	int codec;
+	int level;
+	int filter;
+
+	// packs (optional)
+	int             pack;
+	unsigned int    pack_clock;
+	terrain_pack_t* packs[TERRAIN_EXPORTER_PACKS];
+	char            pack_fname[TERRAIN_EXPORTER_PACKS][256];
+	int             pack_refcount[TERRAIN_EXPORTER_PACKS];
+	unsigned int    pack_stamp[TERRAIN_EXPORTER_PACKS];
+} terrain_exporter_t;
+
+terrain_exporter_t* terrain_exporter_new(const char* base,
+                                         int nth, int depth);
+terrain_exporter_t* terrain_exporter_newPack(const char* base,
+                                             int nth, int depth);
+void                terrain_exporter_delete(terrain_exporter_t** _self);
+int                 terrain_exporter_setCodec(terrain_exporter_t* self,
+                                              int codec, int level,
+                                              int filter);
+int                 terrain_exporter_export(terrain_exporter_t* self,
+                                            terrain_tile_t* tile);
+int                 terrain_exporter_sync(terrain_exporter_t* self,
+                                          int x, int y, int zoom);
+int                 terrain_exporter_read(terrain_exporter_t* self,
+                                          int x, int y, int zoom,
+                                          terrain_tile_t* tile);
+int                 terrain_exporter_finish(terrain_exporter_t* self);
+
+#endif
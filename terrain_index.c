@@ -0,0 +1,686 @@
+/*
+ * Copyright (c) 2020 Jeff Boody
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define LOG_TAG "terrain"
+#include "../libcc/cc_log.h"
+#include "../libcc/cc_memory.h"
+#include "terrain_index.h"
+
+#define TERRAIN_INDEX_MAGIC   0x58444954
+#define TERRAIN_INDEX_VERSION 1
+
+// the key stores the zoom in the upper 6 bits and the
+// Morton code of x/y in the lower 58 bits
+#define TERRAIN_INDEX_ZOOM_SHIFT 58
+#define TERRAIN_INDEX_ZOOM_MAX   29
+
+typedef struct
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t count;
+	uint32_t reserved;
+} terrain_indexHeader_t;
+
+/***********************************************************
+* protected                                                *
+***********************************************************/
+
+extern int terrain_mkdir(const char* fname);
+
+/***********************************************************
+* private                                                  *
+***********************************************************/
+
+static uint64_t terrain_index_spread(uint32_t v)
+{
+	// insert a zero bit between each bit of v
+	uint64_t b = (uint64_t) v;
+	b = (b | (b << 16)) & 0x0000FFFF0000FFFFULL;
+	b = (b | (b << 8))  & 0x00FF00FF00FF00FFULL;
+	b = (b | (b << 4))  & 0x0F0F0F0F0F0F0F0FULL;
+	b = (b | (b << 2))  & 0x3333333333333333ULL;
+	b = (b | (b << 1))  & 0x5555555555555555ULL;
+	return b;
+}
+
+static int terrain_index_compare(const void* a, const void* b)
+{
+	ASSERT(a);
+	ASSERT(b);
+
+	const terrain_indexEntry_t* ea;
+	const terrain_indexEntry_t* eb;
+	ea = (const terrain_indexEntry_t*) a;
+	eb = (const terrain_indexEntry_t*) b;
+
+	if(ea->key != eb->key)
+	{
+		return (ea->key < eb->key) ? -1 : 1;
+	}
+	return 0;
+}
+
+static uint32_t terrain_index_hashKey(uint64_t key)
+{
+	key = key*0x9E3779B97F4A7C15ULL;
+	return (uint32_t) (key >> 32);
+}
+
+static int
+terrain_index_hashFind(terrain_index_t* self,
+                       uint64_t key, int* _slot)
+{
+	ASSERT(self);
+	ASSERT(_slot);
+
+	// linear probing for the entry or an empty slot
+	uint32_t mask = (uint32_t) (self->hash_size - 1);
+	uint32_t slot = terrain_index_hashKey(key) & mask;
+	while(self->hash[slot] >= 0)
+	{
+		if(self->entries[self->hash[slot]].key == key)
+		{
+			*_slot = (int) slot;
+			return self->hash[slot];
+		}
+		slot = (slot + 1) & mask;
+	}
+
+	*_slot = (int) slot;
+	return -1;
+}
+
+static int terrain_index_rehash(terrain_index_t* self, int size)
+{
+	ASSERT(self);
+
+	int* hash = (int*) MALLOC(size*sizeof(int));
+	if(hash == NULL)
+	{
+		LOGE("MALLOC failed");
+		return 0;
+	}
+
+	FREE(self->hash);
+	self->hash      = hash;
+	self->hash_size = size;
+
+	int i;
+	for(i = 0; i < size; ++i)
+	{
+		hash[i] = -1;
+	}
+
+	int slot;
+	for(i = 0; i < self->count; ++i)
+	{
+		terrain_index_hashFind(self, self->entries[i].key,
+		                       &slot);
+		hash[slot] = i;
+	}
+
+	return 1;
+}
+
+static int
+terrain_index_insert(terrain_index_t* self,
+                     terrain_indexEntry_t* entry)
+{
+	ASSERT(self);
+	ASSERT(entry);
+
+	// the hash is kept at most half full
+	if(2*(self->count + 1) > self->hash_size)
+	{
+		int size = self->hash_size ? 2*self->hash_size : 1024;
+		if(terrain_index_rehash(self, size) == 0)
+		{
+			return 0;
+		}
+	}
+
+	// replace tiles which are put again
+	int slot;
+	int idx = terrain_index_hashFind(self, entry->key, &slot);
+	if(idx >= 0)
+	{
+		self->entries[idx] = *entry;
+		return 1;
+	}
+
+	if(self->count == self->size)
+	{
+		int   size = self->size ? 2*self->size : 1024;
+		void* tmp  = REALLOC(self->entries,
+		                     size*sizeof(terrain_indexEntry_t));
+		if(tmp == NULL)
+		{
+			LOGE("REALLOC failed");
+			return 0;
+		}
+		self->entries = (terrain_indexEntry_t*) tmp;
+		self->size    = size;
+	}
+
+	self->entries[self->count] = *entry;
+	self->hash[slot]           = self->count;
+	++self->count;
+
+	return 1;
+}
+
+static terrain_indexEntry_t*
+terrain_index_find(terrain_index_t* self,
+                   int x, int y, int zoom)
+{
+	ASSERT(self);
+
+	// the mutex must be locked for writers
+	if(self->count == 0)
+	{
+		return NULL;
+	}
+
+	terrain_indexEntry_t key =
+	{
+		.key = terrain_index_key(x, y, zoom),
+	};
+
+	if(self->writer)
+	{
+		int slot;
+		int idx = terrain_index_hashFind(self, key.key, &slot);
+		return (idx >= 0) ? &self->entries[idx] : NULL;
+	}
+
+	return (terrain_indexEntry_t*)
+	       bsearch(&key, self->entries, self->count,
+	               sizeof(terrain_indexEntry_t),
+	               terrain_index_compare);
+}
+
+static int
+terrain_index_lowerBound(terrain_index_t* self,
+                         uint64_t key)
+{
+	ASSERT(self);
+
+	int lo = 0;
+	int hi = self->count;
+	while(lo < hi)
+	{
+		int mid = lo + (hi - lo)/2;
+		if(self->entries[mid].key < key)
+		{
+			lo = mid + 1;
+		}
+		else
+		{
+			hi = mid;
+		}
+	}
+
+	return lo;
+}
+
+static int
+terrain_index_load(terrain_index_t* self)
+{
+	ASSERT(self);
+
+	FILE* f = fopen(self->fname, "r");
+	if(f == NULL)
+	{
+		// the index is created on flush
+		return 1;
+	}
+
+	fseek(f, (long) 0, SEEK_END);
+	size_t file_size = (size_t) ftell(f);
+	rewind(f);
+
+	// an invalid index is replaced on flush
+	terrain_indexHeader_t hdr;
+	if((fread(&hdr, sizeof(hdr), 1, f) != 1) ||
+	   (hdr.magic != TERRAIN_INDEX_MAGIC)     ||
+	   (hdr.version != TERRAIN_INDEX_VERSION) ||
+	   (file_size != sizeof(hdr) +
+	                 hdr.count*sizeof(terrain_indexEntry_t)))
+	{
+		LOGW("invalid %s", self->fname);
+		fclose(f);
+		return 1;
+	}
+
+	terrain_indexEntry_t entry;
+	uint32_t i;
+	for(i = 0; i < hdr.count; ++i)
+	{
+		if(fread(&entry, sizeof(entry), 1, f) != 1)
+		{
+			LOGE("fread failed");
+			goto fail_read;
+		}
+
+		if(terrain_index_insert(self, &entry) == 0)
+		{
+			goto fail_insert;
+		}
+	}
+
+	fclose(f);
+
+	// success
+	return 1;
+
+	// failure
+	fail_insert:
+	fail_read:
+		fclose(f);
+	return 0;
+}
+
+static terrain_index_t*
+terrain_index_new(const char* base, int writer)
+{
+	ASSERT(base);
+
+	terrain_index_t* self;
+	self = (terrain_index_t*)
+	       CALLOC(1, sizeof(terrain_index_t));
+	if(self == NULL)
+	{
+		LOGE("CALLOC failed");
+		return NULL;
+	}
+
+	terrain_index_name(base, self->fname);
+	self->writer = writer;
+
+	if(pthread_mutex_init(&self->mutex, NULL) != 0)
+	{
+		LOGE("pthread_mutex_init failed");
+		goto fail_mutex;
+	}
+
+	// success
+	return self;
+
+	// failure
+	fail_mutex:
+		FREE(self);
+	return NULL;
+}
+
+static void terrain_index_free(terrain_index_t** _self)
+{
+	ASSERT(_self);
+
+	terrain_index_t* self = *_self;
+	if(self)
+	{
+		if(self->map)
+		{
+			munmap(self->map, self->map_size);
+		}
+		else
+		{
+			FREE(self->entries);
+		}
+		FREE(self->hash);
+		pthread_mutex_destroy(&self->mutex);
+		FREE(self);
+		*_self = NULL;
+	}
+}
+
+/***********************************************************
+* public                                                   *
+***********************************************************/
+
+terrain_index_t* terrain_index_open(const char* base)
+{
+	ASSERT(base);
+
+	terrain_index_t* self = terrain_index_new(base, 0);
+	if(self == NULL)
+	{
+		return NULL;
+	}
+
+	int fd = open(self->fname, O_RDONLY);
+	if(fd < 0)
+	{
+		LOGE("open %s failed", self->fname);
+		goto fail_open;
+	}
+
+	struct stat st;
+	if(fstat(fd, &st) != 0)
+	{
+		LOGE("fstat %s failed", self->fname);
+		goto fail_map;
+	}
+
+	size_t file_size = (size_t) st.st_size;
+	if(file_size < sizeof(terrain_indexHeader_t))
+	{
+		LOGE("invalid %s", self->fname);
+		goto fail_map;
+	}
+
+	void* map = mmap(NULL, file_size, PROT_READ,
+	                 MAP_PRIVATE, fd, 0);
+	if(map == MAP_FAILED)
+	{
+		LOGE("mmap %s failed", self->fname);
+		goto fail_map;
+	}
+	self->map      = (unsigned char*) map;
+	self->map_size = file_size;
+
+	// the map remains valid after the file is closed
+	close(fd);
+
+	terrain_indexHeader_t* hdr;
+	hdr = (terrain_indexHeader_t*) self->map;
+	if((hdr->magic != TERRAIN_INDEX_MAGIC)     ||
+	   (hdr->version != TERRAIN_INDEX_VERSION) ||
+	   (file_size != sizeof(terrain_indexHeader_t) +
+	                 hdr->count*sizeof(terrain_indexEntry_t)))
+	{
+		LOGE("invalid %s", self->fname);
+		goto fail_header;
+	}
+
+	self->count   = (int) hdr->count;
+	self->size    = self->count;
+	self->entries = (terrain_indexEntry_t*)
+	                (self->map + sizeof(terrain_indexHeader_t));
+
+	// success
+	return self;
+
+	// failure
+	fail_map:
+		close(fd);
+	fail_header:
+	fail_open:
+		terrain_index_free(&self);
+	return NULL;
+}
+
+terrain_index_t* terrain_index_append(const char* base)
+{
+	ASSERT(base);
+
+	terrain_index_t* self = terrain_index_new(base, 1);
+	if(self == NULL)
+	{
+		return NULL;
+	}
+
+	if(terrain_index_load(self) == 0)
+	{
+		goto fail_load;
+	}
+
+	// success
+	return self;
+
+	// failure
+	fail_load:
+		terrain_index_free(&self);
+	return NULL;
+}
+
+int terrain_index_close(terrain_index_t** _self)
+{
+	ASSERT(_self);
+
+	int ret = 1;
+
+	terrain_index_t* self = *_self;
+	if(self && self->writer)
+	{
+		ret = terrain_index_flush(self);
+	}
+
+	terrain_index_free(_self);
+
+	return ret;
+}
+
+void terrain_index_name(const char* base, char* fname)
+{
+	ASSERT(base);
+	ASSERT(fname);
+
+	snprintf(fname, 256, "%s/terrain.index", base);
+}
+
+uint64_t terrain_index_key(int x, int y, int zoom)
+{
+	ASSERT((zoom >= 0) && (zoom <= TERRAIN_INDEX_ZOOM_MAX));
+
+	uint64_t key = ((uint64_t) zoom) << TERRAIN_INDEX_ZOOM_SHIFT;
+	return key | terrain_index_spread((uint32_t) x) |
+	       (terrain_index_spread((uint32_t) y) << 1);
+}
+
+int terrain_index_put(terrain_index_t* self,
+                      int x, int y, int zoom,
+                      short min, short max,
+                      int flags)
+{
+	ASSERT(self);
+	ASSERT(self->writer);
+
+	terrain_indexEntry_t entry =
+	{
+		.key      = terrain_index_key(x, y, zoom),
+		.zoom     = zoom,
+		.x        = x,
+		.y        = y,
+		.min      = min,
+		.max      = max,
+		.flags    = flags,
+		.reserved = 0,
+	};
+
+	pthread_mutex_lock(&self->mutex);
+	int ret = terrain_index_insert(self, &entry);
+	if(ret)
+	{
+		self->dirty = 1;
+	}
+	pthread_mutex_unlock(&self->mutex);
+
+	return ret;
+}
+
+int terrain_index_flush(terrain_index_t* self)
+{
+	ASSERT(self);
+	ASSERT(self->writer);
+
+	pthread_mutex_lock(&self->mutex);
+	if(self->dirty == 0)
+	{
+		pthread_mutex_unlock(&self->mutex);
+		return 1;
+	}
+
+	// sort the entries and rebuild the hash
+	if(self->count)
+	{
+		qsort(self->entries, self->count,
+		      sizeof(terrain_indexEntry_t),
+		      terrain_index_compare);
+		if(terrain_index_rehash(self, self->hash_size) == 0)
+		{
+			goto fail_rehash;
+		}
+	}
+
+	// write to a part file which is renamed on success so
+	// readers never see a partial index
+	char pname[256];
+	snprintf(pname, 256, "%s.part", self->fname);
+	if(terrain_mkdir(pname) == 0)
+	{
+		goto fail_mkdir;
+	}
+
+	FILE* f = fopen(pname, "w");
+	if(f == NULL)
+	{
+		LOGE("fopen %s failed", pname);
+		goto fail_fopen;
+	}
+
+	terrain_indexHeader_t hdr =
+	{
+		.magic    = TERRAIN_INDEX_MAGIC,
+		.version  = TERRAIN_INDEX_VERSION,
+		.count    = (uint32_t) self->count,
+		.reserved = 0,
+	};
+
+	if((fwrite(&hdr, sizeof(hdr), 1, f) != 1) ||
+	   (self->count &&
+	    (fwrite(self->entries, sizeof(terrain_indexEntry_t),
+	            self->count, f) != self->count)))
+	{
+		LOGE("fwrite failed");
+		goto fail_fwrite;
+	}
+
+	if(fclose(f) != 0)
+	{
+		LOGE("fclose failed");
+		goto fail_fclose;
+	}
+
+	if(rename(pname, self->fname) != 0)
+	{
+		LOGE("rename %s failed", pname);
+		goto fail_rename;
+	}
+
+	self->dirty = 0;
+	pthread_mutex_unlock(&self->mutex);
+
+	// success
+	return 1;
+
+	// failure
+	fail_fwrite:
+		fclose(f);
+	fail_fclose:
+	fail_rename:
+		unlink(pname);
+	fail_fopen:
+	fail_mkdir:
+	fail_rehash:
+		pthread_mutex_unlock(&self->mutex);
+	return 0;
+}
+
+int terrain_index_header(terrain_index_t* self,
+                         int x, int y, int zoom,
+                         short* min, short* max,
+                         int* flags)
+{
+	ASSERT(self);
+	ASSERT(min);
+	ASSERT(max);
+	ASSERT(flags);
+
+	int found = 0;
+	if(self->writer)
+	{
+		pthread_mutex_lock(&self->mutex);
+	}
+
+	terrain_indexEntry_t* e;
+	e = terrain_index_find(self, x, y, zoom);
+	if(e)
+	{
+		*min   = e->min;
+		*max   = e->max;
+		*flags = e->flags;
+		found  = 1;
+	}
+
+	if(self->writer)
+	{
+		pthread_mutex_unlock(&self->mutex);
+	}
+
+	return found;
+}
+
+int terrain_index_exists(terrain_index_t* self,
+                         int x, int y, int zoom)
+{
+	ASSERT(self);
+
+	short min;
+	short max;
+	int   flags;
+	return terrain_index_header(self, x, y, zoom,
+	                            &min, &max, &flags);
+}
+
+const terrain_indexEntry_t*
+terrain_index_range(terrain_index_t* self,
+                    int zoom, int* count)
+{
+	ASSERT(self);
+	ASSERT(self->writer == 0);
+	ASSERT(count);
+
+	// entries are sorted by zoom and then Morton code
+	uint64_t first = ((uint64_t) zoom) <<
+	                 TERRAIN_INDEX_ZOOM_SHIFT;
+	uint64_t last  = ((uint64_t) (zoom + 1)) <<
+	                 TERRAIN_INDEX_ZOOM_SHIFT;
+
+	int i = terrain_index_lowerBound(self, first);
+	int j = terrain_index_lowerBound(self, last);
+
+	*count = j - i;
+	return (j > i) ? &self->entries[i] : NULL;
+}
@@ -0,0 +1,110 @@
+/*
+ * Copyright (c) 2020 Jeff Boody
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+
+#ifndef terrain_index_H
+#define terrain_index_H
+
+#include <pthread.h>
+#include <stdint.h>
+
+/*
+ * The index holds the header (min, max, flags) of every
+ * tile in a terrain tree so that header only traversals
+ * do not open a file per tile. The index is stored in the
+ * file named by terrain_index_name and is written by the
+ * exporter.
+ *
+ * 16 byte file header
+ * int magic
+ * int version
+ * int count
+ * int reserved
+ *
+ * The header is followed by count entries sorted by zoom
+ * and then by the Morton code of x/y so that neighboring
+ * tiles are nearby in the file. The key combines the zoom
+ * (upper 6 bits) and the Morton code (lower 58 bits).
+ *
+ * Readers map the index. Writers load an existing index,
+ * put or replace entries and write the sorted index with
+ * terrain_index_flush or terrain_index_close. Writers are
+ * thread safe.
+ */
+typedef struct
+{
+	uint64_t key;
+	int32_t  zoom;
+	int32_t  x;
+	int32_t  y;
+	int16_t  min;
+	int16_t  max;
+	int32_t  flags;
+	int32_t  reserved;
+} terrain_indexEntry_t;
+
+typedef struct
+{
+	char fname[256];
+	int  writer;
+	int  dirty;
+
+	// reader map
+	unsigned char* map;
+	size_t         map_size;
+
+	// entries
+	// readers reference the sorted entries in the map and
+	// writers append to entries which are hashed by key
+	// and sorted when flushed
+	int                   count;
+	int                   size;
+	terrain_indexEntry_t* entries;
+	int                   hash_size;
+	int*                  hash;
+
+	pthread_mutex_t mutex;
+} terrain_index_t;
+
+terrain_index_t*            terrain_index_open(const char* base);
+terrain_index_t*            terrain_index_append(const char* base);
+int                         terrain_index_close(terrain_index_t** _self);
+void                        terrain_index_name(const char* base,
+                                               char* fname);
+uint64_t                    terrain_index_key(int x, int y,
+                                              int zoom);
+int                         terrain_index_put(terrain_index_t* self,
+                                              int x, int y, int zoom,
+                                              short min, short max,
+                                              int flags);
+int                         terrain_index_flush(terrain_index_t* self);
+int                         terrain_index_header(terrain_index_t* self,
+                                                 int x, int y, int zoom,
+                                                 short* min, short* max,
+                                                 int* flags);
+int                         terrain_index_exists(terrain_index_t* self,
+                                                 int x, int y, int zoom);
+const terrain_indexEntry_t* terrain_index_range(terrain_index_t* self,
+                                                int zoom, int* count);
+
+#endif
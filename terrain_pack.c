@@ -0,0 +1,999 @@
+/*
+ * Copyright (c) 2020 Jeff Boody
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define LOG_TAG "terrain"
+#include "../libcc/cc_log.h"
+#include "../libcc/cc_memory.h"
+#include "terrain_pack.h"
+
+#define TERRAIN_PACK_MAGIC   0x4B505454
+#define TERRAIN_PACK_RECORD  0x43455254
+#define TERRAIN_PACK_VERSION 1
+
+typedef struct
+{
+	uint32_t magic;
+	uint32_t version;
+	int32_t  zoom;
+	int32_t  reserved;
+} terrain_packHeader_t;
+
+typedef struct
+{
+	uint32_t magic;
+	int32_t  zoom;
+	int32_t  x;
+	int32_t  y;
+	uint32_t size;
+	uint32_t reserved;
+} terrain_packRecord_t;
+
+typedef struct
+{
+	uint64_t offset;
+	uint32_t count;
+	uint32_t magic;
+} terrain_packTrailer_t;
+
+/***********************************************************
+* protected                                                *
+***********************************************************/
+
+extern int            terrain_mkdir(const char* fname);
+extern unsigned char* terrain_decoder_scratch(terrain_decoder_t* self,
+                                              size_t size);
+extern int            terrain_tile_readd(terrain_tile_t* self,
+                                         size_t size,
+                                         const unsigned char* buffer,
+                                         int x, int y, int zoom);
+
+/***********************************************************
+* private                                                  *
+***********************************************************/
+
+static uint64_t terrain_pack_align(uint64_t offset)
+{
+	return (offset + 7) & ~((uint64_t) 7);
+}
+
+static int terrain_pack_compare(const void* a, const void* b)
+{
+	ASSERT(a);
+	ASSERT(b);
+
+	const terrain_packEntry_t* ea;
+	const terrain_packEntry_t* eb;
+	ea = (const terrain_packEntry_t*) a;
+	eb = (const terrain_packEntry_t*) b;
+
+	if(ea->zoom != eb->zoom)
+	{
+		return (ea->zoom < eb->zoom) ? -1 : 1;
+	}
+	if(ea->x != eb->x)
+	{
+		return (ea->x < eb->x) ? -1 : 1;
+	}
+	if(ea->y != eb->y)
+	{
+		return (ea->y < eb->y) ? -1 : 1;
+	}
+	return 0;
+}
+
+static uint32_t terrain_pack_hashKey(int x, int y, int zoom)
+{
+	uint32_t h = (uint32_t) zoom;
+	h = (h*0x9E3779B1U) ^ ((uint32_t) x);
+	h = (h*0x9E3779B1U) ^ ((uint32_t) y);
+	h = h*0x9E3779B1U;
+	return h ^ (h >> 16);
+}
+
+static int
+terrain_pack_hashFind(terrain_pack_t* self,
+                      int x, int y, int zoom, int* _slot)
+{
+	ASSERT(self);
+	ASSERT(_slot);
+
+	// linear probing for the entry or an empty slot
+	uint32_t mask = (uint32_t) (self->hash_size - 1);
+	uint32_t slot = terrain_pack_hashKey(x, y, zoom) & mask;
+	while(self->hash[slot] >= 0)
+	{
+		terrain_packEntry_t* e = &self->index[self->hash[slot]];
+		if((e->x == x) && (e->y == y) && (e->zoom == zoom))
+		{
+			*_slot = (int) slot;
+			return self->hash[slot];
+		}
+		slot = (slot + 1) & mask;
+	}
+
+	*_slot = (int) slot;
+	return -1;
+}
+
+static int terrain_pack_rehash(terrain_pack_t* self, int size)
+{
+	ASSERT(self);
+
+	int* hash = (int*) MALLOC(size*sizeof(int));
+	if(hash == NULL)
+	{
+		LOGE("MALLOC failed");
+		return 0;
+	}
+
+	FREE(self->hash);
+	self->hash      = hash;
+	self->hash_size = size;
+
+	int i;
+	for(i = 0; i < size; ++i)
+	{
+		hash[i] = -1;
+	}
+
+	int slot;
+	for(i = 0; i < self->count; ++i)
+	{
+		terrain_packEntry_t* e = &self->index[i];
+		terrain_pack_hashFind(self, e->x, e->y, e->zoom, &slot);
+		hash[slot] = i;
+	}
+
+	return 1;
+}
+
+static int
+terrain_pack_insert(terrain_pack_t* self,
+                    terrain_packEntry_t* entry)
+{
+	ASSERT(self);
+	ASSERT(entry);
+
+	// the hash is kept at most half full
+	if(2*(self->count + 1) > self->hash_size)
+	{
+		int size = self->hash_size ? 2*self->hash_size : 1024;
+		if(terrain_pack_rehash(self, size) == 0)
+		{
+			return 0;
+		}
+	}
+
+	// replace tiles which are put again
+	int slot;
+	int idx = terrain_pack_hashFind(self, entry->x, entry->y,
+	                                entry->zoom, &slot);
+	if(idx >= 0)
+	{
+		self->index[idx] = *entry;
+		return 1;
+	}
+
+	if(self->count == self->size)
+	{
+		int   size = self->size ? 2*self->size : 1024;
+		void* tmp  = REALLOC(self->index,
+		                     size*sizeof(terrain_packEntry_t));
+		if(tmp == NULL)
+		{
+			LOGE("REALLOC failed");
+			return 0;
+		}
+		self->index = (terrain_packEntry_t*) tmp;
+		self->size  = size;
+	}
+
+	self->index[self->count] = *entry;
+	self->hash[slot]         = self->count;
+	++self->count;
+
+	return 1;
+}
+
+static int
+terrain_pack_validEntry(terrain_pack_t* self,
+                        const terrain_packEntry_t* entry)
+{
+	ASSERT(self);
+	ASSERT(entry);
+
+	// entries of a corrupt index must not reference bytes
+	// outside of the records
+	uint64_t begin = sizeof(terrain_packHeader_t);
+	if((entry->offset < begin)        ||
+	   (entry->offset > self->offset) ||
+	   (((uint64_t) entry->size) > self->offset - entry->offset))
+	{
+		LOGE("invalid zoom=%i, x=%i, y=%i, offset=%" PRIu64
+		     ", size=%u", entry->zoom, entry->x, entry->y,
+		     entry->offset, entry->size);
+		return 0;
+	}
+
+	return 1;
+}
+
+static int
+terrain_pack_find(terrain_pack_t* self,
+                  int x, int y, int zoom,
+                  terrain_packEntry_t* entry)
+{
+	ASSERT(self);
+	ASSERT(entry);
+
+	if(self->writer)
+	{
+		int found = 0;
+		pthread_mutex_lock(&self->mutex);
+		if(self->count)
+		{
+			int slot;
+			int idx = terrain_pack_hashFind(self, x, y, zoom,
+			                                &slot);
+			if(idx >= 0)
+			{
+				*entry = self->index[idx];
+				found  = terrain_pack_validEntry(self, entry);
+			}
+		}
+		pthread_mutex_unlock(&self->mutex);
+		return found;
+	}
+
+	if(self->count == 0)
+	{
+		return 0;
+	}
+
+	terrain_packEntry_t key =
+	{
+		.zoom = zoom,
+		.x    = x,
+		.y    = y,
+	};
+
+	terrain_packEntry_t* e;
+	e = (terrain_packEntry_t*)
+	    bsearch(&key, self->index, self->count,
+	            sizeof(terrain_packEntry_t),
+	            terrain_pack_compare);
+	if(e == NULL)
+	{
+		return 0;
+	}
+
+	*entry = *e;
+	return terrain_pack_validEntry(self, entry);
+}
+
+static int
+terrain_pack_pwrite(terrain_pack_t* self, const void* buf,
+                    size_t size, uint64_t offset)
+{
+	ASSERT(self);
+	ASSERT(buf);
+
+	const unsigned char* p = (const unsigned char*) buf;
+	while(size)
+	{
+		ssize_t bytes = pwrite(self->fd, p, size,
+		                       (off_t) offset);
+		if(bytes <= 0)
+		{
+			LOGE("pwrite failed");
+			return 0;
+		}
+		p      += bytes;
+		size   -= (size_t) bytes;
+		offset += (uint64_t) bytes;
+	}
+
+	return 1;
+}
+
+static int
+terrain_pack_pread(terrain_pack_t* self, void* buf,
+                   size_t size, uint64_t offset)
+{
+	ASSERT(self);
+	ASSERT(buf);
+
+	unsigned char* p = (unsigned char*) buf;
+	while(size)
+	{
+		ssize_t bytes = pread(self->fd, p, size,
+		                      (off_t) offset);
+		if(bytes <= 0)
+		{
+			return 0;
+		}
+		p      += bytes;
+		size   -= (size_t) bytes;
+		offset += (uint64_t) bytes;
+	}
+
+	return 1;
+}
+
+static int
+terrain_pack_trailer(const terrain_packTrailer_t* trailer,
+                     uint64_t file_size)
+{
+	ASSERT(trailer);
+
+	if(trailer->magic != TERRAIN_PACK_MAGIC)
+	{
+		return 0;
+	}
+
+	uint64_t index = terrain_pack_align(trailer->offset);
+	uint64_t end   = index + ((uint64_t) trailer->count)*
+	                 sizeof(terrain_packEntry_t) +
+	                 sizeof(terrain_packTrailer_t);
+	if((trailer->offset < sizeof(terrain_packHeader_t)) ||
+	   (end != file_size))
+	{
+		return 0;
+	}
+
+	return 1;
+}
+
+static int
+terrain_pack_readIndex(terrain_pack_t* self,
+                       uint64_t file_size)
+{
+	ASSERT(self);
+
+	terrain_packTrailer_t trailer;
+	if((file_size < sizeof(terrain_packHeader_t) +
+	                sizeof(terrain_packTrailer_t)) ||
+	   (terrain_pack_pread(self, &trailer,
+	                       sizeof(terrain_packTrailer_t),
+	                       file_size -
+	                       sizeof(terrain_packTrailer_t)) == 0) ||
+	   (terrain_pack_trailer(&trailer, file_size) == 0))
+	{
+		return 0;
+	}
+
+	int count = (int) trailer.count;
+	if(count == 0)
+	{
+		self->offset = trailer.offset;
+		return 1;
+	}
+
+	terrain_packEntry_t* index;
+	index = (terrain_packEntry_t*)
+	        MALLOC(count*sizeof(terrain_packEntry_t));
+	if(index == NULL)
+	{
+		LOGE("MALLOC failed");
+		return 0;
+	}
+
+	if(terrain_pack_pread(self, index,
+	                      count*sizeof(terrain_packEntry_t),
+	                      terrain_pack_align(trailer.offset)) == 0)
+	{
+		goto fail_read;
+	}
+
+	FREE(self->index);
+	self->index  = index;
+	self->count  = count;
+	self->size   = count;
+	self->offset = trailer.offset;
+
+	int size = 1024;
+	while(size < 2*count)
+	{
+		size *= 2;
+	}
+
+	if(terrain_pack_rehash(self, size) == 0)
+	{
+		return 0;
+	}
+
+	// success
+	return 1;
+
+	// failure
+	fail_read:
+		FREE(index);
+	return 0;
+}
+
+static int
+terrain_pack_recover(terrain_pack_t* self,
+                     uint64_t file_size)
+{
+	ASSERT(self);
+
+	// replay the records up to the first partial record
+	terrain_packRecord_t rec;
+	terrain_packEntry_t  entry;
+	uint64_t offset = sizeof(terrain_packHeader_t);
+	while(offset + sizeof(terrain_packRecord_t) <= file_size)
+	{
+		if(terrain_pack_pread(self, &rec,
+		                      sizeof(terrain_packRecord_t),
+		                      offset) == 0)
+		{
+			return 0;
+		}
+
+		uint64_t end = offset + sizeof(terrain_packRecord_t) +
+		               rec.size;
+		if((rec.magic != TERRAIN_PACK_RECORD) ||
+		   (end > file_size))
+		{
+			break;
+		}
+
+		entry.zoom   = rec.zoom;
+		entry.x      = rec.x;
+		entry.y      = rec.y;
+		entry.size   = rec.size;
+		entry.offset = offset + sizeof(terrain_packRecord_t);
+		if(terrain_pack_insert(self, &entry) == 0)
+		{
+			return 0;
+		}
+
+		offset = end;
+	}
+
+	LOGW("recovered %i tiles", self->count);
+
+	self->offset = offset;
+	return 1;
+}
+
+static terrain_pack_t* terrain_pack_new(int fd, int writer)
+{
+	terrain_pack_t* self;
+	self = (terrain_pack_t*)
+	       CALLOC(1, sizeof(terrain_pack_t));
+	if(self == NULL)
+	{
+		LOGE("CALLOC failed");
+		return NULL;
+	}
+
+	self->fd     = fd;
+	self->writer = writer;
+
+	if(pthread_mutex_init(&self->mutex, NULL) != 0)
+	{
+		LOGE("pthread_mutex_init failed");
+		goto fail_mutex;
+	}
+
+	// success
+	return self;
+
+	// failure
+	fail_mutex:
+		FREE(self);
+	return NULL;
+}
+
+static void terrain_pack_free(terrain_pack_t** _self)
+{
+	ASSERT(_self);
+
+	terrain_pack_t* self = *_self;
+	if(self)
+	{
+		if(self->map)
+		{
+			munmap(self->map, self->map_size);
+		}
+		else
+		{
+			FREE(self->index);
+		}
+		FREE(self->hash);
+		close(self->fd);
+		pthread_mutex_destroy(&self->mutex);
+		FREE(self);
+		*_self = NULL;
+	}
+}
+
+/***********************************************************
+* public                                                   *
+***********************************************************/
+
+terrain_pack_t* terrain_pack_open(const char* fname)
+{
+	ASSERT(fname);
+
+	int fd = open(fname, O_RDONLY);
+	if(fd < 0)
+	{
+		LOGE("open %s failed", fname);
+		return NULL;
+	}
+
+	terrain_pack_t* self = terrain_pack_new(fd, 0);
+	if(self == NULL)
+	{
+		close(fd);
+		return NULL;
+	}
+
+	struct stat st;
+	if(fstat(fd, &st) != 0)
+	{
+		LOGE("fstat %s failed", fname);
+		goto fail_map;
+	}
+
+	uint64_t file_size = (uint64_t) st.st_size;
+	if(file_size < sizeof(terrain_packHeader_t) +
+	               sizeof(terrain_packTrailer_t))
+	{
+		LOGE("invalid %s", fname);
+		goto fail_map;
+	}
+
+	void* map = mmap(NULL, (size_t) file_size, PROT_READ,
+	                 MAP_PRIVATE, fd, 0);
+	if(map == MAP_FAILED)
+	{
+		LOGE("mmap %s failed", fname);
+		goto fail_map;
+	}
+	self->map      = (unsigned char*) map;
+	self->map_size = (size_t) file_size;
+
+	// packs which were not closed must be recovered by
+	// reopening them for append
+	terrain_packHeader_t*  hdr;
+	terrain_packTrailer_t* trailer;
+	hdr     = (terrain_packHeader_t*) self->map;
+	trailer = (terrain_packTrailer_t*)
+	          (self->map + file_size -
+	           sizeof(terrain_packTrailer_t));
+	if((hdr->magic != TERRAIN_PACK_MAGIC)     ||
+	   (hdr->version != TERRAIN_PACK_VERSION) ||
+	   (terrain_pack_trailer(trailer, file_size) == 0))
+	{
+		LOGE("invalid %s", fname);
+		goto fail_header;
+	}
+
+	self->count  = (int) trailer->count;
+	self->size   = self->count;
+	self->offset = trailer->offset;
+	self->index  = (terrain_packEntry_t*)
+	               (self->map +
+	                terrain_pack_align(trailer->offset));
+
+	// success
+	return self;
+
+	// failure
+	fail_header:
+	fail_map:
+		terrain_pack_free(&self);
+	return NULL;
+}
+
+terrain_pack_t* terrain_pack_append(const char* fname)
+{
+	ASSERT(fname);
+
+	if(terrain_mkdir(fname) == 0)
+	{
+		return NULL;
+	}
+
+	int fd = open(fname, O_RDWR | O_CREAT,
+	              S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+	if(fd < 0)
+	{
+		LOGE("open %s failed", fname);
+		return NULL;
+	}
+
+	terrain_pack_t* self = terrain_pack_new(fd, 1);
+	if(self == NULL)
+	{
+		close(fd);
+		return NULL;
+	}
+
+	struct stat st;
+	if(fstat(fd, &st) != 0)
+	{
+		LOGE("fstat %s failed", fname);
+		goto fail_pack;
+	}
+
+	terrain_packHeader_t hdr;
+	uint64_t file_size = (uint64_t) st.st_size;
+	if(file_size == 0)
+	{
+		hdr.magic    = TERRAIN_PACK_MAGIC;
+		hdr.version  = TERRAIN_PACK_VERSION;
+		hdr.zoom     = TERRAIN_PACK_ZOOM;
+		hdr.reserved = 0;
+		if(terrain_pack_pwrite(self, &hdr, sizeof(hdr), 0) == 0)
+		{
+			goto fail_pack;
+		}
+		self->offset = sizeof(hdr);
+	}
+	else
+	{
+		if((terrain_pack_pread(self, &hdr, sizeof(hdr),
+		                       0) == 0)              ||
+		   (hdr.magic != TERRAIN_PACK_MAGIC)     ||
+		   (hdr.version != TERRAIN_PACK_VERSION))
+		{
+			LOGE("invalid %s", fname);
+			goto fail_pack;
+		}
+
+		// load the index of a closed pack or recover
+		// the index from the records
+		if((terrain_pack_readIndex(self, file_size) == 0) &&
+		   (terrain_pack_recover(self, file_size) == 0))
+		{
+			LOGE("invalid %s", fname);
+			goto fail_pack;
+		}
+
+		// records are appended over the index
+		if(ftruncate(fd, (off_t) self->offset) != 0)
+		{
+			LOGE("ftruncate %s failed", fname);
+			goto fail_pack;
+		}
+	}
+
+	// success
+	return self;
+
+	// failure
+	fail_pack:
+		terrain_pack_free(&self);
+	return NULL;
+}
+
+int terrain_pack_close(terrain_pack_t** _self)
+{
+	ASSERT(_self);
+
+	int ret = 1;
+
+	terrain_pack_t* self = *_self;
+	if(self && self->writer)
+	{
+		// append the sorted index and trailer
+		if(self->count)
+		{
+			qsort(self->index, self->count,
+			      sizeof(terrain_packEntry_t),
+			      terrain_pack_compare);
+		}
+
+		uint64_t index = terrain_pack_align(self->offset);
+		size_t   bytes = self->count*
+		                 sizeof(terrain_packEntry_t);
+
+		terrain_packTrailer_t trailer =
+		{
+			.offset = self->offset,
+			.count  = (uint32_t) self->count,
+			.magic  = TERRAIN_PACK_MAGIC,
+		};
+
+		unsigned char pad[8] = { 0 };
+		if((terrain_pack_pwrite(self, pad,
+		                        (size_t) (index - self->offset),
+		                        self->offset) == 0) ||
+		   (bytes &&
+		    (terrain_pack_pwrite(self, self->index, bytes,
+		                         index) == 0)) ||
+		   (terrain_pack_pwrite(self, &trailer,
+		                        sizeof(trailer),
+		                        index + bytes) == 0))
+		{
+			ret = 0;
+		}
+	}
+
+	terrain_pack_free(_self);
+
+	return ret;
+}
+
+void terrain_pack_name(const char* base,
+                       int x, int y, int zoom,
+                       char* fname)
+{
+	ASSERT(base);
+	ASSERT(fname);
+
+	if(zoom < TERRAIN_PACK_ZOOM)
+	{
+		snprintf(fname, 256, "%s/terrainpack/root.pack", base);
+		return;
+	}
+
+	int s = zoom - TERRAIN_PACK_ZOOM;
+	snprintf(fname, 256, "%s/terrainpack/%i/%i.pack",
+	         base, x >> s, y >> s);
+}
+
+int terrain_pack_put(terrain_pack_t* self,
+                     int x, int y, int zoom,
+                     size_t size,
+                     const unsigned char* buffer)
+{
+	ASSERT(self);
+	ASSERT(self->writer);
+	ASSERT(buffer);
+
+	terrain_packRecord_t rec =
+	{
+		.magic    = TERRAIN_PACK_RECORD,
+		.zoom     = zoom,
+		.x        = x,
+		.y        = y,
+		.size     = (uint32_t) size,
+		.reserved = 0,
+	};
+
+	// reserve the record such that concurrent writers
+	// append without holding the mutex
+	pthread_mutex_lock(&self->mutex);
+	uint64_t offset = self->offset;
+	self->offset += sizeof(rec) + size;
+	pthread_mutex_unlock(&self->mutex);
+
+	if((terrain_pack_pwrite(self, &rec, sizeof(rec),
+	                        offset) == 0) ||
+	   (terrain_pack_pwrite(self, buffer, size,
+	                        offset + sizeof(rec)) == 0))
+	{
+		return 0;
+	}
+
+	// the tile is found once it has been written
+	terrain_packEntry_t entry =
+	{
+		.zoom   = zoom,
+		.x      = x,
+		.y      = y,
+		.size   = (uint32_t) size,
+		.offset = offset + sizeof(rec),
+	};
+
+	pthread_mutex_lock(&self->mutex);
+	int ret = terrain_pack_insert(self, &entry);
+	pthread_mutex_unlock(&self->mutex);
+
+	return ret;
+}
+
+int terrain_pack_get(terrain_pack_t* self,
+                     int x, int y, int zoom,
+                     size_t* size,
+                     const unsigned char** buffer)
+{
+	ASSERT(self);
+	ASSERT(self->writer == 0);
+	ASSERT(size);
+	ASSERT(buffer);
+
+	terrain_packEntry_t entry;
+	if(terrain_pack_find(self, x, y, zoom, &entry) == 0)
+	{
+		return 0;
+	}
+
+	*size   = (size_t) entry.size;
+	*buffer = self->map + entry.offset;
+	return 1;
+}
+
+int terrain_pack_exists(terrain_pack_t* self,
+                        int x, int y, int zoom)
+{
+	ASSERT(self);
+
+	terrain_packEntry_t entry;
+	return terrain_pack_find(self, x, y, zoom, &entry);
+}
+
+int terrain_pack_read(terrain_pack_t* self,
+                      int x, int y, int zoom,
+                      terrain_tile_t* tile)
+{
+	ASSERT(self);
+	ASSERT(tile);
+
+	terrain_packEntry_t entry;
+	if(terrain_pack_find(self, x, y, zoom, &entry) == 0)
+	{
+		return 0;
+	}
+
+	if(self->map)
+	{
+		return terrain_tile_readd(tile, entry.size,
+		                          self->map + entry.offset,
+		                          x, y, zoom);
+	}
+
+	unsigned char* buffer;
+	buffer = (unsigned char*) MALLOC(entry.size);
+	if(buffer == NULL)
+	{
+		LOGE("MALLOC failed");
+		return 0;
+	}
+
+	if(terrain_pack_pread(self, buffer, entry.size,
+	                      entry.offset) == 0)
+	{
+		LOGE("pread failed");
+		goto fail_read;
+	}
+
+	if(terrain_tile_readd(tile, entry.size, buffer,
+	                      x, y, zoom) == 0)
+	{
+		goto fail_read;
+	}
+
+	FREE(buffer);
+
+	// success
+	return 1;
+
+	// failure
+	fail_read:
+		FREE(buffer);
+	return 0;
+}
+
+int terrain_pack_decode(terrain_pack_t* self,
+                        terrain_decoder_t* decoder,
+                        int x, int y, int zoom,
+                        terrain_tile_t* tile)
+{
+	ASSERT(self);
+	ASSERT(decoder);
+	ASSERT(tile);
+
+	terrain_packEntry_t entry;
+	if(terrain_pack_find(self, x, y, zoom, &entry) == 0)
+	{
+		return 0;
+	}
+
+	if(self->map)
+	{
+		return terrain_decoder_importd(decoder, entry.size,
+		                               self->map + entry.offset,
+		                               x, y, zoom, tile);
+	}
+
+	unsigned char* buffer;
+	buffer = terrain_decoder_scratch(decoder, entry.size);
+	if(buffer == NULL)
+	{
+		return 0;
+	}
+
+	if(terrain_pack_pread(self, buffer, entry.size,
+	                      entry.offset) == 0)
+	{
+		LOGE("pread failed");
+		return 0;
+	}
+
+	return terrain_decoder_importd(decoder, entry.size,
+	                               buffer, x, y, zoom, tile);
+}
+
+terrain_tile_t*
+terrain_pack_import(terrain_pack_t* self,
+                    int x, int y, int zoom)
+{
+	ASSERT(self);
+
+	terrain_tile_t* tile;
+	tile = (terrain_tile_t*) MALLOC(sizeof(terrain_tile_t));
+	if(tile == NULL)
+	{
+		LOGE("MALLOC failed");
+		return NULL;
+	}
+
+	if(terrain_pack_read(self, x, y, zoom, tile) == 0)
+	{
+		FREE(tile);
+		return NULL;
+	}
+
+	return tile;
+}
+
+int terrain_pack_header(terrain_pack_t* self,
+                        int x, int y, int zoom,
+                        short* min, short* max,
+                        int* flags)
+{
+	ASSERT(self);
+	ASSERT(min);
+	ASSERT(max);
+	ASSERT(flags);
+
+	terrain_packEntry_t entry;
+	if((terrain_pack_find(self, x, y, zoom, &entry) == 0) ||
+	   (entry.size < TERRAIN_HSIZE))
+	{
+		return 0;
+	}
+
+	if(self->map)
+	{
+		return terrain_tile_headerb(self->map + entry.offset,
+		                            TERRAIN_HSIZE,
+		                            min, max, flags);
+	}
+
+	unsigned char buffer[TERRAIN_HSIZE];
+	if(terrain_pack_pread(self, buffer, TERRAIN_HSIZE,
+	                      entry.offset) == 0)
+	{
+		LOGE("pread failed");
+		return 0;
+	}
+
+	return terrain_tile_headerb(buffer, TERRAIN_HSIZE,
+	                            min, max, flags);
+}
@@ -0,0 +1,129 @@
+/*
+ * Copyright (c) 2020 Jeff Boody
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+
+#ifndef terrain_pack_H
+#define terrain_pack_H
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "terrain_decoder.h"
+#include "terrain_tile.h"
+
+/*
+ * A pack stores the tiles of a z6 subtree in a single file
+ * rather than one terrainv2 file per tile. Tiles with a
+ * zoom less than TERRAIN_PACK_ZOOM are stored in a root
+ * pack. The files are named by terrain_pack_name.
+ *
+ * 16 byte file header
+ * int magic
+ * int version
+ * int zoom
+ * int reserved
+ *
+ * Tiles are appended as records which consist of a 24 byte
+ * record header (magic, zoom, x, y, size, reserved)
+ * followed by the size bytes of the terrainv2 file. The
+ * index of entries sorted by zoom/x/y (8 byte aligned
+ * after the records) and a 16 byte trailer (end of the
+ * records, count, magic) are written when the pack is
+ * closed. A pack which was not closed is recovered from
+ * the record headers when reopened for append.
+ *
+ * Readers map the pack and decode tiles in place with
+ * terrain_tile_importd or terrain_pack_decode and
+ * terrain_pack_get returns the mapped terrainv2 bytes of a
+ * tile. Writers append tiles with terrain_pack_put, may
+ * read tiles which were previously put and are thread
+ * safe.
+ */
+#define TERRAIN_PACK_ZOOM 6
+
+typedef struct
+{
+	int32_t  zoom;
+	int32_t  x;
+	int32_t  y;
+	uint32_t size;
+	uint64_t offset;
+} terrain_packEntry_t;
+
+typedef struct
+{
+	int fd;
+	int writer;
+
+	// reader map
+	unsigned char* map;
+	size_t         map_size;
+
+	// index entries
+	// readers reference the sorted index in the map and
+	// writers append to an index which is hashed by
+	// zoom/x/y and sorted when closed
+	int                  count;
+	int                  size;
+	terrain_packEntry_t* index;
+	int                  hash_size;
+	int*                 hash;
+
+	// end of the appended records
+	uint64_t offset;
+
+	pthread_mutex_t mutex;
+} terrain_pack_t;
+
+terrain_pack_t* terrain_pack_open(const char* fname);
+terrain_pack_t* terrain_pack_append(const char* fname);
+int             terrain_pack_close(terrain_pack_t** _self);
+void            terrain_pack_name(const char* base,
+                                  int x, int y, int zoom,
+                                  char* fname);
+int             terrain_pack_put(terrain_pack_t* self,
+                                 int x, int y, int zoom,
+                                 size_t size,
+                                 const unsigned char* buffer);
+int             terrain_pack_get(terrain_pack_t* self,
+                                 int x, int y, int zoom,
+                                 size_t* size,
+                                 const unsigned char** buffer);
+int             terrain_pack_exists(terrain_pack_t* self,
+                                    int x, int y, int zoom);
+int             terrain_pack_read(terrain_pack_t* self,
+                                  int x, int y, int zoom,
+                                  terrain_tile_t* tile);
+int             terrain_pack_decode(terrain_pack_t* self,
+                                    terrain_decoder_t* decoder,
+                                    int x, int y, int zoom,
+                                    terrain_tile_t* tile);
+terrain_tile_t* terrain_pack_import(terrain_pack_t* self,
+                                    int x, int y, int zoom);
+int             terrain_pack_header(terrain_pack_t* self,
+                                    int x, int y, int zoom,
+                                    short* min, short* max,
+                                    int* flags);
+
+#endif
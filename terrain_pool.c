@@ -0,0 +1,305 @@
+/*
+ * Copyright (c) 2020 Jeff Boody
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#include <stdlib.h>
+
+#define LOG_TAG "terrain"
+#include "../libcc/cc_log.h"
+#include "../libcc/cc_memory.h"
+#include "terrain_pool.h"
+
+/***********************************************************
+* protected                                                *
+***********************************************************/
+
+extern void terrain_tile_init(terrain_tile_t* self,
+                              int x, int y, int zoom);
+extern int  terrain_tile_readf(terrain_tile_t* self,
+                               FILE* f, int size,
+                               int x, int y, int zoom);
+extern int  terrain_tile_readd(terrain_tile_t* self,
+                               size_t size,
+                               const unsigned char* buffer,
+                               int x, int y, int zoom);
+
+/***********************************************************
+* private                                                  *
+***********************************************************/
+
+static int terrain_pool_grow(terrain_pool_t* self)
+{
+	ASSERT(self);
+
+	// resize the slab array
+	if(self->slab_count == self->slab_size)
+	{
+		int slab_size = self->slab_size ?
+		                2*self->slab_size : 16;
+
+		void** slabs;
+		slabs = (void**)
+		        REALLOC(self->slabs,
+		                slab_size*sizeof(void*));
+		if(slabs == NULL)
+		{
+			LOGE("REALLOC failed");
+			return 0;
+		}
+
+		self->slabs     = slabs;
+		self->slab_size = slab_size;
+	}
+
+	// resize the free list to hold every tile
+	int size = (self->slab_count + 1)*self->slab;
+	if(size > self->size)
+	{
+		terrain_tile_t** tiles;
+		tiles = (terrain_tile_t**)
+		        REALLOC(self->tiles,
+		                size*sizeof(terrain_tile_t*));
+		if(tiles == NULL)
+		{
+			LOGE("REALLOC failed");
+			return 0;
+		}
+
+		self->tiles = tiles;
+		self->size  = size;
+	}
+
+	// the tile contents are initialized by the caller
+	terrain_tile_t* slab;
+	slab = (terrain_tile_t*)
+	       MALLOC(self->slab*sizeof(terrain_tile_t));
+	if(slab == NULL)
+	{
+		LOGE("MALLOC failed");
+		return 0;
+	}
+
+	self->slabs[self->slab_count] = (void*) slab;
+	++self->slab_count;
+
+	int i;
+	for(i = self->slab - 1; i >= 0; --i)
+	{
+		self->tiles[self->count] = &slab[i];
+		++self->count;
+	}
+
+	return 1;
+}
+
+static terrain_tile_t* terrain_pool_get(terrain_pool_t* self)
+{
+	ASSERT(self);
+
+	terrain_tile_t* tile = NULL;
+	pthread_mutex_lock(&self->mutex);
+	if((self->count > 0) || terrain_pool_grow(self))
+	{
+		--self->count;
+		tile = self->tiles[self->count];
+		self->tiles[self->count] = NULL;
+	}
+	pthread_mutex_unlock(&self->mutex);
+
+	return tile;
+}
+
+/***********************************************************
+* public                                                   *
+***********************************************************/
+
+terrain_pool_t* terrain_pool_new(int slab)
+{
+	ASSERT(slab > 0);
+
+	terrain_pool_t* self;
+	self = (terrain_pool_t*)
+	       CALLOC(1, sizeof(terrain_pool_t));
+	if(self == NULL)
+	{
+		LOGE("CALLOC failed");
+		return NULL;
+	}
+
+	self->slab = slab;
+
+	if(pthread_mutex_init(&self->mutex, NULL) != 0)
+	{
+		LOGE("pthread_mutex_init failed");
+		goto fail_mutex;
+	}
+
+	// success
+	return self;
+
+	// failure
+	fail_mutex:
+		FREE(self);
+	return NULL;
+}
+
+void terrain_pool_delete(terrain_pool_t** _self)
+{
+	ASSERT(_self);
+
+	terrain_pool_t* self = *_self;
+	if(self)
+	{
+		if(self->count != self->slab_count*self->slab)
+		{
+			LOGW("invalid count=%i, tiles=%i",
+			     self->count, self->slab_count*self->slab);
+		}
+
+		int i;
+		for(i = 0; i < self->slab_count; ++i)
+		{
+			FREE(self->slabs[i]);
+		}
+
+		pthread_mutex_destroy(&self->mutex);
+		FREE(self->tiles);
+		FREE(self->slabs);
+		FREE(self);
+		*_self = NULL;
+	}
+}
+
+terrain_tile_t*
+terrain_pool_newTile(terrain_pool_t* self,
+                     int x, int y, int zoom)
+{
+	ASSERT(self);
+
+	terrain_tile_t* tile = terrain_pool_get(self);
+	if(tile == NULL)
+	{
+		return NULL;
+	}
+
+	terrain_tile_init(tile, x, y, zoom);
+
+	return tile;
+}
+
+terrain_tile_t*
+terrain_pool_importTile(terrain_pool_t* self,
+                        const char* base,
+                        int x, int y, int zoom)
+{
+	ASSERT(self);
+	ASSERT(base);
+
+	char fname[256];
+	snprintf(fname, 256, "%s/terrainv2/%i/%i/%i.terrain",
+	         base, zoom, x, y);
+
+	FILE* f = fopen(fname, "r");
+	if(f == NULL)
+	{
+		LOGE("invalid %s", fname);
+		return NULL;
+	}
+
+	// get file size including header
+	fseek(f, (long) 0, SEEK_END);
+	int size = (int) ftell(f);
+	rewind(f);
+
+	terrain_tile_t* tile = terrain_pool_get(self);
+	if(tile == NULL)
+	{
+		goto fail_tile;
+	}
+
+	if(terrain_tile_readf(tile, f, size, x, y, zoom) == 0)
+	{
+		goto fail_read;
+	}
+
+	fclose(f);
+
+	// success
+	return tile;
+
+	// failure
+	fail_read:
+		terrain_pool_put(self, &tile);
+	fail_tile:
+		fclose(f);
+	return NULL;
+}
+
+terrain_tile_t*
+terrain_pool_importTiled(terrain_pool_t* self,
+                         size_t size,
+                         const unsigned char* buffer,
+                         int x, int y, int zoom)
+{
+	ASSERT(self);
+	ASSERT(buffer);
+
+	terrain_tile_t* tile = terrain_pool_get(self);
+	if(tile == NULL)
+	{
+		return NULL;
+	}
+
+	if(terrain_tile_readd(tile, size, buffer,
+	                      x, y, zoom) == 0)
+	{
+		goto fail_read;
+	}
+
+	// success
+	return tile;
+
+	// failure
+	fail_read:
+		terrain_pool_put(self, &tile);
+	return NULL;
+}
+
+void terrain_pool_put(terrain_pool_t* self,
+                      terrain_tile_t** _tile)
+{
+	ASSERT(self);
+	ASSERT(_tile);
+
+	terrain_tile_t* tile = *_tile;
+	if(tile)
+	{
+		// the free list holds every tile so it cannot
+		// overflow
+		pthread_mutex_lock(&self->mutex);
+		self->tiles[self->count] = tile;
+		++self->count;
+		pthread_mutex_unlock(&self->mutex);
+
+		*_tile = NULL;
+	}
+}
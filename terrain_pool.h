@@ -0,0 +1,72 @@
+/*
+ * Copyright (c) 2020 Jeff Boody
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#ifndef terrain_pool_H
+#define terrain_pool_H
+
+#include <pthread.h>
+#include <stdio.h>
+
+#include "terrain_tile.h"
+
+/*
+ * The tile pool allocates terrain_tile_t buffers in slabs
+ * and recycles them with a free list to avoid the allocator
+ * and page fault overhead of creating and deleting many
+ * tiles. Tiles allocated by the pool must be returned with
+ * terrain_pool_put rather than deleted and must not be used
+ * after the pool is deleted. The pool is thread safe.
+ */
+typedef struct
+{
+	// tiles per slab
+	int slab;
+
+	// slabs of tiles
+	int    slab_count;
+	int    slab_size;
+	void** slabs;
+
+	// free list
+	int              count;
+	int              size;
+	terrain_tile_t** tiles;
+
+	pthread_mutex_t mutex;
+} terrain_pool_t;
+
+terrain_pool_t* terrain_pool_new(int slab);
+void            terrain_pool_delete(terrain_pool_t** _self);
+terrain_tile_t* terrain_pool_newTile(terrain_pool_t* self,
+                                     int x, int y, int zoom);
+terrain_tile_t* terrain_pool_importTile(terrain_pool_t* self,
+                                        const char* base,
+                                        int x, int y, int zoom);
+terrain_tile_t* terrain_pool_importTiled(terrain_pool_t* self,
+                                         size_t size,
+                                         const unsigned char* buffer,
+                                         int x, int y, int zoom);
+void            terrain_pool_put(terrain_pool_t* self,
+                                 terrain_tile_t** _tile);
+
+#endif
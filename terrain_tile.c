@@ -35,6 +35,7 @@
 #include "../libcc/math/cc_vec3f.h"
 #include "../libcc/cc_log.h"
 #include "../libcc/cc_memory.h"
+#include "terrain_codec.h"
 #include "terrain_tile.h"
 #include "terrain_util.h"
 
@@ -42,82 +43,6 @@
 * private                                                  *
 ***********************************************************/
 
-static int terrain_mkdir(const char* fname)
-{
-	ASSERT(fname);
-
-	int  len = strnlen(fname, 255);
-	char dir[256];
-	int  i;
-	for(i = 0; i < len; ++i)
-	{
-		dir[i]     = fname[i];
-		dir[i + 1] = '\0';
-
-		if(dir[i] == '/')
-		{
-			if(access(dir, R_OK) == 0)
-			{
-				// dir already exists
-				continue;
-			}
-
-			// try to mkdir
-			if(mkdir(dir, S_IRWXU | S_IRWXG | S_IROTH |
-			              S_IXOTH) == -1)
-			{
-				if(errno == EEXIST)
-				{
-					// already exists
-				}
-				else
-				{
-					LOGE("mkdir %s failed", dir);
-					return 0;
-				}
-			}
-		}
-	}
-
-	return 1;
-}
-
-static void terrain_tile_updateMinMax(terrain_tile_t* self)
-{
-	ASSERT(self);
-
-	// check if the min/max has already been set
-	if((self->min != TERRAIN_HEIGHT_MAX) &&
-	   (self->max != TERRAIN_HEIGHT_MIN))
-	{
-		return;
-	}
-
-	int   m;
-	int   n;
-	short h;
-	short min = TERRAIN_HEIGHT_MAX;
-	short max = TERRAIN_HEIGHT_MIN;
-	for(m = 0; m < TERRAIN_SAMPLES_TILE; ++m)
-	{
-		for(n = 0; n < TERRAIN_SAMPLES_TILE; ++n)
-		{
-			h = terrain_tile_get(self, m, n);
-			if(h < min)
-			{
-				min = h;
-			}
-			if(h > max)
-			{
-				max = h;
-			}
-		}
-	}
-
-	self->min = min;
-	self->max = max;
-}
-
 static int readintle(const unsigned char* buffer,
                      int offset)
 {
@@ -255,6 +180,82 @@ static int terrain_clampi(int v, int min, int max)
 * protected                                                *
 ***********************************************************/
 
+int terrain_mkdir(const char* fname)
+{
+	ASSERT(fname);
+
+	int  len = strnlen(fname, 255);
+	char dir[256];
+	int  i;
+	for(i = 0; i < len; ++i)
+	{
+		dir[i]     = fname[i];
+		dir[i + 1] = '\0';
+
+		if(dir[i] == '/')
+		{
+			if(access(dir, R_OK) == 0)
+			{
+				// dir already exists
+				continue;
+			}
+
+			// try to mkdir
+			if(mkdir(dir, S_IRWXU | S_IRWXG | S_IROTH |
+			              S_IXOTH) == -1)
+			{
+				if(errno == EEXIST)
+				{
+					// already exists
+				}
+				else
+				{
+					LOGE("mkdir %s failed", dir);
+					return 0;
+				}
+			}
+		}
+	}
+
+	return 1;
+}
+
+void terrain_tile_updateMinMax(terrain_tile_t* self)
+{
+	ASSERT(self);
+
+	// check if the min/max has already been set
+	if((self->min != TERRAIN_HEIGHT_MAX) &&
+	   (self->max != TERRAIN_HEIGHT_MIN))
+	{
+		return;
+	}
+
+	int   m;
+	int   n;
+	short h;
+	short min = TERRAIN_HEIGHT_MAX;
+	short max = TERRAIN_HEIGHT_MIN;
+	for(m = 0; m < TERRAIN_SAMPLES_TILE; ++m)
+	{
+		for(n = 0; n < TERRAIN_SAMPLES_TILE; ++n)
+		{
+			h = terrain_tile_get(self, m, n);
+			if(h < min)
+			{
+				min = h;
+			}
+			if(h > max)
+			{
+				max = h;
+			}
+		}
+	}
+
+	self->min = min;
+	self->max = max;
+}
+
 int terrain_tile_export(terrain_tile_t* self,
                         const char* base)
 {
@@ -311,38 +312,257 @@ int terrain_tile_export(terrain_tile_t* self,
 		goto fail_header;
 	}
 
-	// allocate dst buffer
+	// compress the samples in chunks to avoid allocating
+	// a dst buffer for the entire tile
 	int bytes = TERRAIN_SAMPLES_TOTAL*
 	            TERRAIN_SAMPLES_TOTAL*sizeof(short);
-	uLong src_size = (uLong) (bytes);
-	uLong dst_size = compressBound(src_size);
-	unsigned char* dst;
-	dst = (unsigned char*)
-	      MALLOC(dst_size*sizeof(unsigned char));
-	if(dst == NULL)
+	z_stream strm;
+	memset(&strm, 0, sizeof(z_stream));
+	if(deflateInit(&strm, Z_DEFAULT_COMPRESSION) != Z_OK)
+	{
+		LOGE("deflateInit failed");
+		goto fail_init;
+	}
+
+	unsigned char dst[16384];
+	strm.next_in  = (Bytef*) self->data;
+	strm.avail_in = (uInt) bytes;
+
+	int ret = Z_OK;
+	while(ret != Z_STREAM_END)
+	{
+		strm.next_out  = (Bytef*) dst;
+		strm.avail_out = (uInt) sizeof(dst);
+
+		ret = deflate(&strm, Z_FINISH);
+		if((ret != Z_OK) && (ret != Z_STREAM_END))
+		{
+			LOGE("deflate failed");
+			goto fail_deflate;
+		}
+
+		// write buffer
+		size_t dst_size = sizeof(dst) - strm.avail_out;
+		if(fwrite(dst, sizeof(unsigned char), dst_size,
+		          f) != dst_size)
+		{
+			LOGE("fwrite failed");
+			goto fail_fwrite;
+		}
+	}
+
+	deflateEnd(&strm);
+	fclose(f);
+	rename(pname, fname);
+
+	// success
+	return 1;
+
+	// failure
+	fail_fwrite:
+	fail_deflate:
+		deflateEnd(&strm);
+	fail_init:
+	fail_header:
+		fclose(f);
+		unlink(pname);
+	return 0;
+}
+
+int terrain_tile_headerc(const unsigned char* buffer,
+                         size_t size,
+                         short* min, short* max,
+                         int* flags, int* codec,
+                         int* filter, size_t* hsize)
+{
+	ASSERT(buffer);
+	ASSERT(min);
+	ASSERT(max);
+	ASSERT(flags);
+	ASSERT(codec);
+	ASSERT(filter);
+	ASSERT(hsize);
+
+	if(size < TERRAIN_HSIZE)
+	{
+		LOGE("invalid size=%i", (int) size);
+		return 0;
+	}
+
+	// v2 tiles are compressed with deflate
+	int magic = readintle(buffer, 0);
+	if((magic == TERRAIN_MAGIC) ||
+	   (swapendian(magic) == TERRAIN_MAGIC))
+	{
+		*codec  = TERRAIN_CODEC_DEFLATE;
+		*filter = TERRAIN_FILTER_NONE;
+		*hsize  = TERRAIN_HSIZE;
+	}
+	else if((magic == TERRAIN_MAGIC3) ||
+	        (swapendian(magic) == TERRAIN_MAGIC3))
+	{
+		if(size < TERRAIN_HSIZE3)
+		{
+			LOGE("invalid size=%i", (int) size);
+			return 0;
+		}
+
+		if(magic == TERRAIN_MAGIC3)
+		{
+			*codec  = readintle(buffer, 16);
+			*filter = readintle(buffer, 20);
+		}
+		else
+		{
+			*codec  = readintbe(buffer, 16);
+			*filter = readintbe(buffer, 20);
+		}
+		*hsize = TERRAIN_HSIZE3;
+
+		if(terrain_codec_validFilter(*filter) == 0)
+		{
+			LOGE("invalid filter=0x%X", *filter);
+			return 0;
+		}
+	}
+
+	return terrain_tile_headerb(buffer, (int) size,
+	                            min, max, flags);
+}
+
+size_t terrain_tile_bound(void)
+{
+	// the largest bound of the codecs
+	size_t bound = 0;
+	int    codec;
+	for(codec = 0; codec < TERRAIN_CODEC_COUNT; ++codec)
+	{
+		size_t b = terrain_codec_bound(codec);
+		if(b > bound)
+		{
+			bound = b;
+		}
+	}
+
+	return TERRAIN_HSIZE3 + bound;
+}
+
+size_t terrain_tile_exportd(terrain_tile_t* self,
+                            int codec, int level,
+                            int filter, size_t size,
+                            unsigned char* buffer)
+{
+	ASSERT(self);
+	ASSERT(buffer);
+
+	// unfiltered deflate tiles are exported with the v2
+	// header identically to terrain_tile_export
+	size_t hsize = TERRAIN_HSIZE3;
+	if((codec == TERRAIN_CODEC_DEFLATE) &&
+	   (filter == TERRAIN_FILTER_NONE))
+	{
+		hsize = TERRAIN_HSIZE;
+	}
+
+	// the buffer should be terrain_tile_bound bytes
+	if(size <= hsize)
+	{
+		LOGE("invalid size=%i", (int) size);
+		return 0;
+	}
+
+	// update min/max sample heights
+	terrain_tile_updateMinMax(self);
+
+	// export the header
+	int header[6] =
+	{
+		TERRAIN_MAGIC,
+		(int) self->min,
+		(int) self->max,
+		self->flags,
+		codec,
+		filter,
+	};
+	if(hsize == TERRAIN_HSIZE3)
+	{
+		header[0] = TERRAIN_MAGIC3;
+	}
+	memcpy(buffer, header, hsize);
+
+	if(filter == TERRAIN_FILTER_NONE)
+	{
+		size_t bytes;
+		bytes = terrain_codec_encode(codec, level, self->data,
+		                             size - hsize,
+		                             buffer + hsize);
+		if(bytes == 0)
+		{
+			return 0;
+		}
+
+		return hsize + bytes;
+	}
+
+	// compress the residuals of the filter
+	unsigned char* residuals;
+	residuals = (unsigned char*)
+	            MALLOC(sizeof(self->data));
+	if(residuals == NULL)
 	{
 		LOGE("MALLOC failed");
-		goto fail_dst;
+		return 0;
 	}
 
-	// compress buffer
-	unsigned char* src = (unsigned char*) self->data;
-	if(compress((Bytef*) dst, (uLongf*) &dst_size,
-	            (const Bytef*) src, src_size) != Z_OK)
+	terrain_codec_filter(filter, self->data, residuals);
+
+	size_t bytes;
+	bytes = terrain_codec_encode(codec, level, residuals,
+	                             size - hsize,
+	                             buffer + hsize);
+	FREE(residuals);
+
+	if(bytes == 0)
 	{
-		LOGE("compress failed");
-		goto fail_compress;
+		return 0;
 	}
 
-	// write buffer
-	if(fwrite(dst, sizeof(unsigned char), dst_size,
-	          f) != dst_size)
+	return hsize + bytes;
+}
+
+int terrain_tile_exportb(terrain_tile_t* self,
+                         const char* base,
+                         size_t size,
+                         const unsigned char* buffer)
+{
+	ASSERT(self);
+	ASSERT(base);
+	ASSERT(buffer);
+
+	char fname[256];
+	char pname[256];
+	snprintf(fname, 256, "%s/terrainv2/%i/%i/%i.terrain",
+	         base, self->zoom, self->x, self->y);
+	snprintf(pname, 256, "%s.part", fname);
+
+	if(terrain_mkdir(fname) == 0)
+	{
+		return 0;
+	}
+
+	FILE* f = fopen(pname, "w");
+	if(f == NULL)
+	{
+		LOGE("invalid %s", pname);
+		return 0;
+	}
+
+	if(fwrite(buffer, sizeof(unsigned char), size, f) != size)
 	{
 		LOGE("fwrite failed");
 		goto fail_fwrite;
 	}
 
-	FREE(dst);
 	fclose(f);
 	rename(pname, fname);
 
@@ -351,15 +571,139 @@ int terrain_tile_export(terrain_tile_t* self,
 
 	// failure
 	fail_fwrite:
-	fail_compress:
-		FREE(dst);
-	fail_dst:
-	fail_header:
 		fclose(f);
 		unlink(pname);
 	return 0;
 }
 
+void terrain_tile_init(terrain_tile_t* self,
+                       int x, int y, int zoom)
+{
+	ASSERT(self);
+
+	int samples = TERRAIN_SAMPLES_TOTAL*
+	              TERRAIN_SAMPLES_TOTAL*
+	              sizeof(short);
+	memset(self->data, 0, samples);
+
+	self->x     = x;
+	self->y     = y;
+	self->zoom  = zoom;
+	self->flags = 0;
+
+	// updated on export if not set
+	self->min = TERRAIN_HEIGHT_MAX;
+	self->max = TERRAIN_HEIGHT_MIN;
+}
+
+int terrain_tile_readd(terrain_tile_t* self,
+                       size_t size,
+                       const unsigned char* buffer,
+                       int x, int y, int zoom)
+{
+	ASSERT(self);
+	ASSERT(buffer);
+
+	int    codec;
+	int    filter;
+	size_t hsize;
+	if(terrain_tile_headerc(buffer, size,
+	                        &self->min, &self->max,
+	                        &self->flags, &codec,
+	                        &filter, &hsize) == 0)
+	{
+		return 0;
+	}
+
+	// decompress buffer
+	if(filter == TERRAIN_FILTER_NONE)
+	{
+		if(terrain_codec_decode(codec, size - hsize,
+		                        buffer + hsize,
+		                        self->data) == 0)
+		{
+			return 0;
+		}
+	}
+	else
+	{
+		unsigned char* residuals;
+		residuals = (unsigned char*)
+		            MALLOC(sizeof(self->data));
+		if(residuals == NULL)
+		{
+			LOGE("MALLOC failed");
+			return 0;
+		}
+
+		if(terrain_codec_decode(codec, size - hsize,
+		                        buffer + hsize,
+		                        residuals) == 0)
+		{
+			FREE(residuals);
+			return 0;
+		}
+
+		terrain_codec_unfilter(filter, residuals,
+		                       self->data);
+		FREE(residuals);
+	}
+
+	self->x    = x;
+	self->y    = y;
+	self->zoom = zoom;
+
+	return 1;
+}
+
+int terrain_tile_readf(terrain_tile_t* self,
+                       FILE* f, int size,
+                       int x, int y, int zoom)
+{
+	ASSERT(self);
+	ASSERT(f);
+
+	// the header size depends on the version
+	if(size <= 0)
+	{
+		LOGE("invalid size=%i", size);
+		return 0;
+	}
+
+	// allocate src buffer
+	unsigned char* src;
+	src = (unsigned char*) MALLOC(size*sizeof(char));
+	if(src == NULL)
+	{
+		LOGE("MALLOC failed");
+		return 0;
+	}
+
+	// read the header and samples
+	if(fread((void*) src, sizeof(char), size, f) != size)
+	{
+		LOGE("fread failed");
+		goto fail_read;
+	}
+
+	if(terrain_tile_readd(self, (size_t) size, src,
+	                      x, y, zoom) == 0)
+	{
+		goto fail_readd;
+	}
+
+	FREE(src);
+
+	// success
+	return 1;
+
+	// failure
+	fail_readd:
+	fail_read:
+		FREE(src);
+	return 0;
+}
+
 void terrain_tile_set(terrain_tile_t* self, int m, int n,
                       short h)
 {
@@ -421,19 +765,7 @@ terrain_tile_t* terrain_tile_new(int x, int y, int zoom)
 		return NULL;
 	}
 
-	int samples = TERRAIN_SAMPLES_TOTAL*
-	              TERRAIN_SAMPLES_TOTAL*
-	              sizeof(short);
-	memset(self->data, 0, samples);
-
-	self->x     = x;
-	self->y     = y;
-	self->zoom  = zoom;
-	self->flags = 0;
-
-	// updated on export if not set
-	self->min = TERRAIN_HEIGHT_MAX;
-	self->max = TERRAIN_HEIGHT_MIN;
+	terrain_tile_init(self, x, y, zoom);
 
 	// success
 	return self;
@@ -505,56 +837,16 @@ terrain_tile_importf(FILE* f, int size, int x, int y,
 		return NULL;
 	}
 
-	if(terrain_tile_headerf(f, &self->min, &self->max,
-	                        &self->flags) == 0)
+	if(terrain_tile_readf(self, f, size, x, y, zoom) == 0)
 	{
-		goto fail_header;
-	}
-
-	// allocate src buffer
-	size -= TERRAIN_HSIZE;
-	char* src = (char*) MALLOC(size*sizeof(char));
-	if(src == NULL)
-	{
-		LOGE("MALLOC failed");
-		goto fail_src;
-	}
-
-	// read the samples
-	if(fread((void*) src, sizeof(char), size, f) != size)
-	{
-		LOGE("fread failed");
 		goto fail_read;
 	}
 
-	int    bytes    = TERRAIN_SAMPLES_TOTAL*
-	                  TERRAIN_SAMPLES_TOTAL*
-	                  sizeof(short);
-	uLong  dst_size = (uLong) (bytes);
-	Bytef* dst      = (Bytef*) self->data;
-	uLong  src_size = (uLong) size;
-	if(uncompress(dst, &dst_size, (const Bytef*) src,
-	              src_size) != Z_OK)
-	{
-		LOGE("fail uncompress");
-		goto fail_uncompress;
-	}
-
-	self->x    = x;
-	self->y    = y;
-	self->zoom = zoom;
-
-	FREE(src);
-
 	// success
 	return self;
 
 	// failure
-	fail_uncompress:
 	fail_read:
-		FREE(src);
-	fail_src:
-	fail_header:
 		FREE(self);
 	return NULL;
 }
@@ -566,46 +858,26 @@ terrain_tile_importd(size_t size,
 {
 	ASSERT(buffer);
 
+	// the samples are overwritten by uncompress
 	terrain_tile_t* self;
-	self = (terrain_tile_t*)
-	       CALLOC(1, sizeof(terrain_tile_t));
+	self = (terrain_tile_t*) MALLOC(sizeof(terrain_tile_t));
 	if(self == NULL)
 	{
-		LOGE("CALLOC failed");
+		LOGE("MALLOC failed");
 		return NULL;
 	}
 
-	if(terrain_tile_headerb(buffer, size,
-	                        &self->min, &self->max,
-	                        &self->flags) == 0)
-	{
-		goto fail_header;
-	}
-
-	// uncompress buffer
-	uLong        dst_size = TERRAIN_SAMPLES_TOTAL*
-	                        TERRAIN_SAMPLES_TOTAL*
-	                        sizeof(short);
-	Bytef*       dst      = (Bytef*) self->data;
-	const Bytef* src      = (const Bytef*)
-	                        (buffer + TERRAIN_HSIZE);
-	uLong        src_size = size - TERRAIN_HSIZE;
-	if(uncompress(dst, &dst_size, src, src_size) != Z_OK)
+	if(terrain_tile_readd(self, size, buffer,
+	                      x, y, zoom) == 0)
 	{
-		LOGE("fail uncompress");
-		goto fail_uncompress;
+		goto fail_read;
 	}
 
-	self->x    = x;
-	self->y    = y;
-	self->zoom = zoom;
-
 	// success
 	return self;
 
 	// failure
-	fail_uncompress:
-	fail_header:
+	fail_read:
 		FREE(self);
 	return NULL;
 }
@@ -664,14 +936,16 @@ int terrain_tile_headerb(const unsigned char* buffer,
 	}
 
 	// parse the header
+	// v2 and v3 share the first 16 bytes
 	int magic = readintle(buffer, 0);
-	if(magic == TERRAIN_MAGIC)
+	if((magic == TERRAIN_MAGIC) || (magic == TERRAIN_MAGIC3))
 	{
 		*min   = (short) readintle(buffer, 4);
 		*max   = (short) readintle(buffer, 8);
 		*flags = readintle(buffer, 12);
 	}
-	else if(swapendian(magic) == TERRAIN_MAGIC)
+	else if((swapendian(magic) == TERRAIN_MAGIC) ||
+	        (swapendian(magic) == TERRAIN_MAGIC3))
 	{
 		*min   = (short) readintbe(buffer, 4);
 		*max   = (short) readintbe(buffer, 8);
@@ -77,6 +77,23 @@
 #define TERRAIN_MAGIC 0x7EBB00D9
 #define TERRAIN_HSIZE 16
 
+/*
+ * 24 byte v3 header
+ * int magic
+ * int min (cast to short)
+ * int max (cast to short)
+ * int flags
+ * int codec (see terrain_codec)
+ * int filter (see terrain_codec)
+ *
+ * The v3 header extends the v2 header with the codec used
+ * to compress the samples and the filter applied before
+ * compression. v2 tiles are compressed with deflate and
+ * are not filtered.
+ */
+#define TERRAIN_MAGIC3 0x7EBB00DA
+#define TERRAIN_HSIZE3 24
+
 typedef struct
 {
 	// tile address